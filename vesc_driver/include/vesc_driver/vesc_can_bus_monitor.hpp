@@ -0,0 +1,91 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CAN_BUS_MONITOR_HPP_
+#define VESC_DRIVER__VESC_CAN_BUS_MONITOR_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "vesc_driver/vesc_can_socket.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Bus utilisation, frame rates and error frames, from the traffic a CAN socket sees. Each frame is
+ * counted with its length on the wire, stuff bits and interframe space included, so the load is
+ * what the bus actually carried rather than an estimate from the payload.
+ */
+class VescCanBusMonitor
+{
+public:
+  /** Traffic since the previous report */
+  struct Report
+  {
+    double period = 0.0;                  ///< s
+    double load = 0.0;                    ///< fraction of the bit rate in use
+    double frames_per_second = 0.0;
+    uint64_t error_frames = 0;
+    uint32_t error_classes = 0;           ///< CAN_ERR_* bits of the error frames, or-ed
+    std::map<uint32_t, double> id_rates;  ///< frames/s per id, extended ids with bit 31 set
+  };
+
+  /** Bit 31 of the Report::id_rates keys, as in SocketCAN's CAN_EFF_FLAG */
+  static const uint32_t EXTENDED_ID_FLAG = 0x80000000U;
+
+  /** @param bitrate Bit rate of the bus, bit/s */
+  explicit VescCanBusMonitor(uint32_t bitrate);
+
+  /** Counts @p frame, called from the socket's receive thread. */
+  void onFrame(const VescCanFrame & frame);
+
+  /** The traffic since the previous report, or since construction. */
+  Report report();
+
+  /** Bits @p frame takes on the bus, from the start of frame to the end of the interframe space */
+  static int frameBits(const VescCanFrame & frame);
+
+private:
+  uint32_t bitrate_;
+  std::mutex mutex_;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t bits_;
+  uint64_t frames_;
+  uint64_t error_frames_;
+  uint32_t error_classes_;
+  std::map<uint32_t, uint64_t> id_frames_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CAN_BUS_MONITOR_HPP_
@@ -0,0 +1,104 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CAN_COMMAND_GROUP_HPP_
+#define VESC_DRIVER__VESC_CAN_COMMAND_GROUP_HPP_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include "vesc_driver/vesc_can_socket.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Collects setpoints for several VESCs and sends them as one burst, e.g. the wheel speeds of a
+ * 4WD base, so that they reach the controllers within a few frame times of each other rather than
+ * whenever each caller gets to send. The spread of a burst on the bus, from the echo of its first
+ * frame to that of its last, is measured as the skew.
+ */
+class VescCanCommandGroup
+{
+public:
+  /** Skew of the bursts so far, seconds */
+  struct Skew
+  {
+    uint64_t bursts = 0;  ///< bursts whose echoes were all seen
+    double last = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+  };
+
+  explicit VescCanCommandGroup(VescCanSocket & socket);
+
+  VescCanCommandGroup(const VescCanCommandGroup &) = delete;
+  VescCanCommandGroup & operator=(const VescCanCommandGroup &) = delete;
+
+  // setpoints for the next burst, the last one per controller is sent
+  void setDutyCycle(uint8_t controller_id, double duty_cycle);
+  void setCurrent(uint8_t controller_id, double current);
+  void setBrake(uint8_t controller_id, double brake);
+  void setSpeed(uint8_t controller_id, double rpm);
+  void setPosition(uint8_t controller_id, double position_deg);
+
+  /**
+   * Sends the collected setpoints back to back and starts the next burst.
+   *
+   * @return false if the interface did not accept all frames.
+   */
+  bool send();
+
+  /**
+   * Takes an echo from the socket.
+   *
+   * @return true if it was the last echo of the latest burst, the skew is updated then.
+   */
+  bool onEcho(const VescCanFrame & frame);
+
+  Skew skew() const;
+
+private:
+  void set(uint8_t controller_id, uint8_t packet_id, const VescCanFrame & frame);
+
+  VescCanSocket & socket_;
+  mutable std::mutex mutex_;
+  std::map<uint8_t, VescCanFrame> pending_;  ///< controller id to its setpoint frame
+  std::set<uint32_t> in_flight_;             ///< frame ids of the latest burst not echoed yet
+  int64_t first_echo_ns_;
+  int64_t last_echo_ns_;
+  Skew skew_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CAN_COMMAND_GROUP_HPP_
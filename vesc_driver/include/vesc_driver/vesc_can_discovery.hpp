@@ -0,0 +1,86 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CAN_DISCOVERY_HPP_
+#define VESC_DRIVER__VESC_CAN_DISCOVERY_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "vesc_driver/vesc_can_socket.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Finds the VESCs on a CAN bus: every controller id is pinged with CAN_PACKET_PING at once, and the
+ * ids that answer with CAN_PACKET_PONG within one shared timeout are live.
+ */
+class VescCanDiscovery
+{
+public:
+  /**
+   * @param socket Socket to ping on, received frames are passed in with decode().
+   * @param host_id Id the pongs are addressed to, must not be used by a VESC on the bus.
+   */
+  explicit VescCanDiscovery(VescCanSocket & socket, uint8_t host_id = 240);
+
+  VescCanDiscovery(const VescCanDiscovery &) = delete;
+  VescCanDiscovery & operator=(const VescCanDiscovery &) = delete;
+
+  /**
+   * Pings ids 0 to 254, except the host id, and waits @p timeout after the last ping for the
+   * answers. A VESC answers within a millisecond, the timeout only has to cover the bus.
+   *
+   * @return The ids that answered, in ascending order.
+   */
+  std::vector<uint8_t> sweep(std::chrono::milliseconds timeout = std::chrono::milliseconds(100));
+
+  /**
+   * Takes @p frame if it is a pong to this host. Called from the socket's receive thread.
+   *
+   * @return Whether @p frame was a pong to this host.
+   */
+  bool decode(const VescCanFrame & frame);
+
+private:
+  VescCanSocket & socket_;
+  uint8_t host_id_;
+  std::mutex mutex_;
+  bool sweeping_;
+  std::set<uint8_t> found_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CAN_DISCOVERY_HPP_
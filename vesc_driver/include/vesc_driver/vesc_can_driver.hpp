@@ -31,23 +31,37 @@
 #ifndef VESC_DRIVER__VESC_CAN_DRIVER_HPP_
 #define VESC_DRIVER__VESC_CAN_DRIVER_HPP_
 
+#include <diagnostic_updater/diagnostic_updater.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <sensor_msgs/msg/imu.hpp>
 #include <std_msgs/msg/float64.hpp>
+#include <vesc_msgs/msg/vesc_command_group.hpp>
 #include <vesc_msgs/msg/vesc_state.hpp>
 #include <vesc_msgs/msg/vesc_state_stamped.hpp>
 #include <vesc_msgs/msg/vesc_imu.hpp>
 #include <vesc_msgs/msg/vesc_imu_stamped.hpp>
+#include <atomic>
 #include <experimental/optional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "driver/vesc_driver/vesc_can_interface.hpp"
+#include "vesc_driver/vesc_can_bus_monitor.hpp"
+#include "vesc_driver/vesc_can_command_group.hpp"
+#include "vesc_driver/vesc_can_discovery.hpp"
+#include "vesc_driver/vesc_can_socket.hpp"
+#include "vesc_driver/vesc_can_status.hpp"
+#include "vesc_driver/vesc_can_transport.hpp"
+#include "vesc_driver/vesc_current_limits.hpp"
 
 namespace vesc_driver
 {
 
 using std_msgs::msg::Float64;
+using vesc_msgs::msg::VescCommandGroup;
 using vesc_msgs::msg::VescState;
 using vesc_msgs::msg::VescStateStamped;
 using vesc_msgs::msg::VescImuStamped;
@@ -64,7 +78,11 @@ private:
   robosw::VescCanInterface vesc_;
 //   void vescPacketCallback(const std::shared_ptr<VescPacket const> & packet);
 //   void vescErrorCallback(const std::string & error);
-  void VescStateUpdatedCallback(const robosw::StampedVescState &state);
+  void statusCallback(const VescCanStatus & status);
+  bool discoverControllers(int vesc_id, bool publish_all);
+  void busDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat);
+  void packetCallback(uint8_t controller_id, const VescPacketConstPtr & packet);
+  void errorCallback(const std::string & error);
 
   // limits on VESC commands
   struct CommandLimit
@@ -90,12 +108,24 @@ private:
   CommandLimit position_limit_;
   CommandLimit servo_limit_;
 
+  // limits the vesc itself enforces, pushed at startup and whenever the parameters change
+  VescCurrentLimits current_limits_;
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr current_limits_callback_;
+  rcl_interfaces::msg::SetParametersResult currentLimitsCallback(
+    const std::vector<rclcpp::Parameter> & parameters);
+  bool pushCurrentLimits(const VescCurrentLimits & limits);
+
   // ROS services
   rclcpp::Publisher<VescStateStamped>::SharedPtr state_pub_;
+  /** state of the other vescs found on the bus, if publish_all_controllers is set */
+  std::map<uint8_t, rclcpp::Publisher<VescStateStamped>::SharedPtr> controller_state_pubs_;
+  std::mutex controller_state_pubs_mutex_;
   rclcpp::Publisher<VescImuStamped>::SharedPtr imu_pub_;
   rclcpp::Publisher<Imu>::SharedPtr imu_std_pub_;
 
   rclcpp::Publisher<Float64>::SharedPtr servo_sensor_pub_;
+  rclcpp::Publisher<Float64>::SharedPtr command_skew_pub_;
+  rclcpp::SubscriptionBase::SharedPtr command_group_sub_;
   rclcpp::SubscriptionBase::SharedPtr duty_cycle_sub_;
   rclcpp::SubscriptionBase::SharedPtr current_sub_;
   rclcpp::SubscriptionBase::SharedPtr brake_sub_;
@@ -115,9 +145,9 @@ private:
   // other variables
   driver_mode_t driver_mode_;           ///< driver state machine mode (state)
   uint8_t controller_id_ = 0;
-  bool state_msg_received_ = false;
-  int fw_version_major_;                ///< firmware major version reported by vesc
-  int fw_version_minor_;                ///< firmware minor version reported by vesc
+  std::atomic<bool> state_msg_received_{false};  ///< set on the receive thread
+  std::atomic<int> fw_version_major_;   ///< firmware major version reported by vesc
+  std::atomic<int> fw_version_minor_;   ///< firmware minor version reported by vesc
 
   // ROS callbacks
   void brakeCallback(const Float64::SharedPtr brake);
@@ -126,7 +156,20 @@ private:
   void positionCallback(const Float64::SharedPtr position);
   void servoCallback(const Float64::SharedPtr servo);
   void speedCallback(const Float64::SharedPtr speed);
+  void commandGroupCallback(const VescCommandGroup::SharedPtr group);
   void timerCallback();
+
+  // status frames and replies are decoded in-tree, robosw only sends the commands. Declared last
+  // so that the receive thread stops before the publishers go away.
+  VescCanStatusDecoder status_decoder_;
+  VescCanTransport can_transport_;  ///< complete packets to and from the vesc, over can_socket_
+  VescCanCommandGroup command_group_;  ///< setpoints for several vescs, sent as one burst
+  VescCanDiscovery discovery_;
+  std::unique_ptr<VescCanBusMonitor> bus_monitor_;
+  std::unique_ptr<diagnostic_updater::Updater> updater_;
+  double bus_load_warn_;                ///< load that raises a warning, fraction of the bit rate
+  bool bus_load_high_ = false;          ///< load was above bus_load_warn_ at the last report
+  VescCanSocket can_socket_;
 };
 
 }  // namespace vesc_driver
@@ -0,0 +1,119 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CAN_SOCKET_HPP_
+#define VESC_DRIVER__VESC_CAN_SOCKET_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vesc_driver
+{
+
+/** A classic CAN frame, the VESC uses extended ids */
+struct VescCanFrame
+{
+  uint32_t id = 0;  ///< 29 bit id, the packet id in bits 8 to 15 and the controller id below
+  uint8_t len = 0;
+  uint8_t data[8] = {0};
+  bool extended = true;       ///< received: false for a standard 11 bit id, not from a VESC
+  bool error = false;         ///< received: error frame, id holds the CAN_ERR_* class bits
+  bool echo = false;          ///< received: sent by this socket, echoed once it was on the bus
+  int64_t stamp_ns = 0;       ///< received: kernel receive time, CLOCK_REALTIME
+};
+
+/**
+ * Raw SocketCAN socket on a CAN interface such as can0. Received frames, error frames included,
+ * are handed to the frame handler on a receive thread, frames are sent from the calling thread.
+ * Frames this socket sent come back as echoes, which interfaces with IFF_ECHO deliver once the
+ * frame was transmitted.
+ */
+class VescCanSocket
+{
+public:
+  typedef std::function<void (const VescCanFrame &)> FrameHandlerFunction;
+
+  VescCanSocket() = default;
+
+  /** Closes the socket and stops the receive thread. */
+  ~VescCanSocket();
+
+  VescCanSocket(const VescCanSocket &) = delete;
+  VescCanSocket & operator=(const VescCanSocket &) = delete;
+
+  /**
+   * Opens the CAN interface @p interface and starts calling @p handler with every frame received
+   * on it, including frames sent by other sockets of this host and error frames.
+   *
+   * @throw std::runtime_error if the interface does not exist or the socket cannot be opened.
+   */
+  void open(const std::string & interface, const FrameHandlerFunction & handler);
+
+  /** Closes the socket, the frame handler is not called any more when this returns. */
+  void close();
+
+  bool isOpen() const;
+
+  /**
+   * Sends @p frame as an extended frame. Safe to call from several threads and from the frame
+   * handler.
+   *
+   * @return false if the socket is closed or the interface refused the frame, e.g. because its
+   *         transmit queue is full.
+   */
+  bool send(const VescCanFrame & frame);
+
+  /**
+   * Sends @p frames back to back with one sendmmsg() call, so that no other frame of this host
+   * gets between them and they leave as close together as the bus allows.
+   *
+   * @return The number of frames the interface accepted, from the start of @p frames.
+   */
+  size_t sendBurst(const std::vector<VescCanFrame> & frames);
+
+private:
+  void receiveThread();
+
+  std::atomic<int> fd_{-1};
+  std::atomic<bool> run_{false};
+  std::unique_ptr<std::thread> thread_;
+  FrameHandlerFunction handler_;
+  std::mutex send_mutex_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CAN_SOCKET_HPP_
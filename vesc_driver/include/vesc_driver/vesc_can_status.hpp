@@ -0,0 +1,114 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CAN_STATUS_HPP_
+#define VESC_DRIVER__VESC_CAN_STATUS_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+
+#include "vesc_driver/vesc_can_socket.hpp"
+
+namespace vesc_driver
+{
+
+/** Telemetry a VESC broadcasts over CAN, merged from its status frames */
+struct VescCanStatus
+{
+  uint8_t controller_id = 0;
+  uint8_t frames = 0;              ///< status frames merged, bits of VescCanStatusDecoder
+
+  // CAN_PACKET_STATUS
+  double rpm = 0.0;                ///< electrical rpm
+  double current_motor = 0.0;      ///< A
+  double duty_cycle = 0.0;
+  // CAN_PACKET_STATUS_2
+  double amp_hours = 0.0;
+  double amp_hours_charged = 0.0;
+  // CAN_PACKET_STATUS_3
+  double watt_hours = 0.0;
+  double watt_hours_charged = 0.0;
+  // CAN_PACKET_STATUS_4
+  double temp_fet = 0.0;           ///< deg C
+  double temp_motor = 0.0;         ///< deg C
+  double current_input = 0.0;      ///< A
+  double pid_pos = 0.0;            ///< deg
+  // CAN_PACKET_STATUS_5
+  int32_t tachometer = 0;
+  double voltage_input = 0.0;      ///< V
+};
+
+/**
+ * Merges the status frames CAN_PACKET_STATUS to STATUS_5 of every VESC on the bus into one
+ * snapshot per controller. The VESC sends the frames its send_can_status setting selects back to
+ * back, starting with CAN_PACKET_STATUS. The decoder learns that set from the first full cycle and
+ * hands the snapshot on once all of them have arrived, so there is one update per cycle rather
+ * than one per frame.
+ */
+class VescCanStatusDecoder
+{
+public:
+  typedef std::function<void (const VescCanStatus &)> StatusHandlerFunction;
+
+  /** Bits of VescCanStatus::frames */
+  enum : uint8_t
+  {
+    STATUS_1 = 1 << 0,
+    STATUS_2 = 1 << 1,
+    STATUS_3 = 1 << 2,
+    STATUS_4 = 1 << 3,
+    STATUS_5 = 1 << 4
+  };
+
+  explicit VescCanStatusDecoder(const StatusHandlerFunction & handler);
+
+  /**
+   * Merges @p frame into its controller's snapshot if it is a status frame, and calls the status
+   * handler if that completes the controller's cycle.
+   *
+   * @return Whether @p frame was a status frame.
+   */
+  bool decode(const VescCanFrame & frame);
+
+private:
+  struct Controller
+  {
+    VescCanStatus status;
+    uint8_t cycle = 0;  ///< frames the controller sends per cycle, 0 until learned
+  };
+
+  StatusHandlerFunction handler_;
+  std::map<uint8_t, Controller> controllers_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CAN_STATUS_HPP_
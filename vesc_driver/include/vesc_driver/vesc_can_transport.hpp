@@ -0,0 +1,125 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CAN_TRANSPORT_HPP_
+#define VESC_DRIVER__VESC_CAN_TRANSPORT_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "vesc_driver/vesc_can_socket.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Carries complete VESC packets over CAN with the firmware's buffer protocol: the payload is
+ * written into the receiver's buffer with CAN_PACKET_FILL_RX_BUFFER(_LONG) frames and processed
+ * with CAN_PACKET_PROCESS_RX_BUFFER, or sent in one CAN_PACKET_PROCESS_SHORT_BUFFER frame if it
+ * fits. Replies come back the same way and are parsed by VescPacketFactory.
+ *
+ * A VESC has one receive buffer, and so does the reply id it answers to. Transfers to one
+ * controller are therefore sent one after the other, while transfers to different controllers run
+ * concurrently. Each controller is answered on a reply id of its own, taken from a range of ids no
+ * VESC on the bus may use, so that replies of several controllers can be in flight together.
+ */
+class VescCanTransport
+{
+public:
+  typedef std::function<void (uint8_t controller_id, const VescPacketConstPtr &)>
+    PacketHandlerFunction;
+  typedef std::function<void (const std::string &)> ErrorHandlerFunction;
+
+  /**
+   * @param socket Socket to send on, received frames are passed in with decode().
+   * @param first_reply_id First of the ids the controllers reply to.
+   * @param reply_id_count Number of reply ids. Controllers beyond that share ids, and their
+   *                       replies must not overlap.
+   */
+  explicit VescCanTransport(
+    VescCanSocket & socket, uint8_t first_reply_id = 224, uint8_t reply_id_count = 16);
+
+  VescCanTransport(const VescCanTransport &) = delete;
+  VescCanTransport & operator=(const VescCanTransport &) = delete;
+
+  void setPacketHandler(const PacketHandlerFunction & handler);
+  void setErrorHandler(const ErrorHandlerFunction & handler);
+
+  /**
+   * Sends @p packet to the VESC @p controller_id, which processes it as if it came over its serial
+   * port and sends the reply, if any, back over CAN. Waits for an earlier transfer to the same
+   * controller to finish sending; safe to call from several threads.
+   *
+   * @return false if the socket refused a frame.
+   */
+  bool send(uint8_t controller_id, const VescPacket & packet);
+
+  /**
+   * Takes @p frame if it belongs to a reply, and calls the packet handler once a reply is complete.
+   * Called from the socket's receive thread.
+   *
+   * @return Whether @p frame was part of a reply.
+   */
+  bool decode(const VescCanFrame & frame);
+
+private:
+  bool sendFrame(uint32_t id, const uint8_t * data, uint8_t len);
+  void handlePayload(uint8_t controller_id, const uint8_t * payload, size_t size);
+
+  /** Outgoing state of one controller */
+  struct Controller
+  {
+    uint8_t reply_id;
+    std::mutex mutex;  ///< held while a transfer is sent
+  };
+
+  /** The controller @p controller_id, assigned a reply id on first use */
+  Controller & controller(uint8_t controller_id);
+
+  VescCanSocket & socket_;
+  uint8_t first_reply_id_;
+  uint8_t reply_id_count_;
+  PacketHandlerFunction packet_handler_;
+  ErrorHandlerFunction error_handler_;
+
+  std::mutex controllers_mutex_;
+  std::map<uint8_t, std::unique_ptr<Controller>> controllers_;
+
+  std::map<uint8_t, Buffer> rx_buffers_;  ///< reply id to received bytes, receive thread only
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CAN_TRANSPORT_HPP_
@@ -0,0 +1,126 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CONFIG_HPP_
+#define VESC_DRIVER__VESC_CONFIG_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * MCCONF_SIGNATURE of the firmware releases whose confgenerator.c layout the motor configuration
+ * schema was checked against, the default of the driver's mcconf_signatures parameter.
+ */
+extern const std::vector<uint32_t> KNOWN_MCCONF_SIGNATURES;
+
+/** APPCONF_SIGNATURE of the checked firmware releases, see KNOWN_MCCONF_SIGNATURES */
+extern const std::vector<uint32_t> KNOWN_APPCONF_SIGNATURES;
+
+/**
+ * Decode the limits section of a serialized mc_configuration (COMM_GET_MCCONF reply). Only the
+ * fields from pwm_mode up to l_duty_start are filled in, the rest of @p conf is left untouched.
+ * The layout is selected by firmware major version, currently only the confgenerator format used
+ * since firmware 5 is supported.
+ *
+ * Any change to the configuration struct in the firmware changes its layout, and with it the
+ * signature the VESC sends first (MCCONF_SIGNATURE in the firmware's confgenerator.h). Only data
+ * with one of @p signatures is decoded, a layout that merely has the same major version would
+ * otherwise decode into wrong limits.
+ *
+ * @param data Serialized configuration, without the packet id.
+ * @param fw_major Firmware major version of the VESC that sent the configuration.
+ * @param signatures Signatures of the layouts known to match the schema.
+ * @param conf[out] Decoded configuration.
+ * @param signature[out] Optional, configuration signature sent by the VESC. Also set if the
+ *                       signature is not accepted.
+ *
+ * @return True if the data could be decoded, false if the firmware version or the signature is
+ *         not supported or the data is too short.
+ */
+bool deserializeMcConf(
+  const Buffer & data, int fw_major, const std::vector<uint32_t> & signatures,
+  mc_configuration * conf, uint32_t * signature = nullptr);
+
+/**
+ * Decode the general settings at the start of a serialized app_configuration (COMM_GET_APPCONF
+ * reply), i.e. controller_id up to can_baud_rate. The signature is APPCONF_SIGNATURE, see
+ * deserializeMcConf().
+ */
+bool deserializeAppConf(
+  const Buffer & data, int fw_major, const std::vector<uint32_t> & signatures,
+  app_configuration * conf, uint32_t * signature = nullptr);
+
+/**
+ * On-disk cache of serialized VESC configurations, keyed by device UUID and firmware version, so
+ * a restarted driver does not need to transfer the configuration again.
+ */
+class VescConfigCache
+{
+public:
+  /** @param directory Directory the cache files are kept in, created on first store. */
+  explicit VescConfigCache(const std::string & directory);
+
+  /**
+   * Load a cached configuration.
+   *
+   * @param kind Configuration kind, e.g. "mcconf" or "appconf".
+   * @return True if a cached configuration was found.
+   */
+  bool load(
+    const std::string & uuid, int fw_major, int fw_minor, const std::string & kind,
+    Buffer * data) const;
+
+  /** Store a configuration, replacing any cached one. Returns false if the file can't be written */
+  bool store(
+    const std::string & uuid, int fw_major, int fw_minor, const std::string & kind,
+    const Buffer & data) const;
+
+  const std::string & directory() const
+  {
+    return directory_;
+  }
+
+private:
+  std::string path(
+    const std::string & uuid, int fw_major, int fw_minor, const std::string & kind) const;
+
+  std::string directory_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CONFIG_HPP_
@@ -0,0 +1,118 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CURRENT_LIMITS_HPP_
+#define VESC_DRIVER__VESC_CURRENT_LIMITS_HPP_
+
+#include <rclcpp/node_interfaces/node_parameters_interface.hpp>
+#include <rclcpp/parameter.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_can_socket.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Current limits pushed to the vesc at runtime, from the motor_current_min/max,
+ * input_current_min/max and persist_current_limits parameters. Unlike the command limits, which
+ * only clip what the driver sends, these bound the vesc's own controllers, e.g. the regenerative
+ * current while braking. A limit of 0 is unset; a min/max pair is only pushed once both are set,
+ * so the vesc keeps its configured limits until then.
+ */
+struct VescCurrentLimits
+{
+  double motor_min = 0.0;     ///< A, braking / regenerative motor current, negative
+  double motor_max = 0.0;     ///< A, motor current, positive
+  double input_min = 0.0;     ///< A, current into the battery, negative
+  double input_max = 0.0;     ///< A, current drawn from the battery, positive
+  bool persist = false;       ///< also store the limits in the vesc's flash
+
+  /** No limit is set, nothing is pushed */
+  bool empty() const
+  {
+    return motor_min == 0.0 && motor_max == 0.0 && input_min == 0.0 && input_max == 0.0;
+  }
+
+  bool hasMotor() const
+  {
+    return motor_min != 0.0 && motor_max != 0.0;
+  }
+
+  bool hasInput() const
+  {
+    return input_min != 0.0 && input_max != 0.0;
+  }
+
+  bool operator==(const VescCurrentLimits & other) const;
+  bool operator!=(const VescCurrentLimits & other) const
+  {
+    return !(*this == other);
+  }
+
+  /**
+   * Declare the parameters and read their initial values. If a value is invalid no limits are
+   * pushed and the @p reason is set.
+   */
+  static VescCurrentLimits declare(
+    rclcpp::node_interfaces::NodeParametersInterface & params, std::string * reason);
+
+  /**
+   * Apply the current limit parameters among @p parameters, the others are ignored. Returns false
+   * with the @p reason and leaves the limits unchanged if a value has the wrong sign.
+   */
+  bool update(const std::vector<rclcpp::Parameter> & parameters, std::string * reason);
+
+  /** For the log, e.g. "motor -20.0 to 60.0 A, input unchanged" */
+  std::string describe() const;
+
+  /**
+   * CAN_PACKET_CONF(_STORE)_CURRENT_LIMITS and _IN frames to @p controller_id for the pairs that
+   * are set. Each pair is a single frame, the vesc applies it as soon as it arrives.
+   */
+  std::vector<VescCanFrame> canFrames(uint8_t controller_id) const;
+
+  /**
+   * Limits for COMM_SET_MCCONF_TEMP. That packet takes the motor currents as scales of the
+   * configured ones, so motor limits beyond @p conf can't be reached and are capped, with
+   * @p capped set. Everything that is not set is taken from @p conf.
+   */
+  VescPacketSetMcconfTemp::Limits mcconfTemp(const mc_configuration & conf, bool * capped) const;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CURRENT_LIMITS_HPP_
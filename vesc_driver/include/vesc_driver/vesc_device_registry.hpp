@@ -0,0 +1,113 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_DEVICE_REGISTRY_HPP_
+#define VESC_DRIVER__VESC_DEVICE_REGISTRY_HPP_
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vesc_driver
+{
+
+/** Identity of a VESC found on a serial port */
+struct VescDeviceInfo
+{
+  std::string port;    ///< canonical device path, e.g. /dev/ttyACM0
+  std::string uuid;    ///< uuid as formatted by VescPacketFWVersion::uuidString()
+  std::string hwname;  ///< hardware name reported by the firmware
+  int fw_major = -1;
+  int fw_minor = -1;
+};
+
+/**
+ * Small text file recording the VESCs found on serial ports, one device per line. It is written by
+ * vesc_device_namer when udev sees a VESC and read by the driver, so the driver already knows the
+ * firmware version and uuid of the device before it gets the first reply, or vesc_device_discovery
+ * to map uuids to ports. The file lives in /run/vesc by default since the port assignment does
+ * not survive a reboot.
+ *
+ * Only root, i.e. udev or a tool run with sudo, can write the registry, and a file or directory
+ * that anyone else could have written is ignored. A forged entry would otherwise point a driver
+ * at another port or at another device's cached configuration.
+ */
+class VescDeviceRegistry
+{
+public:
+  static const char * const DEFAULT_PATH;
+
+  explicit VescDeviceRegistry(const std::string & path = DEFAULT_PATH);
+
+  /** Read the registry file. Returns false if it does not exist, can't be read or isn't trusted. */
+  bool load();
+
+  /**
+   * Add or replace the entry of @p info.port and write the registry file. The file is locked while
+   * it is updated, so several namer processes can update it concurrently.
+   */
+  bool update(const VescDeviceInfo & info);
+
+  /**
+   * Add or replace all of @p devices in one locked update, and drop the entries of
+   * @p stale_ports, e.g. ports that were probed but did not answer.
+   */
+  bool update(
+    const std::vector<VescDeviceInfo> & devices,
+    const std::vector<std::string> & stale_ports = std::vector<std::string>());
+
+  /** Look up the device on @p port, symlinks such as /dev/vesc/<uuid> are resolved first. */
+  bool findByPort(const std::string & port, VescDeviceInfo * info) const;
+
+  /** Look up the port of the device with @p uuid. */
+  bool findByUuid(const std::string & uuid, VescDeviceInfo * info) const;
+
+  const std::map<std::string, VescDeviceInfo> & devices() const
+  {
+    return devices_;
+  }
+
+  /** Canonical path of a serial port, with symlinks resolved. Returns @p port if it can't be. */
+  static std::string canonicalPort(const std::string & port);
+
+private:
+  void parse(const std::string & contents);
+  void index();
+  std::string serialize() const;
+
+  std::string path_;
+  std::map<std::string, VescDeviceInfo> devices_;  ///< keyed by canonical port
+  std::unordered_map<std::string, std::string> ports_by_uuid_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_DEVICE_REGISTRY_HPP_
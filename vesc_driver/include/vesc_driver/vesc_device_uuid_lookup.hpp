@@ -19,54 +19,73 @@
 
 
 #include <string>
-#include <memory>
+#include <vector>
 
 #include "vesc_driver/datatypes.hpp"
-#include "vesc_driver/vesc_interface.hpp"
+#include "vesc_driver/vesc_device_registry.hpp"
 #include "vesc_driver/vesc_packet.hpp"
 
 namespace vesc_driver
 {
 
+/**
+ * Synchronous probe identifying the VESC on a serial port. It writes a single COMM_FW_VERSION
+ * request and waits on the port for the reply until a deadline, without starting any threads, so
+ * a udev rule running it returns as soon as the VESC answers.
+ */
 class VescDeviceLookup
 {
 public:
-  explicit VescDeviceLookup(std::string device);
+  static const int DEFAULT_TIMEOUT_MS = 500;
+
+  /**
+   * Probe the VESC on @p device, returns when the reply is parsed or after @p timeout_ms.
+   */
+  explicit VescDeviceLookup(std::string device, int timeout_ms = DEFAULT_TIMEOUT_MS);
+  ~VescDeviceLookup();
+
+  VescDeviceLookup(const VescDeviceLookup &) = delete;
+  VescDeviceLookup & operator=(const VescDeviceLookup &) = delete;
 
   const char * deviceUUID() const;
   const char * version() const;
   const char * hwname() const;
+  int fwMajor() const;
+  int fwMinor() const;
+  const char * error() const;
   void close();
   bool isReady();
 
+  /**
+   * Probe all @p ports concurrently, the requests are written to every port first and the replies
+   * are collected with a single poll() over all of them. Returns when every port has replied or
+   * failed, or after @p timeout_ms.
+   *
+   * @return The VESCs found, ports that did not reply are not included.
+   */
+  static std::vector<VescDeviceInfo> discover(
+    const std::vector<std::string> & ports, int timeout_ms = DEFAULT_TIMEOUT_MS);
+
 private:
   std::string device_;
   std::string uuid_;
   std::string version_;
   std::string hwname_;
+  int fw_major_;
+  int fw_minor_;
   std::string error_;
   bool ready_;
 
-private:
-  // interface to the VESC
-  VescInterface vesc_;
-  void vescPacketCallback(const std::shared_ptr<VescPacket const> & packet);
-  void vescErrorCallback(const std::string & error);
+  int fd_;        ///< serial port, -1 if closed
+  Buffer buffer_;  ///< received bytes not yet parsed
+
+  /** Only open the port and send the request, used by discover() */
+  struct Deferred {};
+  VescDeviceLookup(std::string device, Deferred);
 
-  static std::string decode_uuid(const uint8_t * uuid)
-  {
-    char uuid_data[100] = "";
-    std::string uuid_founded;
-    snprintf(
-      uuid_data, sizeof(uuid_data),
-      "%02x%02x%02x-%02x%02x%02x-%02x%02x%02x-%02x%02x%02x",
-      uuid[0], uuid[1], uuid[2],
-      uuid[3], uuid[4], uuid[5],
-      uuid[6], uuid[7], uuid[8],
-      uuid[9], uuid[10], uuid[11]
-    );
-    return uuid_data;
-  }
+  bool open();
+  bool sendRequest();
+  bool readReply();
 };
 }  // namespace vesc_driver
 
@@ -31,34 +31,76 @@
 #ifndef VESC_DRIVER__VESC_DRIVER_HPP_
 #define VESC_DRIVER__VESC_DRIVER_HPP_
 
+#include <diagnostic_updater/diagnostic_updater.hpp>
+#include <lifecycle_msgs/msg/state.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <rclcpp_lifecycle/lifecycle_node.hpp>
+#include <rclcpp_lifecycle/lifecycle_publisher.hpp>
 #include <sensor_msgs/msg/imu.hpp>
 #include <std_msgs/msg/float64.hpp>
+#include <vesc_msgs/msg/vesc_fault.hpp>
 #include <vesc_msgs/msg/vesc_state.hpp>
 #include <vesc_msgs/msg/vesc_state_stamped.hpp>
 #include <vesc_msgs/msg/vesc_imu.hpp>
 #include <vesc_msgs/msg/vesc_imu_stamped.hpp>
+#include <vesc_msgs/msg/vesc_rotor_position.hpp>
+#include <vesc_msgs/msg/vesc_sample_capture.hpp>
+#include <vesc_msgs/srv/vesc_sample_trigger.hpp>
+#include <vesc_msgs/srv/vesc_terminal.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <experimental/optional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_config.hpp"
+#include "vesc_driver/vesc_current_limits.hpp"
 #include "vesc_driver/vesc_interface.hpp"
 #include "vesc_driver/vesc_packet.hpp"
+#include "vesc_driver/vesc_reactor.hpp"
 
 namespace vesc_driver
 {
 
 using std_msgs::msg::Float64;
+using vesc_msgs::msg::VescFault;
 using vesc_msgs::msg::VescState;
 using vesc_msgs::msg::VescStateStamped;
 using vesc_msgs::msg::VescImuStamped;
+using vesc_msgs::msg::VescRotorPosition;
+using vesc_msgs::msg::VescSampleCapture;
+using vesc_msgs::srv::VescSampleTrigger;
+using vesc_msgs::srv::VescTerminal;
 using sensor_msgs::msg::Imu;
 
+/**
+ * Driver for a VESC on a serial port, as a lifecycle node. Configuring opens the port and fetches
+ * the device info and configuration, activating starts the telemetry and accepts motor commands,
+ * deactivating stops the motor and the telemetry but keeps the port open. With the autostart
+ * parameter set (the default) the node configures and activates itself on construction. Losing
+ * the port is a lifecycle error: on_error() releases the port and the node ends up unconfigured,
+ * where a lifecycle manager can configure it again. A failed startup leaves the node in its
+ * previous state. Only the standalone executable sets shutdown_on_failure to exit instead, a
+ * composed node must not bring its container down.
+ */
 class VescDriver
-  : public rclcpp::Node
+  : public rclcpp_lifecycle::LifecycleNode
 {
 public:
   explicit VescDriver(const rclcpp::NodeOptions & options);
+  ~VescDriver() override;
+
+  using CallbackReturn = rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn;
+  CallbackReturn on_configure(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_activate(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_deactivate(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_cleanup(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_shutdown(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_error(const rclcpp_lifecycle::State & state) override;
 
 private:
   // interface to the VESC
@@ -70,17 +112,24 @@ private:
   struct CommandLimit
   {
     CommandLimit(
-      rclcpp::Node * node_ptr,
+      rclcpp_lifecycle::LifecycleNode * node_ptr,
       const std::string & str,
       const std::experimental::optional<double> & min_lower = std::experimental::optional<double>(),
       const std::experimental::optional<double> & max_upper =
       std::experimental::optional<double>());
     double clip(double value);
-    rclcpp::Node * node_ptr;
+    void restrict(
+      const std::experimental::optional<double> & vesc_lower,
+      const std::experimental::optional<double> & vesc_upper);
+    void reset();
+    rclcpp_lifecycle::LifecycleNode * node_ptr;
     rclcpp::Logger logger;
     std::string name;
-    std::experimental::optional<double> lower;
+    std::experimental::optional<double> lower;       ///< in effect
     std::experimental::optional<double> upper;
+    std::experimental::optional<double> user_lower;  ///< from the parameters, before restrict()
+    std::experimental::optional<double> user_upper;
+    std::mutex mutex;  ///< guards lower / upper, restrict() is called from the packet thread
   };
 
   CommandLimit duty_cycle_limit_;
@@ -90,12 +139,22 @@ private:
   CommandLimit position_limit_;
   CommandLimit servo_limit_;
 
+  // limits the vesc itself enforces, pushed once the motor configuration is known and whenever the
+  // parameters change. COMM_SET_MCCONF_TEMP carries the configured erpm, duty and power limits too.
+  std::mutex current_limits_mutex_;     ///< guards current_limits_, mcconf_ and mcconf_live_
+  VescCurrentLimits current_limits_;
+  bool mcconf_live_;                    ///< mcconf_ was sent by the vesc, not taken from the cache
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr current_limits_callback_;
+  rcl_interfaces::msg::SetParametersResult currentLimitsCallback(
+    const std::vector<rclcpp::Parameter> & parameters);
+  void sendCurrentLimits();             ///< current_limits_mutex_ held
+
   // ROS services
-  rclcpp::Publisher<VescStateStamped>::SharedPtr state_pub_;
-  rclcpp::Publisher<VescImuStamped>::SharedPtr imu_pub_;
-  rclcpp::Publisher<Imu>::SharedPtr imu_std_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<VescStateStamped>::SharedPtr state_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<VescImuStamped>::SharedPtr imu_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<Imu>::SharedPtr imu_std_pub_;
 
-  rclcpp::Publisher<Float64>::SharedPtr servo_sensor_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<Float64>::SharedPtr servo_sensor_pub_;
   rclcpp::SubscriptionBase::SharedPtr duty_cycle_sub_;
   rclcpp::SubscriptionBase::SharedPtr current_sub_;
   rclcpp::SubscriptionBase::SharedPtr brake_sub_;
@@ -103,6 +162,15 @@ private:
   rclcpp::SubscriptionBase::SharedPtr position_sub_;
   rclcpp::SubscriptionBase::SharedPtr servo_sub_;
   rclcpp::TimerBase::SharedPtr timer_;
+  std::shared_ptr<VescReactor> reactor_;  ///< process-wide I/O thread, if single_io_thread is set
+  VescReactor::TimerId reactor_timer_;    ///< poll timer on the reactor, -1 if not running
+  rclcpp_lifecycle::LifecyclePublisher<VescFault>::SharedPtr fault_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<VescFault>::SharedPtr fault_log_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<VescRotorPosition>::SharedPtr rotor_position_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<VescSampleCapture>::SharedPtr sample_pub_;
+  rclcpp::Service<VescSampleTrigger>::SharedPtr sample_srv_;
+  rclcpp::CallbackGroup::SharedPtr terminal_group_;  ///< keeps terminal waits off the control loop
+  rclcpp::Service<VescTerminal>::SharedPtr terminal_srv_;
 
   // driver modes (possible states)
   typedef enum
@@ -113,9 +181,111 @@ private:
   driver_mode_t;
 
   // other variables
-  driver_mode_t driver_mode_;           ///< driver state machine mode (state)
-  int fw_version_major_;                ///< firmware major version reported by vesc
-  int fw_version_minor_;                ///< firmware minor version reported by vesc
+  std::atomic<driver_mode_t> driver_mode_;  ///< driver state machine mode (state)
+  std::atomic<bool> active_;            ///< lifecycle state is active, telemetry and commands on
+  bool autostart_;                      ///< configured and activated without a lifecycle manager
+  bool shutdown_on_failure_;            ///< shut the process down on a failure, standalone only
+  uint16_t imu_mask_;                   ///< IMU fields requested from the vesc, 0 disables polling
+  uint8_t rotor_position_mode_;         ///< disp_pos_mode streamed by the vesc
+
+  // parameters read at construction, used by on_configure
+  std::string port_;
+  std::string uuid_;
+  std::string device_registry_;
+  VescSerialConfig serial_config_;
+  double poll_rate_;                    ///< telemetry polling rate, Hz
+  bool low_latency_;                    ///< switch the port to low latency after connecting
+
+  // vesc configuration, fetched once and cached on disk
+  std::unique_ptr<VescConfigCache> config_cache_;  ///< empty if caching is disabled
+  std::vector<uint32_t> mcconf_signatures_;  ///< motor configuration layouts that are decoded
+  std::vector<uint32_t> appconf_signatures_;  ///< app configuration layouts that are decoded
+  /** The vesc the configuration belongs to, as reported or taken from the device registry */
+  struct DeviceIdentity
+  {
+    std::string uuid;
+    int fw_major = -1;
+    int fw_minor = -1;
+  };
+  mutable std::mutex device_mutex_;     ///< guards device_, set on the packet thread
+  DeviceIdentity device_;
+  DeviceIdentity device() const;        ///< consistent copy of device_
+  std::atomic<bool> config_requested_;  ///< configuration has been loaded or requested
+  mc_configuration mcconf_;             ///< motor configuration (limits section) reported by vesc
+  std::atomic<bool> mcconf_valid_;
+  app_configuration appconf_;           ///< app configuration (general settings) reported by vesc
+  bool appconf_valid_;
+
+  // startup timing
+  std::chrono::steady_clock::time_point startup_time_;  ///< when the driver started connecting
+  bool device_cached_;                  ///< device info was taken from the device registry
+  std::atomic<bool> first_command_sent_;
+  double millisecondsSinceStartup() const;
+  void enterOperating();
+  void commandSent();
+  bool commandsEnabled() const;
+  void fail();
+  void stopMotor();
+  void releaseInterfaces();
+  std::atomic<bool> link_lost_;         ///< the port closed, the next transition reports an error
+
+  // sample capture, the samples are written into capture_ which is allocated once up front
+  std::mutex capture_mutex_;            ///< guards the capture, samples arrive on the packet thread
+  VescSampleCapture capture_;
+  size_t capture_max_;                  ///< capacity of the capture arrays
+  size_t capture_len_;                  ///< samples expected in the running capture
+  size_t capture_received_;             ///< samples received so far
+  bool capture_active_;
+  std::chrono::steady_clock::time_point capture_last_sample_;
+  void sampleTriggerCallback(
+    const std::shared_ptr<VescSampleTrigger::Request> request,
+    std::shared_ptr<VescSampleTrigger::Response> response);
+  void handleSample(const VescPacketSample & sample);
+  void publishCapture(bool complete);
+
+  // terminal commands, the output is collected from the print packets until the vesc goes quiet
+  std::mutex terminal_mutex_;           ///< one terminal command at a time
+  std::mutex print_mutex_;              ///< guards print_* and fault_log_*
+  std::condition_variable print_cv_;
+  bool print_collecting_;               ///< a terminal command or the fault log fetch is running
+  std::string print_output_;
+  std::chrono::steady_clock::time_point print_last_;
+  bool printQuiet(const std::chrono::steady_clock::time_point & now) const;
+
+  // fault events, the fault code is only looked at on the packet thread
+  int last_fault_code_;                 ///< -1 until the first state sample
+  bool fault_log_pending_;              ///< the "faults" output is being collected
+  VescFault fault_log_msg_;
+  std::chrono::steady_clock::time_point fault_log_started_;
+  void handleFaultCode(int fault_code);
+  void publishFaultLog();
+  void terminalCallback(
+    const std::shared_ptr<VescTerminal::Request> request,
+    std::shared_ptr<VescTerminal::Response> response);
+  void handlePrint(const std::string & text);
+
+  // diagnostics, published at a low rate from values the packet thread already keeps up to date
+  std::unique_ptr<diagnostic_updater::Updater> updater_;
+  std::mutex diagnostics_mutex_;        ///< guards the snapshot below, written on the packet thread
+  std::string diag_hw_name_;
+  std::string diag_firmware_;
+  std::string diag_uuid_;
+  int diag_fault_code_;                 ///< -1 until the first state sample
+  double diag_temp_fet_;
+  double diag_temp_motor_;
+  double diag_v_in_;
+  double diag_temp_fet_start_;          ///< thermal throttling starts here, NaN until mcconf known
+  double diag_temp_motor_start_;
+  uint64_t diag_values_count_;          ///< state samples received
+  VescInterface::Statistics diag_last_stats_;  ///< link counters at the previous update
+  uint64_t diag_last_values_count_;
+  std::chrono::steady_clock::time_point diag_last_update_;
+  void linkDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat);
+  void controllerDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat);
+
+  void fetchConfiguration();
+  void handleMcConf(const Buffer & data, bool from_cache);
+  void handleAppConf(const Buffer & data, bool from_cache);
 
   // ROS callbacks
   void brakeCallback(const Float64::SharedPtr brake);
@@ -125,6 +295,8 @@ private:
   void servoCallback(const Float64::SharedPtr servo);
   void speedCallback(const Float64::SharedPtr speed);
   void timerCallback();
+  void startTimer();
+  void stopTimer();
 };
 
 }  // namespace vesc_driver
@@ -0,0 +1,139 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_FIRMWARE_UPLOAD_HPP_
+#define VESC_DRIVER__VESC_FIRMWARE_UPLOAD_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/vesc_interface.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Writes a firmware image to a VESC through a VescInterface. The image is cut into chunks that are
+ * all built (and optionally LZO compressed) up front, then streamed with up to a window of chunks
+ * in flight. Every chunk is acknowledged by the VESC with its offset, a chunk that is refused, or
+ * not acknowledged in time, e.g. because its frame failed the CRC check, is sent again.
+ *
+ * Firmware before 3.x acknowledges without the offset. The first chunk is therefore sent alone,
+ * and if its acknowledgement lacks the offset the upload continues with one chunk in flight, each
+ * acknowledgement then belonging to the only chunk in flight.
+ *
+ * The packet handler of the interface must forward packets to handlePacket().
+ */
+class VescFirmwareUploader
+{
+public:
+  struct Options
+  {
+    size_t chunk_size = 384;  ///< image bytes per write, the VESC takes payloads up to 512 bytes
+    size_t window = 4;        ///< writes in flight
+    int retries = 5;          ///< attempts per chunk after the first one
+    std::chrono::milliseconds chunk_timeout{500};
+    std::chrono::milliseconds erase_timeout{20000};
+    bool lzo = false;         ///< compress the chunks that shrink, needs liblzo2
+  };
+
+  struct Result
+  {
+    bool success = false;
+    std::string error;
+    size_t image_bytes = 0;   ///< image size including the size and CRC header
+    size_t wire_bytes = 0;    ///< frame bytes written, including resent chunks
+    size_t chunks = 0;
+    size_t resent = 0;
+    double erase_seconds = 0.0;
+    double write_seconds = 0.0;
+
+    /** Image bytes per second while writing */
+    double throughput() const;
+  };
+
+  typedef std::function<void (size_t done, size_t total)> ProgressFunction;
+
+  VescFirmwareUploader(VescInterface * vesc, const Options & options);
+
+  /** Erase the staging area and write @p firmware, blocks until done or failed. */
+  Result upload(const Buffer & firmware, const ProgressFunction & progress = ProgressFunction());
+
+  /** Start the bootloader, which installs the uploaded image and reboots the VESC. */
+  void jumpToBootloader();
+
+  /** Feed packets received from the VESC. */
+  void handlePacket(const VescPacketConstPtr & packet);
+
+  /** Prefix @p firmware with its size and CRC16, as the bootloader expects it. */
+  static Buffer prefixImage(const Buffer & firmware);
+
+  /** Whether the package was built with liblzo2. */
+  static bool lzoAvailable();
+
+private:
+  struct Chunk
+  {
+    uint32_t offset;
+    std::shared_ptr<VescPacket> packet;
+    int attempts;
+    bool in_flight;
+    bool done;
+    std::chrono::steady_clock::time_point sent;
+  };
+
+  std::vector<Chunk> buildChunks(const Buffer & image) const;
+  void sendChunk(Chunk * chunk, Result * result);
+
+  VescInterface * vesc_;
+  Options options_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool erase_done_;
+  bool erase_ok_;
+  std::map<uint32_t, size_t> chunk_by_offset_;
+  std::vector<Chunk> chunks_;
+  std::vector<uint32_t> acks_;   ///< offsets acknowledged, not yet processed
+  std::vector<uint32_t> nacks_;  ///< offsets refused, not yet processed
+  /** In acks_ / nacks_ for an acknowledgement without the offset */
+  static const uint32_t NO_OFFSET = UINT32_MAX;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_FIRMWARE_UPLOAD_HPP_
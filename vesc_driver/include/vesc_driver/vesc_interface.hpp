@@ -33,6 +33,8 @@
 
 #include "vesc_driver/vesc_packet.hpp"
 
+#include <chrono>
+#include <cstdint>
 #include <exception>
 #include <functional>
 #include <memory>
@@ -43,6 +45,30 @@
 namespace vesc_driver
 {
 
+class VescReactor;
+
+/**
+ * Serial link settings. The defaults match the VESC's USB port, a UART port needs the baud rate
+ * configured in the VESC's app configuration.
+ */
+struct VescSerialConfig
+{
+  enum class FlowControl { NONE, HARDWARE, SOFTWARE };
+  enum class Parity { NONE, ODD, EVEN };
+  enum class StopBits { ONE, ONE_POINT_FIVE, TWO };
+
+  uint32_t baud_rate = 115200;  ///< any rate, non-standard rates are set through termios2
+  FlowControl flow_control = FlowControl::HARDWARE;
+  Parity parity = Parity::NONE;
+  StopBits stop_bits = StopBits::ONE;
+
+  /** Bits on the wire per byte: start bit, 8 data bits, parity and stop bits. */
+  double bitsPerByte() const;
+
+  /** Bytes per second the link carries in each direction. */
+  double bytesPerSecond() const;
+};
+
 /**
  * Class providing an interface to the Vedder VESC motor controller via a serial port interface.
  */
@@ -90,12 +116,24 @@ public:
    */
   void setErrorHandler(const ErrorHandlerFunction & handler);
 
+  /**
+   * Services the serial port on @p reactor instead of a receive thread and an asio context. The
+   * port is opened with termios, received frames are parsed and handled on the reactor thread and
+   * sends are queued for the reactor thread to write once the port takes them, so send() does not
+   * block. Takes effect on the next connect(), pass nullptr to go back to the receive thread.
+   *
+   * @throw SerialException if connected.
+   */
+  void setReactor(std::shared_ptr<VescReactor> reactor);
+
   /**
    * Opens the serial port interface to the VESC.
    *
+   * @param config Baud rate, flow control, parity and stop bits of the link.
+   *
    * @throw SerialException
    */
-  void connect(const std::string & port);
+  void connect(const std::string & port, const VescSerialConfig & config = VescSerialConfig());
 
   /**
    * Closes the serial port interface to the VESC.
@@ -109,14 +147,60 @@ public:
    */
   bool isConnected() const;
 
+  /** Running totals of the link traffic, since the interface was created. */
+  struct Statistics
+  {
+    uint64_t rx_bytes = 0;
+    uint64_t rx_packets = 0;
+    uint64_t tx_bytes = 0;
+    uint64_t tx_packets = 0;
+    uint64_t parse_errors = 0;   ///< frames with a bad checksum, length, end byte or unknown id
+    uint64_t dropped_bytes = 0;  ///< bytes discarded while out of sync with the VESC
+  };
+
+  /**
+   * Gets the link statistics. The counters are updated on the receive and send paths with relaxed
+   * atomics, so reading them does not slow the link down.
+   */
+  Statistics statistics() const;
+
   /**
-   * Send a VESC packet.
+   * Switch the connected port to low latency: ASYNC_LOW_LATENCY, reads that return on the first
+   * byte and, on an FTDI adapter, a 1 ms latency timer. The settings that can be applied stay in
+   * place if another one is refused.
+   *
+   * @return false and sets @p error if a setting was refused.
+   */
+  bool setLowLatency(std::string * error);
+
+  /**
+   * Measure the time from sending a firmware version request to receiving the reply. The replies
+   * to these requests are not passed to the packet handler. Blocks, so must not be called from the
+   * packet handler or on the reactor thread.
+   *
+   * @param samples Requests to send, one at a time.
+   * @param timeout Time to wait for each reply.
+   *
+   * @return The median round trip in seconds, negative if the VESC did not reply.
+   */
+  double measureRoundTrip(
+    int samples = 20, std::chrono::milliseconds timeout = std::chrono::milliseconds(100));
+
+  /**
+   * Send a VESC packet. Safe to call from several threads, the frame is written before returning.
    */
   void send(const VescPacket & packet);
 
   void requestFWVersion();
   void requestState();
-  void requestImuData();
+  void requestImuData(uint16_t mask = 0xFFFF);
+  void requestSamples(uint8_t mode, uint16_t sample_len, uint8_t decimation);
+
+  /** Select the position the VESC streams as rotor position packets, one of disp_pos_mode. */
+  void setRotorPositionMode(uint8_t mode);
+
+  /** Run a terminal command, the output arrives as "Print" packets. */
+  void sendTerminalCommand(const std::string & command);
 
   void setDutyCycle(double duty_cycle);
   void setCurrent(double current);
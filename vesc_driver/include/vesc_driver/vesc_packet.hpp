@@ -39,6 +39,7 @@
 
 #define CRCPP_USE_CPP11
 #include "vesc_driver/crc.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
 
 namespace vesc_driver
 {
@@ -76,6 +77,9 @@ protected:
   /** Construct frame with specified payload size. */
   explicit VescFrame(int payload_size);
 
+  /** Construct from a complete small frame, e.g. a codec::ConstantFrame. */
+  VescFrame(const uint8_t * frame, size_t frame_size);
+
   std::shared_ptr<Buffer> frame_;  ///< Stores frame data, shared_ptr for shallow copy
   BufferRange payload_;              ///< View into frame's payload section
 
@@ -104,6 +108,16 @@ protected:
   VescPacket(const std::string & name, int payload_size, int payload_id);
   VescPacket(const std::string & name, std::shared_ptr<VescFrame> raw);
 
+  /** Copy of the precomputed frame of a packet without arguments */
+  template<uint8_t ... Payload>
+  VescPacket(const std::string & name, codec::ConstantFrame<Payload...>)
+  : VescFrame(codec::ConstantFrame<Payload...>::BYTES, codec::ConstantFrame<Payload...>::SIZE),
+    name_(name)
+  {}
+
+  /** Write the CRC of the payload into the frame, once the payload is complete */
+  void writeCrc();
+
 private:
   std::string name_;
 };
@@ -123,6 +137,7 @@ public:
 
   std::string     hwname() const;
   const uint8_t * uuid()  const;
+  std::string     uuidString() const;
   bool     paired() const;
   uint8_t  devVersion() const;
 
@@ -143,6 +158,48 @@ public:
 
 /*------------------------------------------------------------------------------------------------*/
 
+/**
+ * Serialized motor configuration (mc_configuration) as sent by the VESC. The layout of the data
+ * depends on the firmware version, see vesc_config.hpp for decoding.
+ */
+class VescPacketMcConf : public VescPacket
+{
+public:
+  explicit VescPacketMcConf(std::shared_ptr<VescFrame> raw);
+
+  /** Serialized configuration, i.e. the payload without the packet id */
+  Buffer data() const;
+};
+
+class VescPacketRequestMcConf : public VescPacket
+{
+public:
+  VescPacketRequestMcConf();
+};
+
+/*------------------------------------------------------------------------------------------------*/
+
+/**
+ * Serialized app configuration (app_configuration) as sent by the VESC. The layout of the data
+ * depends on the firmware version, see vesc_config.hpp for decoding.
+ */
+class VescPacketAppConf : public VescPacket
+{
+public:
+  explicit VescPacketAppConf(std::shared_ptr<VescFrame> raw);
+
+  /** Serialized configuration, i.e. the payload without the packet id */
+  Buffer data() const;
+};
+
+class VescPacketRequestAppConf : public VescPacket
+{
+public:
+  VescPacketRequestAppConf();
+};
+
+/*------------------------------------------------------------------------------------------------*/
+
 class VescPacketValues : public VescPacket
 {
 public:
@@ -175,6 +232,9 @@ public:
   double  avg_vq()  const;
 };
 
+/** Name of an mc_fault_code, e.g. "FAULT_CODE_OVER_TEMP_FET" */
+const char * faultCodeName(int fault_code);
+
 class VescPacketRequestValues : public VescPacket
 {
 public:
@@ -240,11 +300,61 @@ public:
   //  double servo_pos() const;
 };
 
+/*------------------------------------------------------------------------------------------------*/
+
+/**
+ * Temporary motor limits (COMM_SET_MCCONF_TEMP). The motor currents are given as scales of the
+ * configured l_current_min / l_current_max, the input currents are absolute and only read by
+ * firmware that knows them. Unless stored, the VESC falls back to its configuration on reboot.
+ */
+class VescPacketSetMcconfTemp : public VescPacket
+{
+public:
+  struct Limits
+  {
+    double current_min_scale;
+    double current_max_scale;
+    double min_erpm;
+    double max_erpm;
+    double min_duty;
+    double max_duty;
+    double watt_min;
+    double watt_max;
+    double in_current_min;
+    double in_current_max;
+  };
+
+  /** @param store Also write the limits to the VESC's flash. */
+  VescPacketSetMcconfTemp(const Limits & limits, bool store);
+};
+
+/*------------------------------------------------------------------------------------------------*/
+
+/**
+ * Rotor position pushed by the VESC at its own rate once a position display mode is set with
+ * VescPacketSetDetect.
+ */
+class VescPacketRotorPosition : public VescPacket
+{
+public:
+  explicit VescPacketRotorPosition(std::shared_ptr<VescFrame> raw);
+
+  double position() const;  ///< degrees, or the error in degrees for the error modes
+};
+
+class VescPacketSetDetect : public VescPacket
+{
+public:
+  /** @param mode Which position the VESC streams, one of disp_pos_mode. */
+  explicit VescPacketSetDetect(uint8_t mode);
+};
+
 /*------------------------------------------------------------------------------------------------*/
 class VescPacketRequestImu : public VescPacket
 {
 public:
-  VescPacketRequestImu();
+  /** @param mask Bit mask of VescPacketImu::ImuField values the VESC should reply with. */
+  explicit VescPacketRequestImu(uint16_t mask = 0xFFFF);
 };
 
 class VescPacketImu : public VescPacket
@@ -275,30 +385,178 @@ public:
   double q_y() const;
   double q_z() const;
 
+  /** Bit positions of the fields in the IMU data mask, in the order they appear on the wire */
+  enum ImuField
+  {
+    IMU_ROLL = 0,
+    IMU_PITCH,
+    IMU_YAW,
+    IMU_ACC_X,
+    IMU_ACC_Y,
+    IMU_ACC_Z,
+    IMU_GYR_X,
+    IMU_GYR_Y,
+    IMU_GYR_Z,
+    IMU_MAG_X,
+    IMU_MAG_Y,
+    IMU_MAG_Z,
+    IMU_Q_W,
+    IMU_Q_X,
+    IMU_Q_Y,
+    IMU_Q_Z,
+    IMU_NUM_FIELDS
+  };
+
+  // masks selecting a whole group of fields in VescPacketRequestImu
+  static const uint16_t IMU_MASK_RPY = 0x0007;         ///< roll, pitch, yaw
+  static const uint16_t IMU_MASK_ACC = 0x0038;         ///< linear acceleration
+  static const uint16_t IMU_MASK_GYRO = 0x01C0;        ///< angular velocity
+  static const uint16_t IMU_MASK_MAG = 0x0E00;         ///< magnetometer
+  static const uint16_t IMU_MASK_QUATERNION = 0xF000;  ///< orientation quaternion
+
 private:
   double getFloat32Auto(uint32_t * pos) const;
 
   uint32_t mask_;
-  double roll_;
-  double pitch_;
-  double yaw_;
-
-  double acc_x_;
-  double acc_y_;
-  double acc_z_;
-
-  double gyr_x_;
-  double gyr_y_;
-  double gyr_z_;
-
-  double mag_x_;
-  double mag_y_;
-  double mag_z_;
-
-  double q0_;
-  double q1_;
-  double q2_;
-  double q3_;
+  double fields_[IMU_NUM_FIELDS];  ///< Decoded values indexed by ImuField, zero if not in mask
+};
+
+/*------------------------------------------------------------------------------------------------*/
+
+/**
+ * One sample of a COMM_SAMPLE_PRINT capture burst. The VESC sends one of these per sample once
+ * the capture triggers.
+ */
+class VescPacketSample : public VescPacket
+{
+public:
+  explicit VescPacketSample(std::shared_ptr<VescFrame> raw);
+
+  float current0() const;     ///< phase current 0, A
+  float current1() const;     ///< phase current 1, A
+  float voltage_ph1() const;  ///< phase voltages, V
+  float voltage_ph2() const;
+  float voltage_ph3() const;
+  float voltage_zero() const;  ///< virtual ground, V
+  float current_fir() const;   ///< filtered motor current, A
+  float f_sw() const;          ///< switching frequency at the sample, Hz
+  uint8_t status() const;      ///< motor state at the sample
+  uint8_t phase() const;       ///< commutation step, or phase angle in FOC
+
+private:
+  enum SampleField
+  {
+    SAMPLE_CURRENT0 = 0,
+    SAMPLE_CURRENT1,
+    SAMPLE_VOLTAGE_PH1,
+    SAMPLE_VOLTAGE_PH2,
+    SAMPLE_VOLTAGE_PH3,
+    SAMPLE_VOLTAGE_ZERO,
+    SAMPLE_CURRENT_FIR,
+    SAMPLE_F_SW,
+    SAMPLE_NUM_FIELDS
+  };
+
+  float fields_[SAMPLE_NUM_FIELDS];
+  uint8_t status_;
+  uint8_t phase_;
+};
+
+class VescPacketRequestSample : public VescPacket
+{
+public:
+  /**
+   * Start a sample capture.
+   *
+   * @param mode When to sample, one of debug_sampling_mode.
+   * @param sample_len Number of samples, the VESC caps this at its sample buffer size.
+   * @param decimation Keep every n-th sample.
+   */
+  VescPacketRequestSample(uint8_t mode, uint16_t sample_len, uint8_t decimation);
+};
+
+/*------------------------------------------------------------------------------------------------*/
+
+/** Run a VESC terminal command, e.g. "faults", the output comes back as VescPacketPrint lines */
+class VescPacketTerminalCmd : public VescPacket
+{
+public:
+  explicit VescPacketTerminalCmd(const std::string & command);
+};
+
+/** A line printed by the VESC, in reply to a terminal command or unsolicited */
+class VescPacketPrint : public VescPacket
+{
+public:
+  explicit VescPacketPrint(std::shared_ptr<VescFrame> raw);
+
+  std::string text() const;
+};
+
+/*------------------------------------------------------------------------------------------------*/
+
+/**
+ * Firmware update. The new application is written to the VESC's staging flash area with
+ * VescPacketWriteNewAppData after erasing it with VescPacketEraseNewApp, and installed by the
+ * bootloader after VescPacketJumpToBootloader. The image starts with its size and CRC16, the
+ * bootloader refuses an image that does not match them.
+ */
+class VescPacketEraseNewApp : public VescPacket
+{
+public:
+  /** @param size Bytes that will be written, including the size and CRC header. */
+  explicit VescPacketEraseNewApp(uint32_t size);
+};
+
+class VescPacketEraseNewAppResult : public VescPacket
+{
+public:
+  explicit VescPacketEraseNewAppResult(std::shared_ptr<VescFrame> raw);
+
+  bool ok() const;
+};
+
+class VescPacketWriteNewAppData : public VescPacket
+{
+public:
+  /** Write the bytes [@p begin, @p end) at @p offset into the staging area. */
+  VescPacketWriteNewAppData(
+    uint32_t offset, Buffer::const_iterator begin, Buffer::const_iterator end);
+};
+
+class VescPacketWriteNewAppDataLzo : public VescPacket
+{
+public:
+  /**
+   * Write LZO1X compressed bytes at @p offset, the VESC decompresses them to @p decompressed_size
+   * bytes before writing.
+   */
+  VescPacketWriteNewAppDataLzo(
+    uint32_t offset, uint16_t decompressed_size, Buffer::const_iterator begin,
+    Buffer::const_iterator end);
+};
+
+class VescPacketWriteNewAppDataResult : public VescPacket
+{
+public:
+  explicit VescPacketWriteNewAppDataResult(std::shared_ptr<VescFrame> raw);
+
+  bool ok() const;
+  bool hasOffset() const;   ///< false for firmware that does not echo the offset
+  uint32_t offset() const;  ///< offset of the write this acknowledges, 0 without hasOffset()
+};
+
+/** Same reply, in case the firmware answers a compressed write with the LZO command id */
+class VescPacketWriteNewAppDataLzoResult : public VescPacketWriteNewAppDataResult
+{
+public:
+  explicit VescPacketWriteNewAppDataLzoResult(std::shared_ptr<VescFrame> raw);
+};
+
+class VescPacketJumpToBootloader : public VescPacket
+{
+public:
+  VescPacketJumpToBootloader();
 };
 
 /*------------------------------------------------------------------------------------------------*/
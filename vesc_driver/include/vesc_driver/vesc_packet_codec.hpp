@@ -0,0 +1,328 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_PACKET_CODEC_HPP_
+#define VESC_DRIVER__VESC_PACKET_CODEC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace vesc_driver
+{
+
+/** Decode a 32 bit word written by the firmware's buffer_append_float32_auto() */
+float decodeFloat32Auto(uint32_t res);
+
+/** Encode @p number as the firmware's buffer_append_float32_auto() does */
+uint32_t encodeFloat32Auto(float number);
+
+/**
+ * Declarative packet layouts. A packet's payload is described once as a list of fields, e.g.
+ *
+ *   typedef codec::PacketSchema<COMM_SET_CURRENT, codec::Field<int32_t, 1000>> SetCurrentSchema;
+ *
+ * and the offsets, the payload size and the big-endian encoding and decoding of every field are
+ * generated from it at compile time.
+ */
+namespace codec
+{
+
+/** CRC-16/XMODEM over @p size bytes, as the VESC uses for its frames. Usable at compile time. */
+constexpr uint16_t crc16(const uint8_t * data, size_t size)
+{
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= static_cast<uint16_t>(data[i] << 8);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) :
+        static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+/** CRC-16/XMODEM of the bytes given as arguments */
+template<typename ... Bytes>
+constexpr uint16_t crc16Of(Bytes... bytes)
+{
+  const uint8_t data[] = {static_cast<uint8_t>(bytes)...};
+  return crc16(data, sizeof...(Bytes));
+}
+
+static_assert(
+  crc16Of('1', '2', '3', '4', '5', '6', '7', '8', '9') == 0x31C3, "CRC-16/XMODEM check value");
+
+/**
+ * A big-endian integer field. Decoding divides the wire value by @p Scale and encoding multiplies
+ * by it, e.g. Field<int16_t, 10> carries a temperature in tenths of a degree.
+ */
+template<typename Wire, int64_t Scale = 1>
+struct Field
+{
+  static_assert(std::is_integral<Wire>::value, "the wire type must be an integer");
+  static_assert(Scale > 0, "the scale must be positive");
+
+  typedef Wire WireType;
+  static constexpr size_t SIZE = sizeof(Wire);
+
+  template<typename Iter>
+  static Wire read(Iter pos)
+  {
+    typedef typename std::make_unsigned<Wire>::type Unsigned;
+    Unsigned v = 0;
+    for (size_t i = 0; i < SIZE; i++) {
+      v = static_cast<Unsigned>((v << 8) | static_cast<uint8_t>(*(pos + i)));
+    }
+    return static_cast<Wire>(v);
+  }
+
+  template<typename Iter>
+  static void write(Iter pos, Wire value)
+  {
+    typedef typename std::make_unsigned<Wire>::type Unsigned;
+    Unsigned v = static_cast<Unsigned>(value);
+    for (size_t i = SIZE; i-- > 0; ) {
+      *(pos + i) = static_cast<uint8_t>(v & 0xFF);
+      v = static_cast<Unsigned>(v >> 8);
+    }
+  }
+
+  template<typename Iter>
+  static double decode(Iter pos)
+  {
+    return static_cast<double>(read(pos)) / Scale;
+  }
+
+  template<typename Iter, typename T>
+  static void encode(Iter pos, T value)
+  {
+    write(pos, static_cast<Wire>(value * Scale));
+  }
+};
+
+/** A float written by the firmware's buffer_append_float32_auto() */
+struct Float32Auto
+{
+  typedef float WireType;
+  static constexpr size_t SIZE = 4;
+
+  template<typename Iter>
+  static float read(Iter pos)
+  {
+    return decodeFloat32Auto(Field<uint32_t>::read(pos));
+  }
+
+  template<typename Iter>
+  static void write(Iter pos, float value)
+  {
+    Field<uint32_t>::write(pos, encodeFloat32Auto(value));
+  }
+
+  template<typename Iter>
+  static double decode(Iter pos)
+  {
+    return read(pos);
+  }
+
+  template<typename Iter, typename T>
+  static void encode(Iter pos, T value)
+  {
+    write(pos, static_cast<float>(value));
+  }
+};
+
+namespace detail
+{
+
+/** Sum of the first @p count of @p sizes */
+constexpr size_t sumSizes(const size_t * sizes, size_t count)
+{
+  size_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += sizes[i];
+  }
+  return sum;
+}
+
+/** Offset of field @p I, the sizes are listed after a leading zero so that empty lists work */
+template<size_t I, typename ... Fields>
+constexpr size_t offsetOf()
+{
+  const size_t sizes[] = {0, Fields::SIZE ...};
+  return sumSizes(sizes, I + 1);
+}
+
+}  // namespace detail
+
+/**
+ * Payload layout of a packet: the command id followed by @p Fields, packed without padding. The
+ * field indices used with read(), decode() and the offset are the positions in @p Fields.
+ */
+template<uint8_t Id, typename ... Fields>
+struct PacketSchema
+{
+  static constexpr uint8_t ID = Id;
+  static constexpr size_t NUM_FIELDS = sizeof...(Fields);
+  /** Bytes taken by the fields */
+  static constexpr size_t FIELDS_SIZE = detail::offsetOf<sizeof...(Fields), Fields...>();
+  /** Bytes in the payload, including the command id */
+  static constexpr size_t PAYLOAD_SIZE = 1 + FIELDS_SIZE;
+
+  template<size_t I>
+  using FieldType = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+  /** Offset of field @p I in the payload */
+  template<size_t I>
+  static constexpr size_t offset()
+  {
+    static_assert(I < NUM_FIELDS, "field index out of range");
+    return 1 + detail::offsetOf<I, Fields...>();
+  }
+
+  /** Raw wire value of field @p I, @p payload points at the command id */
+  template<size_t I, typename Iter>
+  static typename FieldType<I>::WireType read(Iter payload)
+  {
+    return FieldType<I>::read(payload + offset<I>());
+  }
+
+  /** Scaled value of field @p I, @p payload points at the command id */
+  template<size_t I, typename Iter>
+  static double decode(Iter payload)
+  {
+    return FieldType<I>::decode(payload + offset<I>());
+  }
+
+  /** Write the command id and one value per field, in field order, to @p payload */
+  template<typename Iter, typename ... Values>
+  static void encode(Iter payload, Values... values)
+  {
+    static_assert(sizeof...(Values) == NUM_FIELDS, "one value per field");
+    *payload = Id;
+    encodeFields(payload, std::index_sequence_for<Fields...>(), values ...);
+  }
+
+private:
+  template<typename Iter, size_t ... I, typename ... Values>
+  static void encodeFields(Iter payload, std::index_sequence<I...>, Values... values)
+  {
+    // expands to one encode() per field, in order
+    int expand[] = {0, (FieldType<I>::encode(payload + offset<I>(), values), 0)...};
+    (void)expand;
+  }
+};
+
+/**
+ * Data layout of a VESC CAN frame: @p Fields packed from the first data byte. The packet id @p Id
+ * travels in the frame id rather than the data, see canId().
+ */
+template<uint8_t Id, typename ... Fields>
+struct CanFrameSchema
+{
+  static constexpr uint8_t ID = Id;
+  static constexpr size_t NUM_FIELDS = sizeof...(Fields);
+  /** Data bytes taken by the fields */
+  static constexpr size_t SIZE = detail::offsetOf<sizeof...(Fields), Fields...>();
+  static_assert(SIZE <= 8, "a CAN frame carries at most 8 data bytes");
+
+  template<size_t I>
+  using FieldType = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+  /** Offset of field @p I in the frame data */
+  template<size_t I>
+  static constexpr size_t offset()
+  {
+    static_assert(I < NUM_FIELDS, "field index out of range");
+    return detail::offsetOf<I, Fields...>();
+  }
+
+  /** Raw wire value of field @p I */
+  template<size_t I, typename Iter>
+  static typename FieldType<I>::WireType read(Iter data)
+  {
+    return FieldType<I>::read(data + offset<I>());
+  }
+
+  /** Scaled value of field @p I */
+  template<size_t I, typename Iter>
+  static double decode(Iter data)
+  {
+    return FieldType<I>::decode(data + offset<I>());
+  }
+
+  /** Write one value per field, in field order, to @p data */
+  template<typename Iter, typename ... Values>
+  static void encode(Iter data, Values... values)
+  {
+    static_assert(sizeof...(Values) == NUM_FIELDS, "one value per field");
+    encodeFields(data, std::index_sequence_for<Fields...>(), values ...);
+  }
+
+private:
+  template<typename Iter, size_t ... I, typename ... Values>
+  static void encodeFields(Iter data, std::index_sequence<I...>, Values... values)
+  {
+    int expand[] = {0, (FieldType<I>::encode(data + offset<I>(), values), 0)...};
+    (void)expand;
+  }
+};
+
+/** Extended frame id of CAN packet @p packet_id to or from the VESC @p controller_id */
+constexpr uint32_t canId(uint8_t packet_id, uint8_t controller_id)
+{
+  return static_cast<uint32_t>(packet_id) << 8 | controller_id;
+}
+
+/**
+ * A complete small frame for a constant payload, start byte to end byte with the CRC, built at
+ * compile time. Used for requests that carry no arguments.
+ */
+template<uint8_t ... Payload>
+struct ConstantFrame
+{
+  static_assert(sizeof...(Payload) > 0 && sizeof...(Payload) < 256, "small frame payload size");
+
+  static constexpr uint16_t CRC = crc16Of(Payload...);
+  static constexpr size_t SIZE = sizeof...(Payload) + 5;
+  static constexpr uint8_t BYTES[SIZE] = {
+    2, sizeof...(Payload), Payload...,
+    static_cast<uint8_t>(CRC >> 8), static_cast<uint8_t>(CRC & 0xFF), 3};
+};
+
+template<uint8_t ... Payload>
+constexpr uint8_t ConstantFrame<Payload...>::BYTES[];
+
+}  // namespace codec
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_PACKET_CODEC_HPP_
@@ -0,0 +1,168 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_REACTOR_HPP_
+#define VESC_DRIVER__VESC_REACTOR_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vesc_driver
+{
+
+/**
+ * Single-threaded I/O loop. File descriptors, timers and posted functions are all dispatched from
+ * one thread waiting in epoll_wait(), so their handlers never run concurrently and run in the order
+ * the kernel reports the events. Used to service serial ports without a receive thread and an
+ * asio context per port, one reactor can serve the ports of all VESCs in a process.
+ */
+class VescReactor
+{
+public:
+  typedef std::function<void (uint32_t events)> FdHandler;
+  typedef std::function<void ()> TimerHandler;
+  typedef int TimerId;
+
+  /**
+   * Creates the epoll set and starts the reactor thread.
+   *
+   * @throw std::runtime_error if epoll or eventfd are not available.
+   */
+  VescReactor();
+
+  /** Stops the reactor thread, handlers still registered are not called again. */
+  ~VescReactor();
+
+  VescReactor(const VescReactor &) = delete;
+  VescReactor & operator=(const VescReactor &) = delete;
+
+  /**
+   * Calls @p handler with the epoll events whenever @p fd is readable, writable while
+   * setWritable() asks for it, or fails. The reactor does not take ownership of @p fd.
+   *
+   * @return false if epoll refused @p fd, e.g. because it can't be polled, with errno set.
+   */
+  bool addFd(int fd, FdHandler handler);
+
+  /**
+   * Also report EPOLLOUT for @p fd while @p writable, to write queued data once there is room.
+   * May be called from any thread.
+   */
+  void setWritable(int fd, bool writable);
+
+  /**
+   * Stops watching @p fd. When this returns the handler is not running and will not be called
+   * again, unless this is called from the handler itself.
+   */
+  void removeFd(int fd);
+
+  /**
+   * Calls @p handler every @p period, the first time after @p delay.
+   *
+   * @return Id for removeTimer(), or -1 if the timer could not be created.
+   */
+  TimerId addTimer(
+    std::chrono::nanoseconds period, TimerHandler handler,
+    std::chrono::nanoseconds delay = std::chrono::nanoseconds(0));
+
+  /** Stops the timer, with the same guarantee as removeFd(). */
+  void removeTimer(TimerId id);
+
+  /**
+   * Calls @p handler every @p period, staggered against the other poll timers with the same
+   * period: with n of them, one shared timer ticks every period / n and calls them in turn, so the
+   * devices are not all polled in the same instant.
+   *
+   * @return Id for removePollTimer(), or -1 if the timer could not be created.
+   */
+  TimerId addPollTimer(std::chrono::nanoseconds period, TimerHandler handler);
+
+  /** Stops the poll timer, with the same guarantee as removeFd(). */
+  void removePollTimer(TimerId id);
+
+  /** Runs @p fn on the reactor thread. */
+  void post(std::function<void ()> fn);
+
+  /** Whether the caller is running on the reactor thread. */
+  bool inReactorThread() const;
+
+  /**
+   * The reactor shared by all users in this process, created on first use and destroyed with the
+   * last reference to it.
+   */
+  static std::shared_ptr<VescReactor> shared();
+
+private:
+  struct Source
+  {
+    FdHandler handler;
+    bool timer;  ///< the fd is a timerfd owned by the reactor
+  };
+
+  int epoll_fd_;
+  int wake_fd_;  ///< eventfd signalled by post()
+  bool running_;
+  std::thread thread_;
+
+  std::map<int, std::shared_ptr<Source>> sources_;  ///< only touched on the reactor thread
+
+  /** Poll timers sharing one period, called in turn from one timerfd */
+  struct PollGroup
+  {
+    int fd = -1;                                       ///< timerfd
+    size_t next = 0;                                   ///< member to call on the next tick
+    std::vector<std::pair<TimerId, TimerHandler>> members;
+  };
+  std::map<int64_t, PollGroup> poll_groups_;         ///< by period in ns, reactor thread only
+  TimerId next_poll_id_;
+
+  void armPollGroup(int64_t period, PollGroup * group);
+  void tickPollGroup(int64_t period);
+  std::mutex posted_mutex_;
+  std::deque<std::function<void ()>> posted_;
+
+  void run();
+  void runPosted();
+  bool add(int fd, std::shared_ptr<Source> source);
+  void remove(int fd);
+  /** Run @p fn on the reactor thread and wait until it is done */
+  void runSync(const std::function<void ()> & fn);
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_REACTOR_HPP_
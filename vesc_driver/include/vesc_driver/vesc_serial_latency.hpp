@@ -0,0 +1,65 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_SERIAL_LATENCY_HPP_
+#define VESC_DRIVER__VESC_SERIAL_LATENCY_HPP_
+
+#include <string>
+
+namespace vesc_driver
+{
+
+/**
+ * Set ASYNC_LOW_LATENCY on the serial port @p port, so the driver pushes received bytes to the
+ * reader right away instead of batching them. Like the baud rate the flag belongs to the tty, so
+ * this applies to a port already opened elsewhere.
+ *
+ * @return false and sets @p error if the port or the driver refused a setting.
+ */
+bool setSerialLowLatency(const std::string & port, std::string * error);
+
+/**
+ * The sysfs latency timer of the FTDI adapter behind @p port, e.g.
+ * /sys/bus/usb-serial/devices/ttyUSB0/latency_timer, empty if the port has none.
+ */
+std::string ftdiLatencyTimerPath(const std::string & port);
+
+/**
+ * Set the latency timer of the FTDI adapter behind @p port. The adapter holds received bytes for
+ * up to this long, 16 ms by default, before sending a partly filled USB packet.
+ *
+ * @return false and sets @p error if there is no timer or it cannot be written, usually for lack of
+ *         permission; a udev rule can set it instead.
+ */
+bool setFtdiLatencyTimer(const std::string & port, int milliseconds, std::string * error);
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_SERIAL_LATENCY_HPP_
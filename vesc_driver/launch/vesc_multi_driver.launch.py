@@ -0,0 +1,111 @@
+# Copyright 2020 F1TENTH Foundation
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+#   * Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+#
+#   * Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+#
+#   * Neither the name of the {copyright_holder} nor the names of its
+#     contributors may be used to endorse or promote products derived from
+#     this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+# Drives several VESCs from one process. The drivers are composed into a single multi-threaded
+# component container rather than started as one process each, e.g.
+#
+#   ros2 launch vesc_driver vesc_multi_driver.launch.py \
+#     ports:=/dev/ttyACM0,/dev/ttyACM1 namespaces:=left,right
+#
+# Each driver gets the parameters in vesc_config.yaml with its own port, and runs in its own
+# namespace, vesc0, vesc1, ... unless namespaces are given. Ports can also be given as uuids, which
+# are looked up in the device registry written by vesc_device_discovery. By default all drivers
+# share one I/O thread for their serial ports, see single_io_thread in vesc_config.yaml.
+
+import os
+
+from ament_index_python.packages import get_package_share_directory
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument, OpaqueFunction
+from launch.substitutions import LaunchConfiguration
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+
+
+def split_list(value):
+    return [item.strip() for item in value.split(',') if item.strip()]
+
+
+def launch_drivers(context):
+    vesc_config = LaunchConfiguration('params_file').perform(context)
+    ports = split_list(LaunchConfiguration('ports').perform(context))
+    uuids = split_list(LaunchConfiguration('uuids').perform(context))
+    namespaces = split_list(LaunchConfiguration('namespaces').perform(context))
+    single_io_thread = LaunchConfiguration('single_io_thread').perform(context).lower() == 'true'
+
+    devices = [{'port': port} for port in ports] + [{'port': '', 'uuid': uuid} for uuid in uuids]
+    if namespaces and len(namespaces) != len(devices):
+        raise RuntimeError('namespaces needs one entry per port and uuid')
+
+    drivers = []
+    for i, device in enumerate(devices):
+        drivers.append(ComposableNode(
+            package='vesc_driver',
+            plugin='vesc_driver::VescDriver',
+            name='vesc_driver_node',
+            namespace=namespaces[i] if namespaces else 'vesc%d' % i,
+            parameters=[vesc_config, device, {'single_io_thread': single_io_thread}],
+        ))
+
+    # the terminal service waits for the vesc in its own callback group, so the container needs
+    # more than one thread
+    return [ComposableNodeContainer(
+        name='vesc_driver_container',
+        namespace='',
+        package='rclcpp_components',
+        executable='component_container_mt',
+        composable_node_descriptions=drivers,
+        output='screen',
+    )]
+
+
+def generate_launch_description():
+
+    vesc_config = os.path.join(
+        get_package_share_directory('vesc_driver'),
+        'params',
+        'vesc_config.yaml'
+        )
+    return LaunchDescription([
+        DeclareLaunchArgument(
+            'ports', default_value='',
+            description='comma separated serial ports, one driver per port'),
+        DeclareLaunchArgument(
+            'uuids', default_value='',
+            description='comma separated VESC uuids, one driver per uuid'),
+        DeclareLaunchArgument(
+            'namespaces', default_value='',
+            description='comma separated namespaces for the drivers, ports first, then uuids'),
+        DeclareLaunchArgument(
+            'params_file', default_value=vesc_config,
+            description='driver parameters shared by all drivers'),
+        DeclareLaunchArgument(
+            'single_io_thread', default_value='true',
+            description='serve the serial ports of all drivers from one thread'),
+        OpaqueFunction(function=launch_drivers),
+    ])
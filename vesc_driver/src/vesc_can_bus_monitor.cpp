@@ -0,0 +1,141 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_can_bus_monitor.hpp"
+
+#include <vector>
+
+namespace vesc_driver
+{
+
+VescCanBusMonitor::VescCanBusMonitor(uint32_t bitrate)
+: bitrate_(bitrate),
+  start_(std::chrono::steady_clock::now()),
+  bits_(0),
+  frames_(0),
+  error_frames_(0),
+  error_classes_(0)
+{
+}
+
+void VescCanBusMonitor::onFrame(const VescCanFrame & frame)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (frame.error) {
+    error_frames_++;
+    error_classes_ |= frame.id;
+    return;
+  }
+  bits_ += frameBits(frame);
+  frames_++;
+  id_frames_[frame.extended ? frame.id | EXTENDED_ID_FLAG : frame.id]++;
+}
+
+VescCanBusMonitor::Report VescCanBusMonitor::report()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  Report report;
+  report.period = std::chrono::duration<double>(now - start_).count();
+  if (report.period > 0.0) {
+    report.load = bits_ / (static_cast<double>(bitrate_) * report.period);
+    report.frames_per_second = frames_ / report.period;
+    for (const auto & entry : id_frames_) {
+      report.id_rates[entry.first] = entry.second / report.period;
+    }
+  }
+  report.error_frames = error_frames_;
+  report.error_classes = error_classes_;
+
+  start_ = now;
+  bits_ = 0;
+  frames_ = 0;
+  error_frames_ = 0;
+  error_classes_ = 0;
+  id_frames_.clear();
+  return report;
+}
+
+int VescCanBusMonitor::frameBits(const VescCanFrame & frame)
+{
+  // start of frame to the end of the CRC, the part that is bit stuffed
+  std::vector<bool> bits;
+  bits.reserve(160);
+  auto append = [&bits](uint32_t value, int count) {
+      for (int i = count - 1; i >= 0; i--) {
+        bits.push_back(((value >> i) & 1) != 0);
+      }
+    };
+  append(0, 1);                          // start of frame
+  if (frame.extended) {
+    append(frame.id >> 18, 11);          // base id
+    append(3, 2);                        // SRR, IDE
+    append(frame.id & 0x3FFFF, 18);      // id extension
+    append(0, 3);                        // RTR, r1, r0
+  } else {
+    append(frame.id, 11);
+    append(0, 3);                        // RTR, IDE, r0
+  }
+  append(frame.len, 4);
+  for (int i = 0; i < frame.len; i++) {
+    append(frame.data[i], 8);
+  }
+  uint16_t crc = 0;
+  for (bool bit : bits) {
+    bool feedback = bit != (((crc >> 14) & 1) != 0);
+    crc = static_cast<uint16_t>((crc << 1) & 0x7FFF);
+    if (feedback) {
+      crc ^= 0x4599;
+    }
+  }
+  append(crc, 15);
+
+  // a bit of the opposite level follows every five equal bits, and starts the next run
+  int stuff_bits = 0;
+  int run = 0;
+  bool level = false;
+  for (bool bit : bits) {
+    if (run > 0 && bit == level) {
+      run++;
+    } else {
+      level = bit;
+      run = 1;
+    }
+    if (run == 5) {
+      stuff_bits++;
+      level = !bit;
+      run = 1;
+    }
+  }
+  // CRC delimiter, ACK slot and delimiter, end of frame and intermission
+  return static_cast<int>(bits.size()) + stuff_bits + 1 + 2 + 7 + 3;
+}
+
+}  // namespace vesc_driver
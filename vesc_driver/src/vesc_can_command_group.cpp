@@ -0,0 +1,156 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_can_command_group.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+using codec::CanFrameSchema;
+using codec::Field;
+
+// setpoint frames, see comm_can.c in the VESC firmware
+typedef CanFrameSchema<CAN_PACKET_SET_DUTY, Field<int32_t, 100000>> SetDutySchema;
+typedef CanFrameSchema<CAN_PACKET_SET_CURRENT, Field<int32_t, 1000>> SetCurrentSchema;
+typedef CanFrameSchema<CAN_PACKET_SET_CURRENT_BRAKE, Field<int32_t, 1000>> SetBrakeSchema;
+typedef CanFrameSchema<CAN_PACKET_SET_RPM, Field<int32_t>> SetRpmSchema;
+typedef CanFrameSchema<CAN_PACKET_SET_POS, Field<int32_t, 1000000>> SetPosSchema;
+
+template<typename Schema>
+VescCanFrame setpointFrame(double value)
+{
+  VescCanFrame frame;
+  frame.len = Schema::SIZE;
+  Schema::encode(frame.data, value);
+  return frame;
+}
+
+}  // namespace
+
+VescCanCommandGroup::VescCanCommandGroup(VescCanSocket & socket)
+: socket_(socket),
+  first_echo_ns_(0),
+  last_echo_ns_(0)
+{
+}
+
+void VescCanCommandGroup::setDutyCycle(uint8_t controller_id, double duty_cycle)
+{
+  set(controller_id, SetDutySchema::ID, setpointFrame<SetDutySchema>(duty_cycle));
+}
+
+void VescCanCommandGroup::setCurrent(uint8_t controller_id, double current)
+{
+  set(controller_id, SetCurrentSchema::ID, setpointFrame<SetCurrentSchema>(current));
+}
+
+void VescCanCommandGroup::setBrake(uint8_t controller_id, double brake)
+{
+  set(controller_id, SetBrakeSchema::ID, setpointFrame<SetBrakeSchema>(brake));
+}
+
+void VescCanCommandGroup::setSpeed(uint8_t controller_id, double rpm)
+{
+  set(controller_id, SetRpmSchema::ID, setpointFrame<SetRpmSchema>(rpm));
+}
+
+void VescCanCommandGroup::setPosition(uint8_t controller_id, double position_deg)
+{
+  set(controller_id, SetPosSchema::ID, setpointFrame<SetPosSchema>(position_deg));
+}
+
+void VescCanCommandGroup::set(uint8_t controller_id, uint8_t packet_id, const VescCanFrame & frame)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  VescCanFrame & pending = pending_[controller_id];
+  pending = frame;
+  pending.id = codec::canId(packet_id, controller_id);
+}
+
+bool VescCanCommandGroup::send()
+{
+  std::vector<VescCanFrame> frames;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto & entry : pending_) {
+      frames.push_back(entry.second);
+    }
+    pending_.clear();
+    // a burst whose echoes are still missing is not measured
+    in_flight_.clear();
+    for (const auto & frame : frames) {
+      in_flight_.insert(frame.id);
+    }
+    first_echo_ns_ = 0;
+  }
+  if (frames.empty()) {
+    return true;
+  }
+  return socket_.sendBurst(frames) == frames.size();
+}
+
+bool VescCanCommandGroup::onEcho(const VescCanFrame & frame)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (in_flight_.erase(frame.id) == 0) {
+    return false;
+  }
+  if (first_echo_ns_ == 0) {
+    first_echo_ns_ = frame.stamp_ns;
+  }
+  last_echo_ns_ = frame.stamp_ns;
+  if (!in_flight_.empty()) {
+    return false;
+  }
+
+  double skew = std::max<int64_t>(0, last_echo_ns_ - first_echo_ns_) * 1e-9;
+  skew_.bursts++;
+  skew_.last = skew;
+  skew_.max = std::max(skew_.max, skew);
+  skew_.mean += (skew - skew_.mean) / skew_.bursts;
+  return true;
+}
+
+VescCanCommandGroup::Skew VescCanCommandGroup::skew() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return skew_;
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,101 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_can_discovery.hpp"
+
+#include <thread>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+
+VescCanDiscovery::VescCanDiscovery(VescCanSocket & socket, uint8_t host_id)
+: socket_(socket),
+  host_id_(host_id),
+  sweeping_(false)
+{
+}
+
+std::vector<uint8_t> VescCanDiscovery::sweep(std::chrono::milliseconds timeout)
+{
+  std::vector<VescCanFrame> pings;
+  for (int id = 0; id < 255; id++) {
+    if (id == host_id_) {
+      continue;
+    }
+    VescCanFrame ping;
+    ping.id = codec::canId(CAN_PACKET_PING, static_cast<uint8_t>(id));
+    ping.len = 1;
+    ping.data[0] = host_id_;
+    pings.push_back(ping);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    found_.clear();
+    sweeping_ = true;
+  }
+
+  // the pings outnumber a CAN interface's transmit queue, send what it takes and top it up as the
+  // bus drains it. At 500 kbit/s all of them are out in about 40 ms.
+  auto send_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  size_t sent = 0;
+  while (sent < pings.size() && socket_.isOpen() &&
+    std::chrono::steady_clock::now() < send_deadline)
+  {
+    size_t n = socket_.sendBurst(std::vector<VescCanFrame>(pings.begin() + sent, pings.end()));
+    sent += n;
+    if (n == 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+  std::this_thread::sleep_for(timeout);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  sweeping_ = false;
+  return std::vector<uint8_t>(found_.begin(), found_.end());
+}
+
+bool VescCanDiscovery::decode(const VescCanFrame & frame)
+{
+  if (frame.id != codec::canId(CAN_PACKET_PONG, host_id_)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (sweeping_ && frame.len >= 1) {
+    found_.insert(frame.data[0]);
+  }
+  return true;
+}
+
+}  // namespace vesc_driver
@@ -33,12 +33,15 @@
 #include <vesc_msgs/msg/vesc_state.hpp>
 #include <vesc_msgs/msg/vesc_state_stamped.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstdio>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace vesc_driver
 {
@@ -59,14 +62,35 @@ VescCanDriver::VescCanDriver()
   servo_limit_(this, "servo", 0.0, 1.0),
   driver_mode_(MODE_INITIALIZING),
   fw_version_major_(-1),
-  fw_version_minor_(-1)
+  fw_version_minor_(-1),
+  status_decoder_(std::bind(&VescCanDriver::statusCallback, this, _1)),
+  can_transport_(can_socket_),
+  command_group_(can_socket_),
+  discovery_(can_socket_)
 {
   // get vesc serial port address
   std::string port = declare_parameter<std::string>("port", "can0");
-  vesc_.SetStateUpdatedCallback(std::bind(&VescCanDriver::VescStateUpdatedCallback, this, 
-        std::placeholders::_1));
-
-  controller_id_ = declare_parameter<uint8_t>("vesc_id", 0x68);
+  // -1 to use the only vesc on the bus
+  int vesc_id = declare_parameter<int>("vesc_id", 0x68);
+  bool discover = declare_parameter<bool>("discover_controllers", true);
+  bool publish_all = declare_parameter<bool>("publish_all_controllers", false);
+  controller_id_ = static_cast<uint8_t>(vesc_id);
+
+  // bus load, frame rates and error frames on /diagnostics, at the updater's
+  // diagnostic_updater.period, 1 s by default
+  bus_monitor_ = std::make_unique<VescCanBusMonitor>(
+    static_cast<uint32_t>(declare_parameter<int>("can_bitrate", 500000)));
+  bus_load_warn_ = declare_parameter<double>("bus_load_warn", 0.7);
+  updater_ = std::make_unique<diagnostic_updater::Updater>(this);
+  updater_->setHardwareID(port);
+  updater_->add("CAN bus", this, &VescCanDriver::busDiagnostics);
+
+  // current limits enforced by the vesc itself, e.g. to switch power modes at runtime
+  std::string limits_error;
+  current_limits_ = VescCurrentLimits::declare(*get_node_parameters_interface(), &limits_error);
+  if (!limits_error.empty()) {
+    RCLCPP_WARN(get_logger(), "Not pushing current limits, %s.", limits_error.c_str());
+  }
 
   // create vesc state (telemetry) publisher
   state_pub_ = create_publisher<VescStateStamped>("sensors/core", rclcpp::QoS{10});
@@ -94,15 +118,48 @@ VescCanDriver::VescCanDriver()
   servo_sub_ = create_subscription<Float64>(
     "commands/servo/position", rclcpp::QoS{10}, std::bind(&VescCanDriver::servoCallback, this, _1));
 
+  // setpoints for several vescs on the bus at once, e.g. all wheels of a base. They go out back to
+  // back, and the time from the first to the last frame on the bus is published as the skew.
+  command_group_sub_ = create_subscription<VescCommandGroup>(
+    "commands/group", rclcpp::QoS{10}, std::bind(&VescCanDriver::commandGroupCallback, this, _1));
+  command_skew_pub_ = create_publisher<Float64>("sensors/command_skew", rclcpp::QoS{10});
+
   // attempt to connect to the serial port
   try {
+    can_transport_.setPacketHandler(
+      std::bind(&VescCanDriver::packetCallback, this, _1, std::placeholders::_2));
+    can_transport_.setErrorHandler(std::bind(&VescCanDriver::errorCallback, this, _1));
+    can_socket_.open(
+      port, [this](const VescCanFrame & frame) {
+        bus_monitor_->onFrame(frame);
+        if (frame.error || !frame.extended) {
+          return;
+        }
+        if (frame.echo) {
+          if (command_group_.onEcho(frame)) {
+            auto skew_msg = Float64();
+            skew_msg.data = command_group_.skew().last;
+            command_skew_pub_->publish(skew_msg);
+          }
+        } else if (!status_decoder_.decode(frame) && !discovery_.decode(frame)) {
+          can_transport_.decode(frame);
+        }
+      });
+    if ((discover || vesc_id < 0) && !discoverControllers(vesc_id, publish_all)) {
+      rclcpp::shutdown();
+      return;
+    }
     vesc_.Connect(port, controller_id_);
+    pushCurrentLimits(current_limits_);
   } catch (...) {
     RCLCPP_FATAL(get_logger(), "Failed to connect to the VESC %x @ %s.", controller_id_, port.c_str());
     rclcpp::shutdown();
     return;
   }
 
+  current_limits_callback_ = add_on_set_parameters_callback(
+    std::bind(&VescCanDriver::currentLimitsCallback, this, _1));
+
   // create a 50Hz timer, used for state machine & polling VESC telemetry
   timer_ = create_wall_timer(20ms, std::bind(&VescCanDriver::timerCallback, this));
 
@@ -137,6 +194,10 @@ void VescCanDriver::timerCallback()
    *  OPERATING - receiving commands from subscriber topics
    */
   if (driver_mode_ == MODE_INITIALIZING) {
+        // the firmware version is not in the status frames, ask for it with a complete packet
+        if (fw_version_major_ < 0) {
+            can_transport_.send(controller_id_, VescPacketRequestFWVersion());
+        }
         if(state_msg_received_) {
             driver_mode_ = MODE_OPERATING;
             RCLCPP_INFO(get_logger(), "VESC driver initialized.");
@@ -148,40 +209,194 @@ void VescCanDriver::timerCallback()
   }
 }
 
-void VescCanDriver::VescStateUpdatedCallback(const robosw::StampedVescState &msg) {
-    auto state_msg = VescStateStamped();
-    state_msg.header.stamp = now();
+/**
+ * Ping every id on the bus and check the configured vesc answers, a wrong vesc_id would otherwise
+ * leave the driver waiting for telemetry forever. With @p vesc_id -1 the only vesc found is used.
+ * A configured vesc that does not answer is not replaced by another one, that could drive the
+ * wrong motor.
+ *
+ * @return false if there is no vesc to drive.
+ */
+bool VescCanDriver::discoverControllers(int vesc_id, bool publish_all)
+{
+  std::vector<uint8_t> ids = discovery_.sweep();
+  std::ostringstream list;
+  for (uint8_t id : ids) {
+    list << (list.tellp() > 0 ? ", " : "") << static_cast<int>(id);
+  }
+  RCLCPP_INFO(
+    get_logger(), "%zu VESCs answered on the bus: %s.", ids.size(), list.str().c_str());
+
+  if (vesc_id < 0) {
+    if (ids.size() != 1) {
+      RCLCPP_FATAL(
+        get_logger(), "vesc_id is not set and %zu VESCs answered, set vesc_id.", ids.size());
+      return false;
+    }
+    controller_id_ = ids[0];
+  } else if (std::find(ids.begin(), ids.end(), controller_id_) == ids.end()) {
+    RCLCPP_FATAL(
+      get_logger(), "VESC %d did not answer the ping, check vesc_id. Found: %s.", controller_id_,
+      list.str().c_str());
+    return false;
+  }
 
-    if(!state_msg_received_) {
-        state_msg_received_ = true;
+  // the others' telemetry on vesc<id>/sensors/core
+  if (publish_all) {
+    std::lock_guard<std::mutex> lock(controller_state_pubs_mutex_);
+    for (uint8_t id : ids) {
+      if (id != controller_id_) {
+        controller_state_pubs_[id] = create_publisher<VescStateStamped>(
+          "vesc" + std::to_string(id) + "/sensors/core", rclcpp::QoS{10});
+      }
     }
+  }
+  return true;
+}
 
-    state_msg.state.voltage_input = msg.state.voltage_input;
-    state_msg.state.current_motor = msg.state.current_motor;
-    state_msg.state.current_input = msg.state.current_input;
-    state_msg.state.avg_id = 0;
-    state_msg.state.avg_iq = 0;
-    state_msg.state.duty_cycle = msg.state.duty_cycle;
-    state_msg.state.speed = msg.state.speed;
-
-    state_msg.state.charge_drawn = msg.state.charge_drawn;
-    state_msg.state.charge_regen = msg.state.charge_regen;
-    state_msg.state.energy_drawn = msg.state.energy_drawn;
-    state_msg.state.energy_regen = msg.state.energy_regen;
-    state_msg.state.displacement = msg.state.displacement;
-    state_msg.state.distance_traveled = msg.state.distance_traveled;
-    state_msg.state.fault_code = msg.state.fault_code;
-
-    state_msg.state.pid_pos_now = 0;
-    state_msg.state.controller_id = 0x68;
-
-    state_msg.state.ntc_temp_mos1 = msg.state.temperature_pcb;
-    state_msg.state.ntc_temp_mos2 = msg.state.temperature_pcb;
-    state_msg.state.ntc_temp_mos3 = msg.state.temperature_pcb;
-    state_msg.state.avg_vd = 0;
-    state_msg.state.avg_vq = 0;
-
-    state_pub_->publish(state_msg);
+/** Push changed current limit parameters, they are only accepted once the frames went out */
+rcl_interfaces::msg::SetParametersResult VescCanDriver::currentLimitsCallback(
+  const std::vector<rclcpp::Parameter> & parameters)
+{
+  rcl_interfaces::msg::SetParametersResult result;
+  VescCurrentLimits limits = current_limits_;
+  result.successful = limits.update(parameters, &result.reason);
+  if (result.successful && limits != current_limits_) {
+    result.successful = pushCurrentLimits(limits);
+    if (result.successful) {
+      current_limits_ = limits;
+    } else {
+      result.reason = "the CAN interface did not take the limit frames";
+    }
+  }
+  return result;
+}
+
+/** One frame per min/max pair, CAN_PACKET_CONF_CURRENT_LIMITS(_IN) or the store variant */
+bool VescCanDriver::pushCurrentLimits(const VescCurrentLimits & limits)
+{
+  if (limits.empty()) {
+    return true;
+  }
+  std::vector<VescCanFrame> frames = limits.canFrames(controller_id_);
+  if (can_socket_.sendBurst(frames) != frames.size()) {
+    RCLCPP_ERROR(get_logger(), "Failed to send the current limits to VESC %d.", controller_id_);
+    return false;
+  }
+  RCLCPP_INFO(
+    get_logger(), "VESC %d current limits%s: %s.", controller_id_,
+    limits.persist ? " (stored)" : "", limits.describe().c_str());
+  return true;
+}
+
+/** Bus load, frame rate per id and error frames since the last update */
+void VescCanDriver::busDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat)
+{
+  VescCanBusMonitor::Report report = bus_monitor_->report();
+
+  bool high = report.load > bus_load_warn_;
+  if (high && !bus_load_high_) {
+    RCLCPP_WARN(
+      get_logger(), "CAN bus load %.0f%% is above %.0f%%, status broadcasts and commands will be "
+      "delayed. Lower the VESCs' status rates or raise the bit rate.", report.load * 100.0,
+      bus_load_warn_ * 100.0);
+  }
+  bus_load_high_ = high;
+
+  if (!can_socket_.isOpen()) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::ERROR, "Disconnected");
+  } else if (report.error_frames > 0) {
+    stat.summaryf(
+      diagnostic_msgs::msg::DiagnosticStatus::WARN, "%lu error frames since the last update",
+      static_cast<unsigned long>(report.error_frames));
+  } else if (high) {
+    stat.summaryf(
+      diagnostic_msgs::msg::DiagnosticStatus::WARN, "Bus load %.0f%%", report.load * 100.0);
+  } else {
+    stat.summaryf(
+      diagnostic_msgs::msg::DiagnosticStatus::OK, "Bus load %.0f%%", report.load * 100.0);
+  }
+
+  stat.addf("Bus load (%)", "%.1f", report.load * 100.0);
+  stat.addf("Frames/s", "%.1f", report.frames_per_second);
+  stat.add("Error frames", report.error_frames);
+  stat.addf("Error classes", "0x%08x", report.error_classes);
+  for (const auto & entry : report.id_rates) {
+    char id[16];
+    if (entry.first & VescCanBusMonitor::EXTENDED_ID_FLAG) {
+      std::snprintf(
+        id, sizeof(id), "0x%08x", entry.first & ~VescCanBusMonitor::EXTENDED_ID_FLAG);
+    } else {
+      std::snprintf(id, sizeof(id), "0x%03x", entry.first);
+    }
+    stat.addf(std::string("Frames/s ") + id, "%.1f", entry.second);
+  }
+}
+
+/** Publish a controller's telemetry once all of its status frames of a cycle arrived */
+void VescCanDriver::statusCallback(const VescCanStatus & status)
+{
+  rclcpp::Publisher<VescStateStamped>::SharedPtr pub;
+  if (status.controller_id == controller_id_) {
+    pub = state_pub_;
+    state_msg_received_ = true;
+  } else {
+    std::lock_guard<std::mutex> lock(controller_state_pubs_mutex_);
+    auto it = controller_state_pubs_.find(status.controller_id);
+    if (it == controller_state_pubs_.end()) {
+      return;
+    }
+    pub = it->second;
+  }
+
+  auto state_msg = VescStateStamped();
+  state_msg.header.stamp = now();
+
+  state_msg.state.voltage_input = status.voltage_input;
+  state_msg.state.current_motor = status.current_motor;
+  state_msg.state.current_input = status.current_input;
+  state_msg.state.duty_cycle = status.duty_cycle;
+  state_msg.state.speed = status.rpm;
+
+  state_msg.state.charge_drawn = status.amp_hours;
+  state_msg.state.charge_regen = status.amp_hours_charged;
+  state_msg.state.energy_drawn = status.watt_hours;
+  state_msg.state.energy_regen = status.watt_hours_charged;
+  state_msg.state.displacement = status.tachometer;
+
+  state_msg.state.temp_fet = status.temp_fet;
+  state_msg.state.temp_motor = status.temp_motor;
+  state_msg.state.pid_pos_now = status.pid_pos;
+  state_msg.state.controller_id = status.controller_id;
+
+  // the status frames carry neither the dq-axis values, the per-MOSFET temperatures, the absolute
+  // tachometer nor the fault code, they stay zero
+
+  pub->publish(state_msg);
+}
+
+/** Replies to packets sent with can_transport_ */
+void VescCanDriver::packetCallback(uint8_t controller_id, const VescPacketConstPtr & packet)
+{
+  if (controller_id != controller_id_) {
+    return;
+  }
+  if (packet->name() == "FWVersion") {
+    std::shared_ptr<VescPacketFWVersion const> fw_version =
+      std::dynamic_pointer_cast<VescPacketFWVersion const>(packet);
+    if (fw_version_major_ < 0) {
+      RCLCPP_INFO(
+        get_logger(), "Connected to VESC %s with firmware version %d.%d over CAN.",
+        fw_version->hwname().c_str(), fw_version->fwMajor(), fw_version->fwMinor());
+    }
+    fw_version_major_ = fw_version->fwMajor();
+    fw_version_minor_ = fw_version->fwMinor();
+  }
+}
+
+void VescCanDriver::errorCallback(const std::string & error)
+{
+  RCLCPP_ERROR(get_logger(), "%s", error.c_str());
 }
 
 /**
@@ -234,6 +449,49 @@ void VescCanDriver::speedCallback(const Float64::SharedPtr speed)
   }
 }
 
+/**
+ * @param group Setpoints of one kind for several VESCs, clipped to this driver's limits for that
+ *              kind and sent as one burst.
+ */
+void VescCanDriver::commandGroupCallback(const VescCommandGroup::SharedPtr group)
+{
+  if (driver_mode_ != MODE_OPERATING) {
+    return;
+  }
+  if (group->controller_ids.size() != group->values.size()) {
+    RCLCPP_WARN(get_logger(), "Command group needs one value per controller id, ignored.");
+    return;
+  }
+  for (size_t i = 0; i < group->values.size(); i++) {
+    uint8_t id = group->controller_ids[i];
+    double value = group->values[i];
+    switch (group->command) {
+      case VescCommandGroup::COMMAND_DUTY_CYCLE:
+        command_group_.setDutyCycle(id, duty_cycle_limit_.clip(value));
+        break;
+      case VescCommandGroup::COMMAND_CURRENT:
+        command_group_.setCurrent(id, current_limit_.clip(value));
+        break;
+      case VescCommandGroup::COMMAND_BRAKE:
+        command_group_.setBrake(id, brake_limit_.clip(value));
+        break;
+      case VescCommandGroup::COMMAND_SPEED:
+        command_group_.setSpeed(id, speed_limit_.clip(value));
+        break;
+      case VescCommandGroup::COMMAND_POSITION:
+        // radians on the topic, degrees on the bus
+        command_group_.setPosition(id, position_limit_.clip(value) * 180.0 / M_PI);
+        break;
+      default:
+        RCLCPP_WARN(get_logger(), "Unknown command group command %u, ignored.", group->command);
+        return;
+    }
+  }
+  if (!command_group_.send()) {
+    RCLCPP_WARN(get_logger(), "CAN interface did not take the whole command group.");
+  }
+}
+
 /**
  * @param position Commanded VESC motor position in radians. Any value is accepted by this driver.
  *                 Note that the VESC must be in encoder mode for this command to have an effect.
@@ -0,0 +1,204 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_can_socket.hpp"
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vesc_driver
+{
+
+VescCanSocket::~VescCanSocket()
+{
+  close();
+}
+
+void VescCanSocket::open(const std::string & interface, const FrameHandlerFunction & handler)
+{
+  if (isOpen()) {
+    throw std::runtime_error("CAN socket already open");
+  }
+
+  int fd = ::socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("CAN socket failed: ") + std::strerror(errno));
+  }
+  struct sockaddr_can addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = static_cast<int>(::if_nametoindex(interface.c_str()));
+  if (addr.can_ifindex == 0) {
+    ::close(fd);
+    throw std::runtime_error("no CAN interface " + interface);
+  }
+  // all traffic, standard frames from other devices and error frames count towards the bus load
+  can_err_mask_t err_mask = CAN_ERR_MASK;
+  ::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+  // echoes of the own frames and receive times, to see when sent frames reached the bus
+  int on = 1;
+  ::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &on, sizeof(on));
+  ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+  if (::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+    std::string error = std::string("binding to ") + interface + " failed: " + std::strerror(errno);
+    ::close(fd);
+    throw std::runtime_error(error);
+  }
+
+  handler_ = handler;
+  fd_ = fd;
+  run_ = true;
+  thread_.reset(new std::thread(&VescCanSocket::receiveThread, this));
+}
+
+void VescCanSocket::close()
+{
+  if (thread_) {
+    run_ = false;
+    thread_->join();
+    thread_.reset();
+  }
+  std::lock_guard<std::mutex> lock(send_mutex_);
+  int fd = fd_.exchange(-1);
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+bool VescCanSocket::isOpen() const
+{
+  return fd_ >= 0;
+}
+
+namespace
+{
+
+void toCanFrame(const VescCanFrame & frame, struct can_frame * out)
+{
+  std::memset(out, 0, sizeof(*out));
+  out->can_id = (frame.id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  out->can_dlc = frame.len;
+  std::memcpy(out->data, frame.data, frame.len);
+}
+
+}  // namespace
+
+bool VescCanSocket::send(const VescCanFrame & frame)
+{
+  struct can_frame out;
+  toCanFrame(frame, &out);
+
+  std::lock_guard<std::mutex> lock(send_mutex_);
+  if (fd_ < 0) {
+    return false;
+  }
+  return ::write(fd_, &out, sizeof(out)) == sizeof(out);
+}
+
+size_t VescCanSocket::sendBurst(const std::vector<VescCanFrame> & frames)
+{
+  std::vector<struct can_frame> out(frames.size());
+  std::vector<struct iovec> iov(frames.size());
+  std::vector<struct mmsghdr> msgs(frames.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    toCanFrame(frames[i], &out[i]);
+    iov[i].iov_base = &out[i];
+    iov[i].iov_len = sizeof(out[i]);
+    std::memset(&msgs[i], 0, sizeof(msgs[i]));
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  std::lock_guard<std::mutex> lock(send_mutex_);
+  size_t sent = 0;
+  while (fd_ >= 0 && sent < msgs.size()) {
+    int n = ::sendmmsg(fd_, msgs.data() + sent, static_cast<unsigned int>(msgs.size() - sent), 0);
+    if (n <= 0) {
+      break;
+    }
+    sent += n;
+  }
+  return sent;
+}
+
+void VescCanSocket::receiveThread()
+{
+  // wake up now and then to notice close()
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  while (run_) {
+    if (::poll(&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    struct can_frame in;
+    struct iovec iov = {&in, sizeof(in)};
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = ::recvmsg(fd_, &msg, 0);
+    if (n != sizeof(in) || in.can_dlc > 8) {
+      continue;
+    }
+    VescCanFrame frame;
+    frame.error = (in.can_id & CAN_ERR_FLAG) != 0;
+    frame.extended = (in.can_id & CAN_EFF_FLAG) != 0;
+    if (frame.error) {
+      frame.id = in.can_id & CAN_ERR_MASK;
+    } else {
+      frame.id = in.can_id & (frame.extended ? CAN_EFF_MASK : CAN_SFF_MASK);
+    }
+    frame.len = in.can_dlc;
+    std::memcpy(frame.data, in.data, in.can_dlc);
+    frame.echo = (msg.msg_flags & MSG_CONFIRM) != 0;
+    for (struct cmsghdr * c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMPNS) {
+        struct timespec ts;
+        std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        frame.stamp_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+      }
+    }
+    handler_(frame);
+  }
+}
+
+}  // namespace vesc_driver
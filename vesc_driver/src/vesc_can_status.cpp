@@ -0,0 +1,151 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_can_status.hpp"
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+using codec::CanFrameSchema;
+using codec::Field;
+
+// status frame layouts, see comm_can.c in the VESC firmware
+typedef CanFrameSchema<CAN_PACKET_STATUS,
+    Field<int32_t>,             // rpm
+    Field<int16_t, 10>,         // motor current
+    Field<int16_t, 1000>        // duty cycle
+> StatusSchema;
+
+typedef CanFrameSchema<CAN_PACKET_STATUS_2,
+    Field<int32_t, 10000>,      // amp hours
+    Field<int32_t, 10000>       // amp hours charged
+> Status2Schema;
+
+typedef CanFrameSchema<CAN_PACKET_STATUS_3,
+    Field<int32_t, 10000>,      // watt hours
+    Field<int32_t, 10000>       // watt hours charged
+> Status3Schema;
+
+typedef CanFrameSchema<CAN_PACKET_STATUS_4,
+    Field<int16_t, 10>,         // fet temperature
+    Field<int16_t, 10>,         // motor temperature
+    Field<int16_t, 10>,         // input current
+    Field<int16_t, 50>          // pid position
+> Status4Schema;
+
+typedef CanFrameSchema<CAN_PACKET_STATUS_5,
+    Field<int32_t>,             // tachometer
+    Field<int16_t, 10>,         // input voltage
+    Field<int16_t>              // reserved
+> Status5Schema;
+
+static_assert(StatusSchema::SIZE == 8 && Status4Schema::SIZE == 8, "status frames are 8 bytes");
+static_assert(Status5Schema::SIZE == 8, "status frames are 8 bytes");
+
+}  // namespace
+
+VescCanStatusDecoder::VescCanStatusDecoder(const StatusHandlerFunction & handler)
+: handler_(handler)
+{
+}
+
+bool VescCanStatusDecoder::decode(const VescCanFrame & frame)
+{
+  uint8_t packet_id = static_cast<uint8_t>(frame.id >> 8);
+  uint8_t bit;
+  switch (packet_id) {
+    case CAN_PACKET_STATUS: bit = STATUS_1; break;
+    case CAN_PACKET_STATUS_2: bit = STATUS_2; break;
+    case CAN_PACKET_STATUS_3: bit = STATUS_3; break;
+    case CAN_PACKET_STATUS_4: bit = STATUS_4; break;
+    case CAN_PACKET_STATUS_5: bit = STATUS_5; break;
+    default: return false;
+  }
+  if (frame.len < 8) {
+    return true;
+  }
+
+  uint8_t controller_id = static_cast<uint8_t>(frame.id & 0xFF);
+  Controller & controller = controllers_[controller_id];
+  VescCanStatus & status = controller.status;
+
+  // CAN_PACKET_STATUS opens a cycle. If the previous one is still open it had all frames the
+  // controller sends, or its send_can_status setting changed; either way that is the cycle now.
+  if (bit == STATUS_1 && status.frames != 0) {
+    if (controller.cycle != status.frames) {
+      controller.cycle = status.frames;
+      handler_(status);
+    }
+    status.frames = 0;
+  }
+
+  const uint8_t * data = frame.data;
+  switch (bit) {
+    case STATUS_1:
+      status.rpm = StatusSchema::decode<0>(data);
+      status.current_motor = StatusSchema::decode<1>(data);
+      status.duty_cycle = StatusSchema::decode<2>(data);
+      break;
+    case STATUS_2:
+      status.amp_hours = Status2Schema::decode<0>(data);
+      status.amp_hours_charged = Status2Schema::decode<1>(data);
+      break;
+    case STATUS_3:
+      status.watt_hours = Status3Schema::decode<0>(data);
+      status.watt_hours_charged = Status3Schema::decode<1>(data);
+      break;
+    case STATUS_4:
+      status.temp_fet = Status4Schema::decode<0>(data);
+      status.temp_motor = Status4Schema::decode<1>(data);
+      status.current_input = Status4Schema::decode<2>(data);
+      status.pid_pos = Status4Schema::decode<3>(data);
+      break;
+    case STATUS_5:
+      status.tachometer = Status5Schema::read<0>(data);
+      status.voltage_input = Status5Schema::decode<1>(data);
+      break;
+  }
+  status.controller_id = controller_id;
+  status.frames |= bit;
+
+  if (controller.cycle != 0 && status.frames == controller.cycle) {
+    handler_(status);
+    status.frames = 0;
+  }
+  return true;
+}
+
+}  // namespace vesc_driver
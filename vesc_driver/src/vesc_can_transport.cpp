@@ -0,0 +1,256 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_can_transport.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+#include "vesc_driver/vesc_packet_factory.hpp"
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+using codec::CanFrameSchema;
+using codec::Field;
+
+// buffer protocol frames, see comm_can_send_buffer() in the VESC firmware
+typedef CanFrameSchema<CAN_PACKET_PROCESS_RX_BUFFER,
+    Field<uint8_t>,             // sender id
+    Field<uint8_t>,             // 0: process and reply, 1: a reply, 2: process without reply
+    Field<uint16_t>,            // payload length
+    Field<uint16_t>             // payload CRC
+> ProcessRxBufferSchema;
+
+const uint8_t PROCESS_AND_REPLY = 0;
+
+const size_t FILL_CHUNK = 7;        ///< payload bytes per FILL_RX_BUFFER frame
+const size_t FILL_LONG_CHUNK = 6;   ///< payload bytes per FILL_RX_BUFFER_LONG frame
+const size_t FILL_MAX_INDEX = 255;  ///< last index a FILL_RX_BUFFER frame can address
+const size_t SHORT_MAX = 6;         ///< payload bytes a PROCESS_SHORT_BUFFER frame carries
+
+}  // namespace
+
+VescCanTransport::VescCanTransport(
+  VescCanSocket & socket, uint8_t first_reply_id, uint8_t reply_id_count)
+: socket_(socket),
+  first_reply_id_(first_reply_id),
+  reply_id_count_(std::max<uint8_t>(1, reply_id_count))
+{
+}
+
+void VescCanTransport::setPacketHandler(const PacketHandlerFunction & handler)
+{
+  packet_handler_ = handler;
+}
+
+void VescCanTransport::setErrorHandler(const ErrorHandlerFunction & handler)
+{
+  error_handler_ = handler;
+}
+
+VescCanTransport::Controller & VescCanTransport::controller(uint8_t controller_id)
+{
+  std::lock_guard<std::mutex> lock(controllers_mutex_);
+  auto & entry = controllers_[controller_id];
+  if (!entry) {
+    entry.reset(new Controller());
+    entry->reply_id = static_cast<uint8_t>(
+      first_reply_id_ + (controllers_.size() - 1) % reply_id_count_);
+  }
+  return *entry;
+}
+
+bool VescCanTransport::sendFrame(uint32_t id, const uint8_t * data, uint8_t len)
+{
+  VescCanFrame frame;
+  frame.id = id;
+  frame.len = len;
+  std::memcpy(frame.data, data, len);
+  // a long transfer can fill the interface's transmit queue, give the bus time to drain it
+  for (int attempt = 0; attempt < 100; attempt++) {
+    if (socket_.send(frame)) {
+      return true;
+    }
+    if (!socket_.isOpen()) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+  return false;
+}
+
+bool VescCanTransport::send(uint8_t controller_id, const VescPacket & packet)
+{
+  // the payload and its CRC straight from the serial frame
+  const Buffer & frame = packet.frame();
+  size_t header = frame[0] == VescFrame::VESC_SOF_VAL_SMALL_FRAME ? 2 : 3;
+  size_t size = frame.size() - header - 3;
+  const uint8_t * payload = frame.data() + header;
+  uint16_t crc = static_cast<uint16_t>(frame[header + size] << 8 | frame[header + size + 1]);
+
+  Controller & target = controller(controller_id);
+  std::lock_guard<std::mutex> lock(target.mutex);
+
+  uint8_t data[8];
+  if (size <= SHORT_MAX) {
+    data[0] = target.reply_id;
+    data[1] = PROCESS_AND_REPLY;
+    std::memcpy(data + 2, payload, size);
+    return sendFrame(
+      codec::canId(CAN_PACKET_PROCESS_SHORT_BUFFER, controller_id), data,
+      static_cast<uint8_t>(size + 2));
+  }
+
+  size_t index = 0;
+  for (; index < size && index <= FILL_MAX_INDEX; index += FILL_CHUNK) {
+    size_t n = std::min(FILL_CHUNK, size - index);
+    data[0] = static_cast<uint8_t>(index);
+    std::memcpy(data + 1, payload + index, n);
+    if (!sendFrame(
+        codec::canId(CAN_PACKET_FILL_RX_BUFFER, controller_id), data, static_cast<uint8_t>(n + 1)))
+    {
+      return false;
+    }
+  }
+  for (; index < size; index += FILL_LONG_CHUNK) {
+    size_t n = std::min(FILL_LONG_CHUNK, size - index);
+    data[0] = static_cast<uint8_t>(index >> 8);
+    data[1] = static_cast<uint8_t>(index & 0xFF);
+    std::memcpy(data + 2, payload + index, n);
+    if (!sendFrame(
+        codec::canId(CAN_PACKET_FILL_RX_BUFFER_LONG, controller_id), data,
+        static_cast<uint8_t>(n + 2)))
+    {
+      return false;
+    }
+  }
+  ProcessRxBufferSchema::encode(data, target.reply_id, PROCESS_AND_REPLY, size, crc);
+  return sendFrame(
+    codec::canId(CAN_PACKET_PROCESS_RX_BUFFER, controller_id), data, ProcessRxBufferSchema::SIZE);
+}
+
+bool VescCanTransport::decode(const VescCanFrame & frame)
+{
+  uint8_t packet_id = static_cast<uint8_t>(frame.id >> 8);
+  uint8_t reply_id = static_cast<uint8_t>(frame.id & 0xFF);
+  if (reply_id < first_reply_id_ || reply_id - first_reply_id_ >= reply_id_count_) {
+    return false;
+  }
+  const uint8_t * data = frame.data;
+
+  switch (packet_id) {
+    case CAN_PACKET_FILL_RX_BUFFER:
+    case CAN_PACKET_FILL_RX_BUFFER_LONG:
+      {
+        bool long_index = packet_id == CAN_PACKET_FILL_RX_BUFFER_LONG;
+        size_t header = long_index ? 2 : 1;
+        if (frame.len <= header) {
+          return true;
+        }
+        size_t index = long_index ? (data[0] << 8 | data[1]) : data[0];
+        size_t n = frame.len - header;
+        if (index + n > VescFrame::VESC_MAX_PAYLOAD_SIZE) {
+          return true;
+        }
+        Buffer & buffer = rx_buffers_[reply_id];
+        if (buffer.size() < index + n) {
+          buffer.resize(index + n);
+        }
+        std::copy(data + header, data + header + n, buffer.begin() + index);
+        return true;
+      }
+    case CAN_PACKET_PROCESS_RX_BUFFER:
+      {
+        if (frame.len < ProcessRxBufferSchema::SIZE) {
+          return true;
+        }
+        uint8_t sender = ProcessRxBufferSchema::read<0>(data);
+        size_t size = ProcessRxBufferSchema::read<2>(data);
+        uint16_t crc = ProcessRxBufferSchema::read<3>(data);
+        Buffer & buffer = rx_buffers_[reply_id];
+        if (size == 0 || size > buffer.size()) {
+          error_handler_("CAN reply from " + std::to_string(sender) + " is incomplete.");
+        } else if (codec::crc16(buffer.data(), size) != crc) {
+          error_handler_("CAN reply from " + std::to_string(sender) + " has a bad checksum.");
+        } else {
+          handlePayload(sender, buffer.data(), size);
+        }
+        buffer.clear();
+        return true;
+      }
+    case CAN_PACKET_PROCESS_SHORT_BUFFER:
+      if (frame.len > 2) {
+        handlePayload(data[0], data + 2, frame.len - 2);
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+/** Wrap a reassembled payload into a serial frame and have the factory parse it */
+void VescCanTransport::handlePayload(uint8_t controller_id, const uint8_t * payload, size_t size)
+{
+  Buffer frame;
+  frame.reserve(size + 6);
+  if (size <= 255) {
+    frame.push_back(VescFrame::VESC_SOF_VAL_SMALL_FRAME);
+  } else {
+    frame.push_back(VescFrame::VESC_SOF_VAL_LARGE_FRAME);
+    frame.push_back(static_cast<uint8_t>(size >> 8));
+  }
+  frame.push_back(static_cast<uint8_t>(size & 0xFF));
+  frame.insert(frame.end(), payload, payload + size);
+  uint16_t crc = codec::crc16(payload, size);
+  frame.push_back(static_cast<uint8_t>(crc >> 8));
+  frame.push_back(static_cast<uint8_t>(crc & 0xFF));
+  frame.push_back(VescFrame::VESC_EOF_VAL);
+
+  int bytes_needed = 0;
+  std::string error;
+  VescPacketConstPtr packet =
+    VescPacketFactory::createPacket(frame.begin(), frame.end(), &bytes_needed, &error);
+  if (packet) {
+    packet_handler_(controller_id, packet);
+  } else {
+    error_handler_("CAN reply from " + std::to_string(controller_id) + ": " + error);
+  }
+}
+
+}  // namespace vesc_driver
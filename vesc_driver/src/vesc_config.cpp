@@ -0,0 +1,316 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_config.hpp"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+/** Sequential big-endian reader over a serialized configuration */
+class ConfReader
+{
+public:
+  explicit ConfReader(const Buffer & data)
+  : data_(data), ind_(0), ok_(true) {}
+
+  bool ok() const {return ok_;}
+
+  uint32_t read(VESC_TX_T type, double scale, double * value)
+  {
+    switch (type) {
+      case VESC_TX_UINT8:
+        *value = u8();
+        break;
+      case VESC_TX_UINT16:
+        *value = u16();
+        break;
+      case VESC_TX_UINT32:
+        *value = u32();
+        break;
+      case VESC_TX_DOUBLE16:
+        *value = static_cast<int16_t>(u16()) / scale;
+        break;
+      case VESC_TX_DOUBLE32_AUTO:
+        *value = decodeFloat32Auto(u32());
+        break;
+      default:
+        ok_ = false;
+        *value = 0.0;
+        break;
+    }
+    return ok_;
+  }
+
+  uint8_t u8()
+  {
+    if (!require(1)) {return 0;}
+    return data_[ind_++];
+  }
+
+  uint16_t u16()
+  {
+    if (!require(2)) {return 0;}
+    uint16_t v = (static_cast<uint16_t>(data_[ind_]) << 8) + data_[ind_ + 1];
+    ind_ += 2;
+    return v;
+  }
+
+  uint32_t u32()
+  {
+    if (!require(4)) {return 0;}
+    uint32_t v =
+      (static_cast<uint32_t>(data_[ind_]) << 24) + (static_cast<uint32_t>(data_[ind_ + 1]) << 16) +
+      (static_cast<uint32_t>(data_[ind_ + 2]) << 8) + static_cast<uint32_t>(data_[ind_ + 3]);
+    ind_ += 4;
+    return v;
+  }
+
+private:
+  bool require(size_t n)
+  {
+    if (ind_ + n > data_.size()) {
+      ok_ = false;
+    }
+    return ok_;
+  }
+
+  const Buffer & data_;
+  size_t ind_;
+  bool ok_;
+};
+
+// assign a decoded value to a configuration member of arbitrary (float, bool, enum, int) type
+template<typename T>
+void assignField(T * dst, double value, std::true_type /* floating point */)
+{
+  *dst = static_cast<T>(value);
+}
+
+template<typename T>
+void assignField(T * dst, double value, std::false_type /* integral or enum */)
+{
+  *dst = static_cast<T>(static_cast<int64_t>(value));
+}
+
+template<typename ConfT, typename T, T ConfT::* Member>
+void setField(ConfT * conf, double value)
+{
+  assignField(&(conf->*Member), value, std::is_floating_point<T>());
+}
+
+/** One entry of a configuration schema: wire type, scale for DOUBLE16 and the member it fills */
+template<typename ConfT>
+struct ConfField
+{
+  VESC_TX_T type;
+  double scale;
+  void (* set)(ConfT *, double);
+};
+
+#define CONF_FIELD(conf_t, type, scale, member) \
+  {type, scale, &setField<conf_t, decltype(conf_t::member), &conf_t::member>}
+
+/** Limits section of mc_configuration as written by confgenerator.c, firmware 5.x */
+const ConfField<mc_configuration> MCCONF_SCHEMA_V5[] = {
+  CONF_FIELD(mc_configuration, VESC_TX_UINT8, 1, pwm_mode),
+  CONF_FIELD(mc_configuration, VESC_TX_UINT8, 1, comm_mode),
+  CONF_FIELD(mc_configuration, VESC_TX_UINT8, 1, motor_type),
+  CONF_FIELD(mc_configuration, VESC_TX_UINT8, 1, sensor_mode),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_current_max),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_current_min),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_in_current_max),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_in_current_min),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_abs_current_max),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_min_erpm),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_max_erpm),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10000, l_erpm_start),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_max_erpm_fbrake),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_max_erpm_fbrake_cc),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_min_vin),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_max_vin),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_battery_cut_start),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_battery_cut_end),
+  CONF_FIELD(mc_configuration, VESC_TX_UINT8, 1, l_slow_abs_current),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10, l_temp_fet_start),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10, l_temp_fet_end),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10, l_temp_motor_start),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10, l_temp_motor_end),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10000, l_temp_accel_dec),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10000, l_min_duty),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10000, l_max_duty),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_watt_max),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE32_AUTO, 1, l_watt_min),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10000, l_current_max_scale),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10000, l_current_min_scale),
+  CONF_FIELD(mc_configuration, VESC_TX_DOUBLE16, 10000, l_duty_start),
+};
+
+/** General settings at the start of app_configuration, as written by confgenerator.c in FW 5.x */
+const ConfField<app_configuration> APPCONF_SCHEMA_V5[] = {
+  CONF_FIELD(app_configuration, VESC_TX_UINT8, 1, controller_id),
+  CONF_FIELD(app_configuration, VESC_TX_UINT32, 1, timeout_msec),
+  CONF_FIELD(app_configuration, VESC_TX_DOUBLE32_AUTO, 1, timeout_brake_current),
+  CONF_FIELD(app_configuration, VESC_TX_UINT8, 1, send_can_status),
+  CONF_FIELD(app_configuration, VESC_TX_UINT16, 1, send_can_status_rate_hz),
+  CONF_FIELD(app_configuration, VESC_TX_UINT8, 1, can_baud_rate),
+};
+
+#undef CONF_FIELD
+
+template<typename ConfT, size_t N>
+bool deserialize(
+  const Buffer & data, int fw_major, const ConfField<ConfT>(&schema)[N],
+  const std::vector<uint32_t> & signatures, ConfT * conf, uint32_t * signature)
+{
+  if (fw_major < 5) {
+    // older firmware serializes the configuration by hand in commands.c, not supported
+    return false;
+  }
+
+  ConfReader reader(data);
+  uint32_t sig = reader.u32();
+  if (signature != nullptr) {
+    *signature = sig;
+  }
+  if (!reader.ok() || std::find(signatures.begin(), signatures.end(), sig) == signatures.end()) {
+    // another layout, the schema would read the wrong fields
+    return false;
+  }
+  for (const auto & field : schema) {
+    double value;
+    if (!reader.read(field.type, field.scale, &value)) {
+      return false;
+    }
+    field.set(conf, value);
+  }
+  return reader.ok();
+}
+
+}  // namespace
+
+// confgenerator.h of the 5.x releases, in release order
+const std::vector<uint32_t> KNOWN_MCCONF_SIGNATURES = {
+  2211848314U,  // 5.02
+  3698540221U,  // 5.03
+};
+const std::vector<uint32_t> KNOWN_APPCONF_SIGNATURES = {
+  3264926020U,  // 5.02
+  2460147246U,  // 5.03
+};
+
+bool deserializeMcConf(
+  const Buffer & data, int fw_major, const std::vector<uint32_t> & signatures,
+  mc_configuration * conf, uint32_t * signature)
+{
+  return deserialize(data, fw_major, MCCONF_SCHEMA_V5, signatures, conf, signature);
+}
+
+bool deserializeAppConf(
+  const Buffer & data, int fw_major, const std::vector<uint32_t> & signatures,
+  app_configuration * conf, uint32_t * signature)
+{
+  return deserialize(data, fw_major, APPCONF_SCHEMA_V5, signatures, conf, signature);
+}
+
+/*------------------------------------------------------------------------------------------------*/
+
+VescConfigCache::VescConfigCache(const std::string & directory)
+: directory_(directory)
+{
+}
+
+std::string VescConfigCache::path(
+  const std::string & uuid, int fw_major, int fw_minor, const std::string & kind) const
+{
+  std::ostringstream ss;
+  ss << directory_ << "/" << uuid << "_fw" << fw_major << "." << fw_minor << "." << kind;
+  return ss.str();
+}
+
+bool VescConfigCache::load(
+  const std::string & uuid, int fw_major, int fw_minor, const std::string & kind,
+  Buffer * data) const
+{
+  std::ifstream file(path(uuid, fw_major, fw_minor, kind), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  data->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !data->empty();
+}
+
+bool VescConfigCache::store(
+  const std::string & uuid, int fw_major, int fw_minor, const std::string & kind,
+  const Buffer & data) const
+{
+  // create the cache directory, including parents
+  for (size_t pos = directory_.find('/', 1); ; pos = directory_.find('/', pos + 1)) {
+    std::string dir = directory_.substr(0, pos);
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (pos == std::string::npos) {
+      break;
+    }
+  }
+
+  // write to a temporary file first so a concurrent reader never sees a partial configuration
+  std::string file_path = path(uuid, fw_major, fw_minor, kind);
+  std::string tmp_path = file_path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    if (!file) {
+      return false;
+    }
+  }
+  return std::rename(tmp_path.c_str(), file_path.c_str()) == 0;
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,199 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_current_limits.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+using codec::CanFrameSchema;
+using codec::Field;
+
+// min then max, see comm_can.c in the VESC firmware. The store variants have the same layout.
+typedef CanFrameSchema<CAN_PACKET_CONF_CURRENT_LIMITS, Field<int32_t, 1000>, Field<int32_t, 1000>>
+  CurrentLimitsSchema;
+static_assert(CurrentLimitsSchema::SIZE == 8, "current limits layout changed");
+
+VescCanFrame limitsFrame(uint8_t packet_id, uint8_t controller_id, double min, double max)
+{
+  VescCanFrame frame;
+  frame.id = codec::canId(packet_id, controller_id);
+  frame.len = CurrentLimitsSchema::SIZE;
+  CurrentLimitsSchema::encode(frame.data, min, max);
+  return frame;
+}
+
+/** Fraction of the configured limit @p configured that gives @p limit, at most 1 */
+double limitScale(double limit, double configured, bool * capped)
+{
+  if (configured == 0.0) {
+    return 1.0;
+  }
+  double scale = limit / configured;
+  if (scale > 1.0) {
+    *capped = true;
+  }
+  return std::min(std::max(scale, 0.0), 1.0);
+}
+
+/** One min/max pair for describe() */
+std::string describePair(const char * name, double min, double max, bool set)
+{
+  char text[64];
+  if (set) {
+    std::snprintf(text, sizeof(text), "%s %.1f to %.1f A", name, min, max);
+  } else if (min != 0.0 || max != 0.0) {
+    std::snprintf(text, sizeof(text), "%s unchanged until min and max are set", name);
+  } else {
+    std::snprintf(text, sizeof(text), "%s unchanged", name);
+  }
+  return text;
+}
+
+}  // namespace
+
+bool VescCurrentLimits::operator==(const VescCurrentLimits & other) const
+{
+  return motor_min == other.motor_min && motor_max == other.motor_max &&
+         input_min == other.input_min && input_max == other.input_max &&
+         persist == other.persist;
+}
+
+VescCurrentLimits VescCurrentLimits::declare(
+  rclcpp::node_interfaces::NodeParametersInterface & params, std::string * reason)
+{
+  std::vector<rclcpp::Parameter> initial;
+  for (const char * name :
+    {"motor_current_min", "motor_current_max", "input_current_min", "input_current_max"})
+  {
+    initial.emplace_back(name, params.declare_parameter(name, rclcpp::ParameterValue(0.0)));
+  }
+  initial.emplace_back(
+    "persist_current_limits",
+    params.declare_parameter("persist_current_limits", rclcpp::ParameterValue(false)));
+
+  // the initial values are checked like any later change
+  VescCurrentLimits limits;
+  limits.update(initial, reason);
+  return limits;
+}
+
+bool VescCurrentLimits::update(
+  const std::vector<rclcpp::Parameter> & parameters, std::string * reason)
+{
+  VescCurrentLimits limits = *this;
+  for (const auto & parameter : parameters) {
+    const std::string & name = parameter.get_name();
+    if (name == "persist_current_limits") {
+      limits.persist = parameter.as_bool();
+      continue;
+    }
+
+    double * value = nullptr;
+    bool negative = false;
+    if (name == "motor_current_min") {
+      value = &limits.motor_min;
+      negative = true;
+    } else if (name == "motor_current_max") {
+      value = &limits.motor_max;
+    } else if (name == "input_current_min") {
+      value = &limits.input_min;
+      negative = true;
+    } else if (name == "input_current_max") {
+      value = &limits.input_max;
+    } else {
+      continue;
+    }
+
+    *value = parameter.as_double();
+    if (negative ? *value > 0.0 : *value < 0.0) {
+      *reason = name + (negative ? " must not be positive" : " must not be negative");
+      return false;
+    }
+  }
+  *this = limits;
+  return true;
+}
+
+std::string VescCurrentLimits::describe() const
+{
+  return describePair("motor", motor_min, motor_max, hasMotor()) + ", " +
+         describePair("input", input_min, input_max, hasInput());
+}
+
+std::vector<VescCanFrame> VescCurrentLimits::canFrames(uint8_t controller_id) const
+{
+  std::vector<VescCanFrame> frames;
+  if (hasMotor()) {
+    frames.push_back(
+      limitsFrame(
+        persist ? CAN_PACKET_CONF_STORE_CURRENT_LIMITS : CAN_PACKET_CONF_CURRENT_LIMITS,
+        controller_id, motor_min, motor_max));
+  }
+  if (hasInput()) {
+    frames.push_back(
+      limitsFrame(
+        persist ? CAN_PACKET_CONF_STORE_CURRENT_LIMITS_IN : CAN_PACKET_CONF_CURRENT_LIMITS_IN,
+        controller_id, input_min, input_max));
+  }
+  return frames;
+}
+
+VescPacketSetMcconfTemp::Limits VescCurrentLimits::mcconfTemp(
+  const mc_configuration & conf, bool * capped) const
+{
+  *capped = false;
+
+  VescPacketSetMcconfTemp::Limits limits;
+  limits.current_min_scale = hasMotor() ? limitScale(motor_min, conf.l_current_min, capped) : 1.0;
+  limits.current_max_scale = hasMotor() ? limitScale(motor_max, conf.l_current_max, capped) : 1.0;
+  limits.min_erpm = conf.l_min_erpm;
+  limits.max_erpm = conf.l_max_erpm;
+  limits.min_duty = conf.l_min_duty;
+  limits.max_duty = conf.l_max_duty;
+  limits.watt_min = conf.l_watt_min;
+  limits.watt_max = conf.l_watt_max;
+  limits.in_current_min = hasInput() ? input_min : conf.l_in_current_min;
+  limits.in_current_max = hasInput() ? input_max : conf.l_in_current_max;
+  return limits;
+}
+
+}  // namespace vesc_driver
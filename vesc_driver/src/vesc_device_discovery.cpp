@@ -0,0 +1,100 @@
+/*
+# Copyright  2021 Andrea Scipone
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+*/
+
+// Probe all candidate serial ports at once and record which VESC sits on which port.
+//
+//   vesc_device_discovery [--timeout ms] [--registry path] [port ...]
+//
+// Without ports, /dev/ttyACM* is probed. Like the namer run by udev, it needs root to write the
+// registry.
+
+#include <glob.h>
+#include <vesc_driver/vesc_device_registry.hpp>
+#include <vesc_driver/vesc_device_uuid_lookup.hpp>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> candidatePorts()
+{
+  std::vector<std::string> ports;
+  glob_t result;
+  if (glob("/dev/ttyACM*", 0, nullptr, &result) == 0) {
+    for (size_t i = 0; i < result.gl_pathc; i++) {
+      ports.push_back(result.gl_pathv[i]);
+    }
+  }
+  globfree(&result);
+  return ports;
+}
+
+int main(int argc, char ** argv)
+{
+  int timeout_ms = vesc_driver::VescDeviceLookup::DEFAULT_TIMEOUT_MS;
+  std::string registry_path = vesc_driver::VescDeviceRegistry::DEFAULT_PATH;
+  std::vector<std::string> ports;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      timeout_ms = std::stoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--registry") == 0 && i + 1 < argc) {
+      registry_path = argv[++i];
+    } else {
+      ports.push_back(argv[i]);
+    }
+  }
+  if (ports.empty()) {
+    ports = candidatePorts();
+  }
+  if (ports.empty()) {
+    std::cerr << "No serial ports to probe" << std::endl;
+    return -1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<vesc_driver::VescDeviceInfo> devices =
+    vesc_driver::VescDeviceLookup::discover(ports, timeout_ms);
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - start).count();
+
+  // ports that did not answer no longer hold the VESC the registry remembers for them
+  std::vector<std::string> stale_ports;
+  for (const auto & port : ports) {
+    bool found = false;
+    for (const auto & device : devices) {
+      found |= (device.port == port);
+    }
+    if (!found) {
+      stale_ports.push_back(port);
+    }
+  }
+
+  for (const auto & device : devices) {
+    std::cout << device.uuid << " " << device.port << " " << device.hwname << " " <<
+      device.fw_major << "." << device.fw_minor << std::endl;
+  }
+  std::cerr << "Found " << devices.size() << " of " << ports.size() << " ports in " << elapsed <<
+    " ms" << std::endl;
+
+  vesc_driver::VescDeviceRegistry registry(registry_path);
+  if (!registry.update(devices, stale_ports)) {
+    std::cerr << "Unable to update " << registry_path << std::endl;
+    return -1;
+  }
+  return devices.empty() ? -1 : 0;
+}
@@ -14,8 +14,8 @@
 # limitations under the License.
 */
 
-#include <unistd.h>
 #include <stdlib.h>
+#include <vesc_driver/vesc_device_registry.hpp>
 #include <vesc_driver/vesc_device_uuid_lookup.hpp>
 #include <string>
 #include <iostream>
@@ -23,23 +23,34 @@
 int main(int argc, char ** argv)
 {
   std::string devicePort = (argc > 1 ? argv[1] : "ttyACM0");
-  std::string maxRetry_ = (argc > 2 ? argv[2] : "50");
+  // deadline for the vesc to reply, in milliseconds. The lookup returns as soon as it replies.
+  int timeout_ms = (argc > 2 ? std::stoi(argv[2]) :
+    vesc_driver::VescDeviceLookup::DEFAULT_TIMEOUT_MS);
   std::string VESC_UUID_ENV = "VESC_UUID_ENV=";
 
-  vesc_driver::VescDeviceLookup lookup("/dev/" + devicePort);
-  int maxRetry = stoi(maxRetry_);
-  for (int i = 0; i < maxRetry; i++) {
-    usleep(20);
-    if (lookup.isReady()) {break;}
-  }
+  vesc_driver::VescDeviceLookup lookup("/dev/" + devicePort, timeout_ms);
 
   if (lookup.isReady()) {
     VESC_UUID_ENV += lookup.deviceUUID();
 
     std::cout << lookup.deviceUUID() << std::endl;
     setenv("VESC_UUID_ENV", lookup.deviceUUID(), true);
+
+    // remember what was found, so the driver knows the device before it first talks to it
+    vesc_driver::VescDeviceInfo info;
+    info.port = "/dev/" + devicePort;
+    info.uuid = lookup.deviceUUID();
+    info.hwname = lookup.hwname();
+    info.fw_major = lookup.fwMajor();
+    info.fw_minor = lookup.fwMinor();
+    vesc_driver::VescDeviceRegistry registry;
+    if (!registry.update(info)) {
+      std::cerr << "Unable to update " << vesc_driver::VescDeviceRegistry::DEFAULT_PATH <<
+        std::endl;
+    }
     return 0;
   } else {
+    std::cerr << "VESC lookup on /dev/" << devicePort << " failed: " << lookup.error() << std::endl;
     return -1;
   }
 }
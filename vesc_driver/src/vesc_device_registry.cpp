@@ -0,0 +1,229 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_device_registry.hpp"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+
+namespace vesc_driver
+{
+
+const char * const VescDeviceRegistry::DEFAULT_PATH = "/run/vesc/devices";
+
+namespace
+{
+
+/**
+ * The registry decides which port and which cached configuration a driver uses, so it is only
+ * trusted if no one but root can have written it: a regular file owned by root, not writable by
+ * group or others, without other hard links.
+ */
+bool trustedFile(int fd)
+{
+  struct stat st;
+  return ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == 0 &&
+         (st.st_mode & (S_IWGRP | S_IWOTH)) == 0 && st.st_nlink == 1;
+}
+
+/** The directory of @p path must be a real directory owned by root and only writable by root */
+bool trustedDirectory(const std::string & path)
+{
+  size_t slash = path.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  struct stat st;
+  return ::lstat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == 0 &&
+         (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/** Create the directory of @p path for root if it does not exist yet, e.g. /run/vesc after boot */
+void createDirectory(const std::string & path)
+{
+  size_t slash = path.find_last_of('/');
+  if (slash != std::string::npos && slash > 0) {
+    ::mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+}
+
+/** Read a whole file from an open descriptor */
+std::string readAll(int fd)
+{
+  std::string contents;
+  char buffer[512];
+  ssize_t n;
+  while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, n);
+  }
+  return contents;
+}
+
+}  // namespace
+
+VescDeviceRegistry::VescDeviceRegistry(const std::string & path)
+: path_(path)
+{
+}
+
+std::string VescDeviceRegistry::canonicalPort(const std::string & port)
+{
+  char resolved[PATH_MAX];
+  if (::realpath(port.c_str(), resolved) == nullptr) {
+    return port;
+  }
+  return resolved;
+}
+
+bool VescDeviceRegistry::load()
+{
+  if (!trustedDirectory(path_)) {
+    return false;
+  }
+  int fd = ::open(path_.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  if (!trustedFile(fd)) {
+    ::close(fd);
+    return false;
+  }
+  ::flock(fd, LOCK_SH);
+  parse(readAll(fd));
+  ::close(fd);
+  return true;
+}
+
+bool VescDeviceRegistry::update(const VescDeviceInfo & info)
+{
+  return update(std::vector<VescDeviceInfo>{info});
+}
+
+bool VescDeviceRegistry::update(
+  const std::vector<VescDeviceInfo> & devices, const std::vector<std::string> & stale_ports)
+{
+  createDirectory(path_);
+  if (!trustedDirectory(path_)) {
+    return false;
+  }
+  int fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  // a file someone else planted is not updated, its entries would be kept
+  if (!trustedFile(fd)) {
+    ::close(fd);
+    return false;
+  }
+  // the lock is held across read, merge and write, so concurrent updates are not lost
+  ::flock(fd, LOCK_EX);
+  parse(readAll(fd));
+
+  for (const auto & port : stale_ports) {
+    devices_.erase(canonicalPort(port));
+  }
+  for (const auto & info : devices) {
+    VescDeviceInfo entry = info;
+    entry.port = canonicalPort(info.port);
+    devices_[entry.port] = entry;
+  }
+  index();
+
+  std::string contents = serialize();
+  bool ok = ::ftruncate(fd, 0) == 0 && ::lseek(fd, 0, SEEK_SET) == 0 &&
+    ::write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size());
+  // readable by the driver when written by udev as root
+  ::fchmod(fd, 0644);
+  ::close(fd);
+  return ok;
+}
+
+bool VescDeviceRegistry::findByPort(const std::string & port, VescDeviceInfo * info) const
+{
+  auto search = devices_.find(canonicalPort(port));
+  if (search == devices_.end()) {
+    return false;
+  }
+  *info = search->second;
+  return true;
+}
+
+bool VescDeviceRegistry::findByUuid(const std::string & uuid, VescDeviceInfo * info) const
+{
+  auto search = ports_by_uuid_.find(uuid);
+  if (search == ports_by_uuid_.end()) {
+    return false;
+  }
+  *info = devices_.at(search->second);
+  return true;
+}
+
+void VescDeviceRegistry::index()
+{
+  ports_by_uuid_.clear();
+  for (const auto & device : devices_) {
+    ports_by_uuid_[device.second.uuid] = device.first;
+  }
+}
+
+void VescDeviceRegistry::parse(const std::string & contents)
+{
+  devices_.clear();
+  std::istringstream lines(contents);
+  std::string line;
+  while (std::getline(lines, line)) {
+    // <port> <uuid> <fw_major> <fw_minor> <hwname>, the hardware name may contain spaces
+    std::istringstream fields(line);
+    VescDeviceInfo info;
+    if (fields >> info.port >> info.uuid >> info.fw_major >> info.fw_minor) {
+      std::getline(fields >> std::ws, info.hwname);
+      devices_[info.port] = info;
+    }
+  }
+  index();
+}
+
+std::string VescDeviceRegistry::serialize() const
+{
+  std::ostringstream ss;
+  for (const auto & device : devices_) {
+    const VescDeviceInfo & info = device.second;
+    ss << info.port << " " << info.uuid << " " << info.fw_major << " " << info.fw_minor << " " <<
+      info.hwname << "\n";
+  }
+  return ss.str();
+}
+
+}  // namespace vesc_driver
@@ -13,63 +13,224 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 */
-#include <cassert>
-#include <cmath>
-#include <sstream>
-#include <iostream>
-#include <iomanip>
-#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "vesc_driver/vesc_device_uuid_lookup.hpp"
+#include "vesc_driver/vesc_packet_factory.hpp"
 
 
 namespace vesc_driver
 {
-using std::placeholders::_1;
 
-VescDeviceLookup::VescDeviceLookup(std::string name)
-: vesc_(
-    std::string(),
-    std::bind(&VescDeviceLookup::vescPacketCallback, this, _1),
-    std::bind(&VescDeviceLookup::vescErrorCallback, this, _1)
-),
+VescDeviceLookup::VescDeviceLookup(std::string name, int timeout_ms)
+: device_(name),
+  fw_major_(-1),
+  fw_minor_(-1),
   ready_(false),
-  device_(name)
+  fd_(-1)
 {
-  try {
-    vesc_.connect(device_);
-    vesc_.requestFWVersion();
-  } catch (SerialException e) {
-    std::cerr << "VESC error on port " << device_ << std::endl << e.what() << std::endl;
+  if (!open() || !sendRequest()) {
+    close();
     return;
   }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (!ready_) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+      error_ = "Timed out waiting for the firmware version reply";
+      break;
+    }
+
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    int ret = ::poll(&pfd, 1, static_cast<int>(remaining));
+    if (ret < 0 && errno != EINTR) {
+      error_ = std::string("poll failed: ") + std::strerror(errno);
+      break;
+    }
+    if (ret > 0 && !readReply()) {
+      break;
+    }
+  }
+  close();
 }
 
-void VescDeviceLookup::close()
+VescDeviceLookup::VescDeviceLookup(std::string name, Deferred)
+: device_(name),
+  fw_major_(-1),
+  fw_minor_(-1),
+  ready_(false),
+  fd_(-1)
 {
-  vesc_.disconnect();
+  if (!open() || !sendRequest()) {
+    close();
+  }
 }
 
-void VescDeviceLookup::vescPacketCallback(const std::shared_ptr<VescPacket const> & packet)
+std::vector<VescDeviceInfo> VescDeviceLookup::discover(
+  const std::vector<std::string> & ports, int timeout_ms)
 {
-  if (packet->name() == "FWVersion") {
-    std::shared_ptr<VescPacketFWVersion const> fw_version =
-      std::dynamic_pointer_cast<VescPacketFWVersion const>(packet);
+  // send every request before waiting for any reply, the devices answer in parallel
+  std::vector<std::unique_ptr<VescDeviceLookup>> lookups;
+  for (const auto & port : ports) {
+    lookups.emplace_back(new VescDeviceLookup(port, Deferred()));
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (true) {
+    std::vector<struct pollfd> pfds;
+    std::vector<VescDeviceLookup *> pending;
+    for (auto & lookup : lookups) {
+      if (lookup->fd_ >= 0 && !lookup->ready_) {
+        pfds.push_back({lookup->fd_, POLLIN, 0});
+        pending.push_back(lookup.get());
+      }
+    }
 
-    const uint8_t * uuid = fw_version->uuid();
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now()).count();
+    if (pending.empty() || remaining <= 0) {
+      break;
+    }
 
-    hwname_ = fw_version->hwname();
-    version_ = fw_version->fwMajor() + "." + fw_version->fwMinor();
-    uuid_ += decode_uuid(uuid);
-    ready_ = true;
+    int ret = ::poll(pfds.data(), pfds.size(), static_cast<int>(remaining));
+    if (ret < 0 && errno != EINTR) {
+      break;
+    }
+    for (size_t i = 0; ret > 0 && i < pfds.size(); i++) {
+      if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        pending[i]->close();
+      } else if ((pfds[i].revents & POLLIN) && (!pending[i]->readReply() || pending[i]->ready_)) {
+        pending[i]->close();
+      }
+    }
   }
+
+  std::vector<VescDeviceInfo> devices;
+  for (auto & lookup : lookups) {
+    lookup->close();
+    if (lookup->ready_) {
+      VescDeviceInfo info;
+      info.port = lookup->device_;
+      info.uuid = lookup->uuid_;
+      info.hwname = lookup->hwname_;
+      info.fw_major = lookup->fw_major_;
+      info.fw_minor = lookup->fw_minor_;
+      devices.push_back(info);
+    }
+  }
+  return devices;
 }
 
-void VescDeviceLookup::vescErrorCallback(const std::string & error)
+VescDeviceLookup::~VescDeviceLookup()
 {
-  error_ = error;
-  ready_ = false;
+  close();
+}
+
+bool VescDeviceLookup::open()
+{
+  fd_ = ::open(device_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd_ < 0) {
+    error_ = "Unable to open " + device_ + ": " + std::strerror(errno);
+    return false;
+  }
+
+  // raw 8N1 at 115200 with hardware flow control, the same settings VescInterface uses
+  struct termios tty;
+  if (::tcgetattr(fd_, &tty) != 0) {
+    error_ = std::string("tcgetattr failed: ") + std::strerror(errno);
+    return false;
+  }
+  ::cfmakeraw(&tty);
+  ::cfsetspeed(&tty, B115200);
+  tty.c_cflag |= CLOCAL | CREAD | CRTSCTS;
+  if (::tcsetattr(fd_, TCSANOW, &tty) != 0) {
+    error_ = std::string("tcsetattr failed: ") + std::strerror(errno);
+    return false;
+  }
+
+  // drop anything the device sent before we asked
+  ::tcflush(fd_, TCIOFLUSH);
+  return true;
+}
+
+bool VescDeviceLookup::sendRequest()
+{
+  VescPacketRequestFWVersion request;
+  const Buffer & frame = request.frame();
+  ssize_t written = ::write(fd_, frame.data(), frame.size());
+  if (written != static_cast<ssize_t>(frame.size())) {
+    error_ = "Unable to write the firmware version request to " + device_;
+    return false;
+  }
+  return true;
+}
+
+/** Read what is available and try to parse the reply. Returns false on a read error. */
+bool VescDeviceLookup::readReply()
+{
+  uint8_t data[512];
+  ssize_t n = ::read(fd_, data, sizeof(data));
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR) {
+      return true;
+    }
+    error_ = std::string("read failed: ") + std::strerror(errno);
+    return false;
+  }
+  buffer_.insert(buffer_.end(), data, data + n);
+
+  // look for a complete frame, skipping anything that is not one
+  auto iter = buffer_.cbegin();
+  while (iter != buffer_.cend()) {
+    if (VescFrame::VESC_SOF_VAL_SMALL_FRAME == *iter ||
+      VescFrame::VESC_SOF_VAL_LARGE_FRAME == *iter)
+    {
+      int bytes_needed = 0;
+      VescPacketConstPtr packet =
+        VescPacketFactory::createPacket(iter, buffer_.cend(), &bytes_needed, nullptr);
+      if (packet) {
+        if (packet->name() == "FWVersion") {
+          std::shared_ptr<VescPacketFWVersion const> fw_version =
+            std::dynamic_pointer_cast<VescPacketFWVersion const>(packet);
+          hwname_ = fw_version->hwname();
+          fw_major_ = fw_version->fwMajor();
+          fw_minor_ = fw_version->fwMinor();
+          version_ = std::to_string(fw_major_) + "." + std::to_string(fw_minor_);
+          uuid_ = fw_version->uuidString();
+          ready_ = true;
+          return true;
+        }
+        iter += packet->frame().size();
+        continue;
+      } else if (bytes_needed > 0) {
+        // incomplete frame, wait for more data
+        break;
+      }
+    }
+    iter++;
+  }
+  buffer_.erase(buffer_.cbegin(), iter);
+  return true;
+}
+
+void VescDeviceLookup::close()
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
 }
 
 bool VescDeviceLookup::isReady()
@@ -93,4 +254,19 @@ const char * VescDeviceLookup::hwname() const
   return hwname_.c_str();
 }
 
+int VescDeviceLookup::fwMajor() const
+{
+  return fw_major_;
+}
+
+int VescDeviceLookup::fwMinor() const
+{
+  return fw_minor_;
+}
+
+const char * VescDeviceLookup::error() const
+{
+  return error_.c_str();
+}
+
 }  // namespace vesc_driver
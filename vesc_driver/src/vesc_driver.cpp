@@ -29,16 +29,20 @@
 // -*- mode:c++; fill-column: 100; -*-
 
 #include "vesc_driver/vesc_driver.hpp"
+#include "vesc_driver/vesc_device_registry.hpp"
 
 #include <vesc_msgs/msg/vesc_state.hpp>
 #include <vesc_msgs/msg/vesc_state_stamped.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace vesc_driver
 {
@@ -49,8 +53,158 @@ using std_msgs::msg::Float64;
 using vesc_msgs::msg::VescStateStamped;
 using sensor_msgs::msg::Imu;
 
+namespace
+{
+
+// the vesc's terminal output has no end marker, it is complete once no line arrived for this long
+const std::chrono::milliseconds TERMINAL_QUIET_PERIOD(100);
+// longest wait for the fault log requested after a fault
+const std::chrono::milliseconds FAULT_LOG_TIMEOUT(1000);
+
+/** Build the IMU request mask from the field group names given in the imu_fields parameter */
+uint16_t imuMaskFromFields(const std::vector<std::string> & fields, const rclcpp::Logger & logger)
+{
+  uint16_t mask = 0;
+  for (const auto & field : fields) {
+    if (field == "rpy") {
+      mask |= VescPacketImu::IMU_MASK_RPY;
+    } else if (field == "acc") {
+      mask |= VescPacketImu::IMU_MASK_ACC;
+    } else if (field == "gyro") {
+      mask |= VescPacketImu::IMU_MASK_GYRO;
+    } else if (field == "mag") {
+      mask |= VescPacketImu::IMU_MASK_MAG;
+    } else if (field == "quaternion") {
+      mask |= VescPacketImu::IMU_MASK_QUATERNION;
+    } else {
+      RCLCPP_WARN(
+        logger, "Unknown imu_fields entry '%s', expected one of rpy, acc, gyro, mag, quaternion.",
+        field.c_str());
+    }
+  }
+  return mask;
+}
+
+/** Build the serial link settings from the baud_rate, flow_control, parity and stop_bits params */
+VescSerialConfig serialConfigFromParams(
+  int baud_rate, const std::string & flow_control, const std::string & parity,
+  const std::string & stop_bits, const rclcpp::Logger & logger)
+{
+  VescSerialConfig config;
+  if (baud_rate > 0) {
+    config.baud_rate = static_cast<uint32_t>(baud_rate);
+  } else {
+    RCLCPP_WARN(logger, "Invalid baud_rate %d, using %u.", baud_rate, config.baud_rate);
+  }
+
+  if (flow_control == "none") {
+    config.flow_control = VescSerialConfig::FlowControl::NONE;
+  } else if (flow_control == "hardware") {
+    config.flow_control = VescSerialConfig::FlowControl::HARDWARE;
+  } else if (flow_control == "software") {
+    config.flow_control = VescSerialConfig::FlowControl::SOFTWARE;
+  } else {
+    RCLCPP_WARN(
+      logger, "Unknown flow_control '%s', expected none, hardware or software.",
+      flow_control.c_str());
+  }
+
+  if (parity == "none") {
+    config.parity = VescSerialConfig::Parity::NONE;
+  } else if (parity == "odd") {
+    config.parity = VescSerialConfig::Parity::ODD;
+  } else if (parity == "even") {
+    config.parity = VescSerialConfig::Parity::EVEN;
+  } else {
+    RCLCPP_WARN(logger, "Unknown parity '%s', expected none, odd or even.", parity.c_str());
+  }
+
+  if (stop_bits == "1") {
+    config.stop_bits = VescSerialConfig::StopBits::ONE;
+  } else if (stop_bits == "1.5") {
+    config.stop_bits = VescSerialConfig::StopBits::ONE_POINT_FIVE;
+  } else if (stop_bits == "2") {
+    config.stop_bits = VescSerialConfig::StopBits::TWO;
+  } else {
+    RCLCPP_WARN(logger, "Unknown stop_bits '%s', expected 1, 1.5 or 2.", stop_bits.c_str());
+  }
+  return config;
+}
+
+/**
+ * Bytes the vesc sends back per polling cycle: the COMM_GET_VALUES reply plus the IMU reply with
+ * the fields in @p imu_mask. Replies are small frames, the payload plus 5 bytes of framing.
+ */
+size_t replyBytesPerPoll(uint16_t imu_mask)
+{
+  const size_t VALUES_PAYLOAD_SIZE = 73;   // command id and the FW5 telemetry fields
+  const size_t FRAMING_SIZE = 5;           // start, length, crc and end bytes
+  size_t bytes = VALUES_PAYLOAD_SIZE + FRAMING_SIZE;
+  if (imu_mask != 0) {
+    // command id, 16 bit mask and a float32_auto for every field
+    bytes += 3 + 4 * __builtin_popcount(imu_mask) + FRAMING_SIZE;
+  }
+  return bytes;
+}
+
+/** Map the rotor_position_mode param to a disp_pos_mode */
+uint8_t rotorPositionModeFromParam(const std::string & mode, const rclcpp::Logger & logger)
+{
+  if (mode == "none") {
+    return DISP_POS_MODE_NONE;
+  } else if (mode == "inductance") {
+    return DISP_POS_MODE_INDUCTANCE;
+  } else if (mode == "observer") {
+    return DISP_POS_MODE_OBSERVER;
+  } else if (mode == "encoder") {
+    return DISP_POS_MODE_ENCODER;
+  } else if (mode == "pid_pos") {
+    return DISP_POS_MODE_PID_POS;
+  } else if (mode == "pid_pos_error") {
+    return DISP_POS_MODE_PID_POS_ERROR;
+  } else if (mode == "encoder_observer_error") {
+    return DISP_POS_MODE_ENCODER_OBSERVER_ERROR;
+  }
+  RCLCPP_WARN(
+    logger, "Unknown rotor_position_mode '%s', expected one of none, inductance, observer, "
+    "encoder, pid_pos, pid_pos_error, encoder_observer_error.", mode.c_str());
+  return DISP_POS_MODE_NONE;
+}
+
+/** Apply @p fn to each of the per-sample arrays of @p capture */
+template<typename Fn>
+void forEachCaptureArray(VescSampleCapture * capture, Fn fn)
+{
+  fn(capture->current0);
+  fn(capture->current1);
+  fn(capture->voltage_ph1);
+  fn(capture->voltage_ph2);
+  fn(capture->voltage_ph3);
+  fn(capture->voltage_zero);
+  fn(capture->current_fir);
+  fn(capture->f_sw);
+  fn(capture->status);
+  fn(capture->phase);
+}
+
+/** Default location of the configuration cache, $ROS_HOME/vesc_driver or ~/.ros/vesc_driver */
+std::string defaultConfigCacheDir()
+{
+  const char * ros_home = std::getenv("ROS_HOME");
+  if (ros_home != nullptr && *ros_home != '\0') {
+    return std::string(ros_home) + "/vesc_driver";
+  }
+  const char * home = std::getenv("HOME");
+  if (home != nullptr && *home != '\0') {
+    return std::string(home) + "/.ros/vesc_driver";
+  }
+  return std::string();
+}
+
+}  // namespace
+
 VescDriver::VescDriver(const rclcpp::NodeOptions & options)
-: rclcpp::Node("vesc_driver", options),
+: rclcpp_lifecycle::LifecycleNode("vesc_driver", options),
   vesc_(
     std::string(),
     std::bind(&VescDriver::vescPacketCallback, this, _1),
@@ -61,20 +215,252 @@ VescDriver::VescDriver(const rclcpp::NodeOptions & options)
   speed_limit_(this, "speed"),
   position_limit_(this, "position"),
   servo_limit_(this, "servo", 0.0, 1.0),
+  mcconf_live_(false),
+  reactor_timer_(-1),
   driver_mode_(MODE_INITIALIZING),
-  fw_version_major_(-1),
-  fw_version_minor_(-1)
+  active_(false),
+  autostart_(true),
+  shutdown_on_failure_(false),
+  imu_mask_(0),
+  rotor_position_mode_(DISP_POS_MODE_NONE),
+  poll_rate_(50.0),
+  low_latency_(false),
+  config_requested_(false),
+  mcconf_(),
+  mcconf_valid_(false),
+  appconf_(),
+  appconf_valid_(false),
+  startup_time_(std::chrono::steady_clock::now()),
+  device_cached_(false),
+  first_command_sent_(false),
+  link_lost_(false),
+  capture_max_(0),
+  capture_len_(0),
+  capture_received_(0),
+  capture_active_(false),
+  print_collecting_(false),
+  last_fault_code_(-1),
+  fault_log_pending_(false),
+  diag_fault_code_(-1),
+  diag_temp_fet_(std::nan("")),
+  diag_temp_motor_(std::nan("")),
+  diag_v_in_(std::nan("")),
+  diag_temp_fet_start_(std::nan("")),
+  diag_temp_motor_start_(std::nan("")),
+  diag_values_count_(0),
+  diag_last_values_count_(0),
+  diag_last_update_(std::chrono::steady_clock::now())
 {
   // get vesc serial port address
-  std::string port = declare_parameter<std::string>("port", "");
+  port_ = declare_parameter<std::string>("port", "");
+
+  // uuid of the vesc, used to find its port in the device registry when no port is given
+  uuid_ = declare_parameter<std::string>("uuid", "");
+
+  // device registry written by vesc_device_namer and vesc_device_discovery, empty disables the
+  // lookup
+  device_registry_ =
+    declare_parameter<std::string>("device_registry", VescDeviceRegistry::DEFAULT_PATH);
+
+  // IMU field groups to request, anything not requested is not sent by the vesc and reads as zero
+  imu_mask_ = imuMaskFromFields(
+    declare_parameter<std::vector<std::string>>(
+      "imu_fields", std::vector<std::string>{"rpy", "acc", "gyro", "mag", "quaternion"}),
+    get_logger());
+
+  // directory the vesc configuration is cached in, keyed by uuid and firmware version. Remove the
+  // cached files after changing the configuration with VESC Tool. Empty disables the cache.
+  std::string config_cache_dir =
+    declare_parameter<std::string>("config_cache_dir", defaultConfigCacheDir());
+  if (!config_cache_dir.empty()) {
+    config_cache_ = std::make_unique<VescConfigCache>(config_cache_dir);
+  }
+
+  // configuration layouts to decode, as MCCONF_SIGNATURE / APPCONF_SIGNATURE of the firmware's
+  // confgenerator.h. A configuration with another signature is neither applied nor cached; the
+  // signature is logged, add it here once its layout is checked against vesc_config.cpp. An
+  // empty list does not fetch that configuration at all.
+  for (int64_t signature :
+    declare_parameter<std::vector<int64_t>>(
+      "mcconf_signatures",
+      std::vector<int64_t>(KNOWN_MCCONF_SIGNATURES.begin(), KNOWN_MCCONF_SIGNATURES.end())))
+  {
+    mcconf_signatures_.push_back(static_cast<uint32_t>(signature));
+  }
+  for (int64_t signature :
+    declare_parameter<std::vector<int64_t>>(
+      "appconf_signatures",
+      std::vector<int64_t>(KNOWN_APPCONF_SIGNATURES.begin(), KNOWN_APPCONF_SIGNATURES.end())))
+  {
+    appconf_signatures_.push_back(static_cast<uint32_t>(signature));
+  }
+
+  // serial link settings, only relevant for a UART link. USB (ttyACM) ignores them.
+  serial_config_ = serialConfigFromParams(
+    declare_parameter<int>("baud_rate", 115200),
+    declare_parameter<std::string>("flow_control", "hardware"),
+    declare_parameter<std::string>("parity", "none"),
+    declare_parameter<std::string>("stop_bits", "1"),
+    get_logger());
+
+  // telemetry polling rate, Hz
+  poll_rate_ = declare_parameter<double>("poll_rate", 50.0);
+  if (poll_rate_ <= 0.0) {
+    RCLCPP_WARN(get_logger(), "Invalid poll_rate %.1f Hz, using 50 Hz.", poll_rate_);
+    poll_rate_ = 50.0;
+  }
+
+  // shorten the time received bytes wait in the tty and the USB adapter, see setLowLatency()
+  low_latency_ = declare_parameter<bool>("low_latency", false);
+
+  // current limits enforced by the vesc itself, e.g. to switch power modes at runtime
+  std::string limits_error;
+  current_limits_ = VescCurrentLimits::declare(*get_node_parameters_interface(), &limits_error);
+  if (!limits_error.empty()) {
+    RCLCPP_WARN(get_logger(), "Not pushing current limits, %s.", limits_error.c_str());
+  }
+  current_limits_callback_ = add_on_set_parameters_callback(
+    std::bind(&VescDriver::currentLimitsCallback, this, _1));
+
+  // service the serial port, the telemetry polling and the handshake retries from one I/O thread
+  // instead of a receive thread, an asio context and the executor's timer. Received packets, timer
+  // ticks and the writes to the port are then handled strictly in order on that thread; commands
+  // from the executor's callbacks are queued for it rather than written from the executor. All
+  // drivers composed into one process share the thread, and their polls are spread evenly over
+  // the poll period.
+  if (declare_parameter<bool>("single_io_thread", false)) {
+    reactor_ = VescReactor::shared();
+    vesc_.setReactor(reactor_);
+  }
+
+  rotor_position_mode_ = rotorPositionModeFromParam(
+    declare_parameter<std::string>("rotor_position_mode", "none"), get_logger());
+
+  // sample capture (COMM_SAMPLE_PRINT). The arrays are sized for the largest capture here so the
+  // samples streaming in at a high rate are written in place without allocating.
+  capture_max_ = static_cast<size_t>(
+    std::max<int64_t>(1, declare_parameter<int64_t>("sample_capture_max", 1000)));
+  forEachCaptureArray(&capture_, [this](auto & array) {array.reserve(capture_max_);});
+
+  // diagnostics on /diagnostics, for the diagnostic aggregator. The rate is set with the updater's
+  // own diagnostic_updater.period parameter, 1 s by default; the tasks only read counters and the
+  // last state sample, nothing is requested from the vesc for them.
+  updater_ = std::make_unique<diagnostic_updater::Updater>(this);
+  updater_->setHardwareID(uuid_.empty() ? port_ : uuid_);
+  updater_->add("VESC link", this, &VescDriver::linkDiagnostics);
+  updater_->add("VESC controller", this, &VescDriver::controllerDiagnostics);
+
+  // without a lifecycle manager, configure and activate right away like a plain node
+  autostart_ = declare_parameter<bool>("autostart", true);
+  shutdown_on_failure_ = declare_parameter<bool>("shutdown_on_failure", false);
+  if (autostart_) {
+    if (configure().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE ||
+      activate().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+    {
+      // a failed transition already left the node in its previous state
+      RCLCPP_ERROR(get_logger(), "Failed to start the VESC driver.");
+      fail();
+    }
+  }
+}
+
+VescDriver::~VescDriver()
+{
+  // a reactor timer would otherwise keep calling into the destroyed node
+  stopTimer();
+}
+
+/**
+ * Open the serial port and start the handshake. The firmware version and the configuration are
+ * fetched here, so that activating the driver later only has to start the telemetry.
+ */
+VescDriver::CallbackReturn VescDriver::on_configure(const rclcpp_lifecycle::State &)
+{
+  startup_time_ = std::chrono::steady_clock::now();
+  driver_mode_ = MODE_INITIALIZING;
+  link_lost_ = false;
+  {
+    std::lock_guard<std::mutex> lock(device_mutex_);
+    device_ = DeviceIdentity();
+  }
+  config_requested_ = false;
+  mcconf_valid_ = false;
+  appconf_valid_ = false;
+  device_cached_ = false;
+  {
+    std::lock_guard<std::mutex> lock(current_limits_mutex_);
+    mcconf_live_ = false;
+  }
+  last_fault_code_ = -1;
+  // another device may be on the port now, its limits are applied once its configuration is known
+  duty_cycle_limit_.reset();
+  current_limit_.reset();
+  brake_limit_.reset();
+  speed_limit_.reset();
+
+  std::string port = port_;
+  VescDeviceInfo device_info;
+  if (!device_registry_.empty()) {
+    VescDeviceRegistry registry(device_registry_);
+    bool loaded = registry.load();
+    if (port.empty() && !uuid_.empty()) {
+      if (loaded && registry.findByUuid(uuid_, &device_info)) {
+        port = device_info.port;
+        device_cached_ = true;
+        RCLCPP_INFO(get_logger(), "VESC %s found on %s.", uuid_.c_str(), port.c_str());
+      } else {
+        RCLCPP_ERROR(
+          get_logger(), "VESC %s is not in %s, run vesc_device_discovery.", uuid_.c_str(),
+          device_registry_.c_str());
+        return CallbackReturn::FAILURE;
+      }
+    } else {
+      device_cached_ = loaded && registry.findByPort(port, &device_info);
+    }
+  }
+
+  // a UART can only carry baud / bits-per-byte bytes a second, more polling than that only queues
+  // up stale replies. USB-CDC is not limited by the baud rate.
+  if (VescDeviceRegistry::canonicalPort(port).find("ttyACM") == std::string::npos) {
+    double load = poll_rate_ * replyBytesPerPoll(imu_mask_);
+    double capacity = serial_config_.bytesPerSecond();
+    if (load > capacity) {
+      RCLCPP_WARN(
+        get_logger(), "Polling at %.1f Hz needs %.0f B/s but %u baud carries %.0f B/s, the "
+        "telemetry will lag. Raise baud_rate, lower poll_rate or request fewer imu_fields.",
+        poll_rate_, load, serial_config_.baud_rate, capacity);
+    } else {
+      RCLCPP_INFO(
+        get_logger(), "Polling uses %.0f of %.0f B/s (%.0f%%) of the serial link.", load, capacity,
+        100.0 * load / capacity);
+    }
+  }
 
   // attempt to connect to the serial port
   try {
-    vesc_.connect(port);
+    vesc_.connect(port, serial_config_);
   } catch (SerialException e) {
-    RCLCPP_FATAL(get_logger(), "Failed to connect to the VESC, %s.", e.what());
-    rclcpp::shutdown();
-    return;
+    RCLCPP_ERROR(get_logger(), "Failed to connect to the VESC, %s.", e.what());
+    return CallbackReturn::FAILURE;
+  }
+  updater_->setHardwareID(uuid_.empty() ? port : uuid_);
+
+  // the probes go out before the handshake, nothing else is waiting for a firmware version yet
+  if (low_latency_) {
+    double before = vesc_.measureRoundTrip();
+    std::string error;
+    if (!vesc_.setLowLatency(&error)) {
+      RCLCPP_WARN(get_logger(), "Low latency mode is incomplete, %s.", error.c_str());
+    }
+    double after = vesc_.measureRoundTrip();
+    if (before < 0.0 || after < 0.0) {
+      RCLCPP_WARN(
+        get_logger(), "Low latency mode set, the VESC did not answer the round trip probe.");
+    } else {
+      RCLCPP_INFO(
+        get_logger(), "Low latency mode set, request to reply round trip %.2f ms, was %.2f ms.",
+        after * 1e3, before * 1e3);
+    }
   }
 
   // create vesc state (telemetry) publisher
@@ -87,7 +473,32 @@ VescDriver::VescDriver(const rclcpp::NodeOptions & options)
   servo_sensor_pub_ = create_publisher<Float64>(
     "sensors/servo_position_command", rclcpp::QoS{10});
 
-  // subscribe to motor and servo command topics
+  // fault events. Latched, so a late subscriber sees the current fault state right away.
+  fault_pub_ = create_publisher<VescFault>("sensors/fault", rclcpp::QoS{1}.transient_local());
+  fault_log_pub_ =
+    create_publisher<VescFault>("sensors/fault_log", rclcpp::QoS{1}.transient_local());
+
+  // rotor position stream. The vesc pushes the selected position at its own rate, each packet is
+  // published from the receive thread as it arrives, stamped with the arrival time.
+  if (rotor_position_mode_ != DISP_POS_MODE_NONE) {
+    rotor_position_pub_ =
+      create_publisher<VescRotorPosition>("sensors/rotor_position", rclcpp::SensorDataQoS());
+  }
+
+  sample_pub_ = create_publisher<VescSampleCapture>("sensors/samples", rclcpp::QoS{1});
+  sample_srv_ = create_service<VescSampleTrigger>(
+    "sample_capture", std::bind(
+      &VescDriver::sampleTriggerCallback, this, std::placeholders::_1, std::placeholders::_2));
+
+  // terminal commands wait for the vesc's output, so they are served in their own callback group.
+  // With a multi-threaded executor the timer and the command subscriptions keep running meanwhile.
+  terminal_group_ = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  terminal_srv_ = create_service<VescTerminal>(
+    "terminal", std::bind(
+      &VescDriver::terminalCallback, this, std::placeholders::_1, std::placeholders::_2),
+    rmw_qos_profile_services_default, terminal_group_);
+
+  // subscribe to motor and servo command topics, commands are ignored until the driver is active
   duty_cycle_sub_ = create_subscription<Float64>(
     "commands/motor/duty_cycle", rclcpp::QoS{10}, std::bind(
       &VescDriver::dutyCycleCallback, this,
@@ -103,8 +514,195 @@ VescDriver::VescDriver(const rclcpp::NodeOptions & options)
   servo_sub_ = create_subscription<Float64>(
     "commands/servo/position", rclcpp::QoS{10}, std::bind(&VescDriver::servoCallback, this, _1));
 
-  // create a 50Hz timer, used for state machine & polling VESC telemetry
-  timer_ = create_wall_timer(20ms, std::bind(&VescDriver::timerCallback, this));
+  // create a timer at the poll rate, used for state machine & polling VESC telemetry. It keeps
+  // retrying the handshake while inactive, the telemetry is only polled while active.
+  startTimer();
+
+  // Pipeline the startup handshake: the firmware version and configuration requests go out
+  // back-to-back rather than one per timer tick. If the namer already identified the device, its
+  // configuration can be taken from the cache before the vesc even replies.
+  if (device_cached_) {
+    {
+      std::lock_guard<std::mutex> lock(device_mutex_);
+      device_.uuid = device_info.uuid;
+      device_.fw_major = device_info.fw_major;
+      device_.fw_minor = device_info.fw_minor;
+    }
+    config_requested_ = true;
+    fetchConfiguration();
+  }
+  vesc_.requestFWVersion();
+  return CallbackReturn::SUCCESS;
+}
+
+/** Start the telemetry, the port is already open and the vesc identified */
+VescDriver::CallbackReturn VescDriver::on_activate(const rclcpp_lifecycle::State &)
+{
+  state_pub_->on_activate();
+  imu_pub_->on_activate();
+  imu_std_pub_->on_activate();
+  servo_sensor_pub_->on_activate();
+  fault_pub_->on_activate();
+  fault_log_pub_->on_activate();
+  sample_pub_->on_activate();
+  if (rotor_position_pub_) {
+    rotor_position_pub_->on_activate();
+  }
+  active_ = true;
+
+  // request the first samples now rather than on the next timer tick
+  if (rotor_position_mode_ != DISP_POS_MODE_NONE) {
+    vesc_.setRotorPositionMode(rotor_position_mode_);
+  }
+  vesc_.requestState();
+  if (imu_mask_ != 0) {
+    vesc_.requestImuData(imu_mask_);
+  }
+  RCLCPP_INFO(get_logger(), "VESC driver active %.1f ms after startup", millisecondsSinceStartup());
+  return CallbackReturn::SUCCESS;
+}
+
+/** Stop the motor and the telemetry, the port stays open so activating again is immediate */
+VescDriver::CallbackReturn VescDriver::on_deactivate(const rclcpp_lifecycle::State &)
+{
+  stopMotor();
+  if (rotor_position_mode_ != DISP_POS_MODE_NONE) {
+    vesc_.setRotorPositionMode(DISP_POS_MODE_NONE);
+  }
+
+  state_pub_->on_deactivate();
+  imu_pub_->on_deactivate();
+  imu_std_pub_->on_deactivate();
+  servo_sensor_pub_->on_deactivate();
+  fault_pub_->on_deactivate();
+  fault_log_pub_->on_deactivate();
+  sample_pub_->on_deactivate();
+  if (rotor_position_pub_) {
+    rotor_position_pub_->on_deactivate();
+  }
+  // deactivated because the port closed, continue in on_error()
+  return link_lost_ ? CallbackReturn::ERROR : CallbackReturn::SUCCESS;
+}
+
+/** Close the port and drop the ROS interfaces created by on_configure */
+VescDriver::CallbackReturn VescDriver::on_cleanup(const rclcpp_lifecycle::State &)
+{
+  if (link_lost_) {
+    return CallbackReturn::ERROR;
+  }
+  releaseInterfaces();
+  return CallbackReturn::SUCCESS;
+}
+
+/**
+ * The port closed, or a transition failed with an error. Release what on_configure set up, so the
+ * node is unconfigured afterwards and can be configured again once the vesc is back.
+ */
+VescDriver::CallbackReturn VescDriver::on_error(const rclcpp_lifecycle::State & state)
+{
+  RCLCPP_ERROR(
+    get_logger(), "VESC driver error in state %s, releasing the port.", state.label().c_str());
+  if (active_) {
+    stopMotor();
+  }
+  releaseInterfaces();
+  link_lost_ = false;
+  return CallbackReturn::SUCCESS;
+}
+
+/** What on_cleanup and on_error share, safe to call with the port already closed */
+void VescDriver::releaseInterfaces()
+{
+  stopTimer();
+  vesc_.disconnect();
+
+  duty_cycle_sub_.reset();
+  current_sub_.reset();
+  brake_sub_.reset();
+  speed_sub_.reset();
+  position_sub_.reset();
+  servo_sub_.reset();
+  sample_srv_.reset();
+  terminal_srv_.reset();
+  state_pub_.reset();
+  imu_pub_.reset();
+  imu_std_pub_.reset();
+  servo_sensor_pub_.reset();
+  fault_pub_.reset();
+  fault_log_pub_.reset();
+  sample_pub_.reset();
+  rotor_position_pub_.reset();
+  driver_mode_ = MODE_INITIALIZING;
+}
+
+VescDriver::CallbackReturn VescDriver::on_shutdown(const rclcpp_lifecycle::State & state)
+{
+  if (active_) {
+    stopMotor();
+  }
+  if (state.id() != lifecycle_msgs::msg::State::PRIMARY_STATE_UNCONFIGURED) {
+    stopTimer();
+    vesc_.disconnect();
+  }
+  return CallbackReturn::SUCCESS;
+}
+
+/** Release the motor, zero current lets it coast */
+void VescDriver::stopMotor()
+{
+  active_ = false;
+  if (vesc_.isConnected() && driver_mode_ == MODE_OPERATING) {
+    vesc_.setCurrent(0.0);
+  }
+}
+
+double VescDriver::millisecondsSinceStartup() const
+{
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - startup_time_).count();
+}
+
+/** Called from the packet thread once the vesc has replied, ready to accept commands */
+void VescDriver::enterOperating()
+{
+  driver_mode_t expected = MODE_INITIALIZING;
+  if (driver_mode_.compare_exchange_strong(expected, MODE_OPERATING)) {
+    DeviceIdentity device = this->device();
+    RCLCPP_INFO(
+      get_logger(),
+      "Connected to VESC with firmware version %d.%d, operating %.1f ms after startup",
+      device.fw_major, device.fw_minor, millisecondsSinceStartup());
+    // the device is confirmed now, the current limits may have been waiting for it
+    std::lock_guard<std::mutex> lock(current_limits_mutex_);
+    sendCurrentLimits();
+  }
+}
+
+void VescDriver::commandSent()
+{
+  if (!first_command_sent_.exchange(true)) {
+    RCLCPP_INFO(
+      get_logger(), "First command sent to VESC %.1f ms after startup", millisecondsSinceStartup());
+  }
+}
+
+/**
+ * Give up after a failure. The standalone executable exits when nothing else manages the node,
+ * while a composed node is left to its lifecycle manager so the rest of the container keeps
+ * running.
+ */
+void VescDriver::fail()
+{
+  if (autostart_ && shutdown_on_failure_) {
+    RCLCPP_FATAL(get_logger(), "Shutting down.");
+    rclcpp::shutdown();
+  }
+}
+
+/** Motor commands are passed on once the vesc replied and while the driver is active */
+bool VescDriver::commandsEnabled() const
+{
+  return driver_mode_ == MODE_OPERATING && active_;
 }
 
 /* TODO or TO-THINKABOUT LIST
@@ -117,15 +715,25 @@ VescDriver::VescDriver(const rclcpp::NodeOptions & options)
   - what to do if no servo command received recently?
   - what is the motor safe off state (0 current?)
   - what to do if a command parameter is out of range, ignore?
-  - try to predict vesc bounds (from vesc config) and command detect bounds errors
 */
 
 void VescDriver::timerCallback()
 {
   // VESC interface should not unexpectedly disconnect, but test for it anyway
   if (!vesc_.isConnected()) {
-    RCLCPP_FATAL(get_logger(), "Unexpectedly disconnected from serial port.");
-    rclcpp::shutdown();
+    // leave recovering to the lifecycle manager: the transition out of the current state fails with
+    // an error, on_error() releases the port and the node ends up unconfigured
+    RCLCPP_ERROR(get_logger(), "Unexpectedly disconnected from serial port.");
+    stopTimer();
+    link_lost_ = true;
+    uint8_t state = get_current_state().id();
+    if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE) {
+      deactivate();
+    } else if (state == lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE) {
+      cleanup();
+    }
+    link_lost_ = false;
+    fail();
     return;
   }
 
@@ -135,23 +743,65 @@ void VescDriver::timerCallback()
    *  OPERATING - receiving commands from subscriber topics
    */
   if (driver_mode_ == MODE_INITIALIZING) {
-    // request version number, return packet will update the internal version numbers
+    // no reply yet, request the version number again. The reply switches to operating mode.
     vesc_.requestFWVersion();
-    if (fw_version_major_ >= 0 && fw_version_minor_ >= 0) {
-      RCLCPP_INFO(
-        get_logger(), "Connected to VESC with firmware version %d.%d",
-        fw_version_major_, fw_version_minor_);
-      driver_mode_ = MODE_OPERATING;
-    }
   } else if (driver_mode_ == MODE_OPERATING) {
-    // poll for vesc state (telemetry)
-    vesc_.requestState();
-    // poll for vesc imu
-    vesc_.requestImuData();
+    // poll for vesc state (telemetry) and imu while active, the link stays quiet in standby
+    if (active_) {
+      vesc_.requestState();
+      if (imu_mask_ != 0) {
+        vesc_.requestImuData(imu_mask_);
+      }
+    }
   } else {
     // unknown mode, how did that happen?
     assert(false && "unknown driver mode");
   }
+
+  auto now = std::chrono::steady_clock::now();
+  {
+    // the vesc stopped sending in the middle of a capture, publish what arrived
+    std::lock_guard<std::mutex> lock(capture_mutex_);
+    if (capture_active_ && capture_received_ > 0 &&
+      now - capture_last_sample_ > std::chrono::milliseconds(500))
+    {
+      RCLCPP_WARN(
+        get_logger(), "Sample capture incomplete, received %zu of %zu samples.", capture_received_,
+        capture_len_);
+      publishCapture(false);
+    }
+  }
+  {
+    // the fault log requested after a fault is complete
+    std::lock_guard<std::mutex> lock(print_mutex_);
+    if (fault_log_pending_ && (printQuiet(now) || now - fault_log_started_ > FAULT_LOG_TIMEOUT)) {
+      publishFaultLog();
+    }
+  }
+}
+
+/** Start timerCallback() at the poll rate, on the reactor's poll scheduler if there is one */
+void VescDriver::startTimer()
+{
+  auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::duration<double>(1.0 / poll_rate_));
+  if (reactor_) {
+    reactor_timer_ = reactor_->addPollTimer(period, std::bind(&VescDriver::timerCallback, this));
+  } else {
+    timer_ = create_wall_timer(period, std::bind(&VescDriver::timerCallback, this));
+  }
+}
+
+void VescDriver::stopTimer()
+{
+  if (reactor_timer_ >= 0) {
+    reactor_->removePollTimer(reactor_timer_);
+    reactor_timer_ = -1;
+  }
+  if (timer_) {
+    timer_->cancel();
+    timer_.reset();
+  }
 }
 
 void VescDriver::vescPacketCallback(const std::shared_ptr<VescPacket const> & packet)
@@ -189,18 +839,76 @@ void VescDriver::vescPacketCallback(const std::shared_ptr<VescPacket const> & pa
     state_msg.state.avg_vq = values->avg_vq();
 
     state_pub_->publish(state_msg);
+    handleFaultCode(values->fault_code());
+    {
+      std::lock_guard<std::mutex> lock(diagnostics_mutex_);
+      diag_temp_fet_ = values->temp_fet();
+      diag_temp_motor_ = values->temp_motor();
+      diag_v_in_ = values->v_in();
+      diag_fault_code_ = values->fault_code();
+      diag_values_count_++;
+    }
   } else if (packet->name() == "FWVersion") {
     std::shared_ptr<VescPacketFWVersion const> fw_version =
       std::dynamic_pointer_cast<VescPacketFWVersion const>(packet);
-    // todo: might need lock here
-    fw_version_major_ = fw_version->fwMajor();
-    fw_version_minor_ = fw_version->fwMinor();
+    // the configuration taken from the registry's device info is stale if this is another device
+    bool device_changed;
+    {
+      std::lock_guard<std::mutex> lock(device_mutex_);
+      device_changed = device_.fw_major != fw_version->fwMajor() ||
+        device_.fw_minor != fw_version->fwMinor() || device_.uuid != fw_version->uuidString();
+      device_.uuid = fw_version->uuidString();
+      device_.fw_major = fw_version->fwMajor();
+      device_.fw_minor = fw_version->fwMinor();
+    }
+    if (device_changed && config_requested_.exchange(false)) {
+      RCLCPP_WARN(get_logger(), "VESC differs from the device registry entry, refetching config.");
+      mcconf_valid_ = false;
+      appconf_valid_ = false;
+      {
+        std::lock_guard<std::mutex> lock(current_limits_mutex_);
+        mcconf_live_ = false;
+      }
+      // the limits were narrowed to the other device's configuration
+      duty_cycle_limit_.reset();
+      current_limit_.reset();
+      brake_limit_.reset();
+      speed_limit_.reset();
+    }
+    {
+      std::lock_guard<std::mutex> lock(diagnostics_mutex_);
+      diag_hw_name_ = fw_version->hwname();
+      diag_firmware_ =
+        std::to_string(fw_version->fwMajor()) + "." + std::to_string(fw_version->fwMinor());
+      diag_uuid_ = fw_version->uuidString();
+    }
     RCLCPP_INFO(
       get_logger(),
       "-=%s=- hardware paired %d",
       fw_version->hwname().c_str(),
       fw_version->paired()
     );
+    if (!config_requested_.exchange(true)) {
+      fetchConfiguration();
+    }
+    enterOperating();
+  } else if (packet->name() == "McConf") {
+    handleMcConf(std::dynamic_pointer_cast<VescPacketMcConf const>(packet)->data(), false);
+  } else if (packet->name() == "AppConf") {
+    handleAppConf(std::dynamic_pointer_cast<VescPacketAppConf const>(packet)->data(), false);
+  } else if (packet->name() == "RotorPosition") {
+    if (rotor_position_pub_) {
+      auto rotor_position_msg = VescRotorPosition();
+      rotor_position_msg.header.stamp = now();
+      rotor_position_msg.mode = rotor_position_mode_;
+      rotor_position_msg.position =
+        std::dynamic_pointer_cast<VescPacketRotorPosition const>(packet)->position();
+      rotor_position_pub_->publish(rotor_position_msg);
+    }
+  } else if (packet->name() == "Print") {
+    handlePrint(std::dynamic_pointer_cast<VescPacketPrint const>(packet)->text());
+  } else if (packet->name() == "Sample") {
+    handleSample(*std::dynamic_pointer_cast<VescPacketSample const>(packet));
   } else if (packet->name() == "ImuData") {
     std::shared_ptr<VescPacketImu const> imuData =
       std::dynamic_pointer_cast<VescPacketImu const>(packet);
@@ -258,6 +966,449 @@ void VescDriver::vescPacketCallback(const std::shared_ptr<VescPacket const> & pa
   );
 }
 
+/** Serial link health: connection, traffic rates and framing errors since the last update */
+void VescDriver::linkDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat)
+{
+  auto stats = vesc_.statistics();
+  auto now = std::chrono::steady_clock::now();
+  double dt = std::chrono::duration<double>(now - diag_last_update_).count();
+  uint64_t new_errors = stats.parse_errors - diag_last_stats_.parse_errors;
+
+  if (!vesc_.isConnected()) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::ERROR, "Disconnected");
+  } else if (driver_mode_ == MODE_INITIALIZING) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, "Waiting for the VESC to reply");
+  } else if (new_errors > 0) {
+    stat.summaryf(
+      diagnostic_msgs::msg::DiagnosticStatus::WARN, "%lu framing errors since the last update",
+      static_cast<unsigned long>(new_errors));
+  } else {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Connected");
+  }
+
+  if (dt > 0.0) {
+    stat.addf("RX bytes/s", "%.0f", (stats.rx_bytes - diag_last_stats_.rx_bytes) / dt);
+    stat.addf("RX packets/s", "%.1f", (stats.rx_packets - diag_last_stats_.rx_packets) / dt);
+    stat.addf("TX bytes/s", "%.0f", (stats.tx_bytes - diag_last_stats_.tx_bytes) / dt);
+    stat.addf("TX packets/s", "%.1f", (stats.tx_packets - diag_last_stats_.tx_packets) / dt);
+  }
+  stat.add("RX bytes", stats.rx_bytes);
+  stat.add("TX bytes", stats.tx_bytes);
+  stat.add("Framing errors", stats.parse_errors);
+  stat.add("Discarded bytes", stats.dropped_bytes);
+
+  diag_last_stats_ = stats;
+  diag_last_update_ = now;
+}
+
+/** Controller health: firmware, fault state and temperatures from the last state sample */
+void VescDriver::controllerDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat)
+{
+  std::string hw_name, firmware, uuid;
+  int fault_code;
+  double temp_fet, temp_motor, v_in, temp_fet_start, temp_motor_start;
+  uint64_t values_count;
+  {
+    std::lock_guard<std::mutex> lock(diagnostics_mutex_);
+    hw_name = diag_hw_name_;
+    firmware = diag_firmware_;
+    uuid = diag_uuid_;
+    fault_code = diag_fault_code_;
+    temp_fet = diag_temp_fet_;
+    temp_motor = diag_temp_motor_;
+    v_in = diag_v_in_;
+    temp_fet_start = diag_temp_fet_start_;
+    temp_motor_start = diag_temp_motor_start_;
+    values_count = diag_values_count_;
+  }
+  if (!active_) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Standby");
+  } else if (values_count == 0) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, "No state received");
+  } else if (values_count == diag_last_values_count_) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, "State is stale");
+  } else if (fault_code > 0) {
+    stat.summaryf(
+      diagnostic_msgs::msg::DiagnosticStatus::ERROR, "Fault %s", faultCodeName(fault_code));
+  } else if (!std::isnan(temp_fet_start) && temp_fet >= temp_fet_start) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, "MOSFET temperature limiting");
+  } else if (!std::isnan(temp_motor_start) && temp_motor >= temp_motor_start) {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::WARN, "Motor temperature limiting");
+  } else {
+    stat.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "OK");
+  }
+  diag_last_values_count_ = values_count;
+
+  stat.add("Hardware", hw_name);
+  stat.add("Firmware", firmware);
+  stat.add("UUID", uuid);
+  stat.add("Fault", fault_code >= 0 ? faultCodeName(fault_code) : "unknown");
+  stat.addf("MOSFET temperature (C)", "%.1f", temp_fet);
+  stat.addf("Motor temperature (C)", "%.1f", temp_motor);
+  stat.addf("Input voltage (V)", "%.2f", v_in);
+  stat.add("State samples", values_count);
+}
+
+VescDriver::DeviceIdentity VescDriver::device() const
+{
+  std::lock_guard<std::mutex> lock(device_mutex_);
+  return device_;
+}
+
+/**
+ * Load the vesc configuration from the cache, or request it from the vesc if it is not cached.
+ * Without a signature to accept the reply could not be decoded, so it is not requested.
+ */
+void VescDriver::fetchConfiguration()
+{
+  DeviceIdentity device = this->device();
+  Buffer data;
+  if (!mcconf_signatures_.empty()) {
+    if (config_cache_ &&
+      config_cache_->load(device.uuid, device.fw_major, device.fw_minor, "mcconf", &data))
+    {
+      handleMcConf(data, true);
+    }
+    if (!mcconf_valid_) {
+      vesc_.send(VescPacketRequestMcConf());
+    }
+  }
+
+  if (!appconf_signatures_.empty()) {
+    if (config_cache_ &&
+      config_cache_->load(device.uuid, device.fw_major, device.fw_minor, "appconf", &data))
+    {
+      handleAppConf(data, true);
+    }
+    if (!appconf_valid_) {
+      vesc_.send(VescPacketRequestAppConf());
+    }
+  }
+}
+
+void VescDriver::handleMcConf(const Buffer & data, bool from_cache)
+{
+  DeviceIdentity device = this->device();
+  mc_configuration conf = mc_configuration();
+  uint32_t signature = 0;
+  if (!deserializeMcConf(data, device.fw_major, mcconf_signatures_, &conf, &signature)) {
+    RCLCPP_WARN(
+      get_logger(), "Unable to decode the motor configuration of firmware %d.%d%s, signature %u. "
+      "Its layout is unknown unless the signature is in mcconf_signatures.",
+      device.fw_major, device.fw_minor, from_cache ? " from the cache" : "", signature);
+    return;
+  }
+  if (!from_cache && config_cache_ &&
+    !config_cache_->store(device.uuid, device.fw_major, device.fw_minor, "mcconf", data))
+  {
+    RCLCPP_WARN(
+      get_logger(), "Unable to cache the motor configuration in %s.",
+      config_cache_->directory().c_str());
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(current_limits_mutex_);
+    mcconf_ = conf;
+    mcconf_valid_ = true;
+    mcconf_live_ = !from_cache;
+    sendCurrentLimits();
+  }
+  {
+    std::lock_guard<std::mutex> lock(diagnostics_mutex_);
+    diag_temp_fet_start_ = conf.l_temp_fet_start;
+    diag_temp_motor_start_ = conf.l_temp_motor_start;
+  }
+  RCLCPP_INFO(
+    get_logger(),
+    "VESC motor limits%s: current %.1f to %.1f A, input current %.1f to %.1f A, "
+    "speed %.0f to %.0f ERPM, duty cycle %.3f to %.3f",
+    from_cache ? " (cached)" : "",
+    conf.l_current_min, conf.l_current_max, conf.l_in_current_min, conf.l_in_current_max,
+    conf.l_min_erpm, conf.l_max_erpm, conf.l_min_duty, conf.l_max_duty);
+
+  // commands outside of these bounds would be clipped by the vesc anyway, clip them here instead
+  duty_cycle_limit_.restrict(-conf.l_max_duty, conf.l_max_duty);
+  current_limit_.restrict(conf.l_current_min, conf.l_current_max);
+  brake_limit_.restrict(std::experimental::optional<double>(), std::fabs(conf.l_current_min));
+  speed_limit_.restrict(conf.l_min_erpm, conf.l_max_erpm);
+}
+
+/**
+ * Take changed current limit parameters, they are pushed right away if the vesc is operating.
+ * COMM_SET_MCCONF_TEMP is built from the vesc's own motor configuration, while it has not arrived
+ * yet the change is refused instead of being taken without reaching the vesc.
+ */
+rcl_interfaces::msg::SetParametersResult VescDriver::currentLimitsCallback(
+  const std::vector<rclcpp::Parameter> & parameters)
+{
+  rcl_interfaces::msg::SetParametersResult result;
+  std::lock_guard<std::mutex> lock(current_limits_mutex_);
+  VescCurrentLimits limits = current_limits_;
+  result.successful = limits.update(parameters, &result.reason);
+  if (result.successful && limits != current_limits_) {
+    if (!limits.empty() && driver_mode_ == MODE_OPERATING && !mcconf_live_) {
+      result.successful = false;
+      result.reason = "no motor configuration from the VESC yet, the limits can't be pushed";
+      if (mcconf_valid_) {
+        vesc_.send(VescPacketRequestMcConf());
+      }
+      return result;
+    }
+    current_limits_ = limits;
+    sendCurrentLimits();
+  }
+  return result;
+}
+
+/**
+ * Push the current limits with COMM_SET_MCCONF_TEMP. The packet writes back the configured limits
+ * too, so it is only built from a motor configuration the vesc sent itself, and only once its
+ * firmware version reply confirmed the device. A cached configuration may be stale or another
+ * device's, the vesc is asked for its own and the limits are sent once it arrives.
+ */
+void VescDriver::sendCurrentLimits()
+{
+  if (current_limits_.empty() || driver_mode_ != MODE_OPERATING || !vesc_.isConnected()) {
+    return;
+  }
+  if (!mcconf_live_) {
+    // without any configuration its request is already out
+    if (mcconf_valid_) {
+      vesc_.send(VescPacketRequestMcConf());
+    }
+    return;
+  }
+
+  bool capped = false;
+  vesc_.send(
+    VescPacketSetMcconfTemp(
+      current_limits_.mcconfTemp(mcconf_, &capped), current_limits_.persist));
+  if (capped) {
+    RCLCPP_WARN(
+      get_logger(), "Motor current limits above the configured %.1f to %.1f A can't be set at "
+      "runtime over serial, capped.", mcconf_.l_current_min, mcconf_.l_current_max);
+  }
+  RCLCPP_INFO(
+    get_logger(), "VESC current limits%s: %s.", current_limits_.persist ? " (stored)" : "",
+    current_limits_.describe().c_str());
+}
+
+void VescDriver::handleAppConf(const Buffer & data, bool from_cache)
+{
+  DeviceIdentity device = this->device();
+  app_configuration conf = app_configuration();
+  uint32_t signature = 0;
+  if (!deserializeAppConf(data, device.fw_major, appconf_signatures_, &conf, &signature)) {
+    RCLCPP_WARN(
+      get_logger(), "Unable to decode the app configuration of firmware %d.%d%s, signature %u. "
+      "Its layout is unknown unless the signature is in appconf_signatures.",
+      device.fw_major, device.fw_minor, from_cache ? " from the cache" : "", signature);
+    return;
+  }
+  if (!from_cache && config_cache_ &&
+    !config_cache_->store(device.uuid, device.fw_major, device.fw_minor, "appconf", data))
+  {
+    RCLCPP_WARN(
+      get_logger(), "Unable to cache the app configuration in %s.",
+      config_cache_->directory().c_str());
+  }
+
+  appconf_ = conf;
+  appconf_valid_ = true;
+  RCLCPP_INFO(
+    get_logger(),
+    "VESC app configuration%s: controller id %d, timeout %u ms, CAN status %d @ %u Hz",
+    from_cache ? " (cached)" : "", conf.controller_id, conf.timeout_msec,
+    static_cast<int>(conf.send_can_status), conf.send_can_status_rate_hz);
+}
+
+/**
+ * Start a sample capture. The vesc streams the samples once its trigger condition is met, the
+ * capture is published on sensors/samples when all of them arrived.
+ */
+void VescDriver::sampleTriggerCallback(
+  const std::shared_ptr<VescSampleTrigger::Request> request,
+  std::shared_ptr<VescSampleTrigger::Response> response)
+{
+  if (!commandsEnabled()) {
+    response->success = false;
+    response->message = "VESC driver not active";
+    return;
+  }
+
+  size_t sample_len = request->sample_len == 0 ? capture_max_ : request->sample_len;
+  if (sample_len > capture_max_) {
+    response->success = false;
+    response->message = "sample_len exceeds sample_capture_max (" + std::to_string(capture_max_) +
+      ")";
+    return;
+  }
+  uint8_t decimation = std::max<uint8_t>(1, request->decimation);
+
+  std::lock_guard<std::mutex> lock(capture_mutex_);
+  // resizing within the reserved capacity does not allocate
+  forEachCaptureArray(&capture_, [sample_len](auto & array) {array.resize(sample_len);});
+  capture_.mode = request->mode;
+  capture_.decimation = decimation;
+  capture_len_ = sample_len;
+  capture_received_ = 0;
+  capture_active_ = request->mode != DEBUG_SAMPLING_OFF;
+
+  vesc_.requestSamples(request->mode, static_cast<uint16_t>(sample_len), decimation);
+  response->success = true;
+  response->message = capture_active_ ? "capture started" : "capture stopped";
+}
+
+void VescDriver::handleSample(const VescPacketSample & sample)
+{
+  std::lock_guard<std::mutex> lock(capture_mutex_);
+  if (!capture_active_) {
+    return;
+  }
+
+  size_t i = capture_received_++;
+  capture_.current0[i] = sample.current0();
+  capture_.current1[i] = sample.current1();
+  capture_.voltage_ph1[i] = sample.voltage_ph1();
+  capture_.voltage_ph2[i] = sample.voltage_ph2();
+  capture_.voltage_ph3[i] = sample.voltage_ph3();
+  capture_.voltage_zero[i] = sample.voltage_zero();
+  capture_.current_fir[i] = sample.current_fir();
+  capture_.f_sw[i] = sample.f_sw();
+  capture_.status[i] = sample.status();
+  capture_.phase[i] = sample.phase();
+  capture_last_sample_ = std::chrono::steady_clock::now();
+
+  if (capture_received_ == capture_len_) {
+    publishCapture(true);
+  }
+}
+
+/** Publish the running capture and end it, the caller holds capture_mutex_. */
+void VescDriver::publishCapture(bool complete)
+{
+  forEachCaptureArray(&capture_, [this](auto & array) {array.resize(capture_received_);});
+  capture_.complete = complete;
+  capture_.header.stamp = now();
+  sample_pub_->publish(capture_);
+  capture_active_ = false;
+}
+
+/**
+ * Run a terminal command on the vesc. The vesc prints its output as a burst of lines without an end
+ * marker, the output is complete once no line arrived for a while.
+ */
+void VescDriver::terminalCallback(
+  const std::shared_ptr<VescTerminal::Request> request,
+  std::shared_ptr<VescTerminal::Response> response)
+{
+  auto timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(request->timeout > 0.0 ? request->timeout : 1.0));
+
+  // the command and its packet id must fit in a single frame
+  if (request->command.size() > static_cast<size_t>(VescFrame::VESC_MAX_PAYLOAD_SIZE - 1)) {
+    response->success = false;
+    response->output = "command too long, at most " +
+      std::to_string(VescFrame::VESC_MAX_PAYLOAD_SIZE - 1) + " characters";
+    RCLCPP_ERROR(
+      get_logger(), "Terminal command of %zu characters is too long", request->command.size());
+    return;
+  }
+
+  std::lock_guard<std::mutex> terminal_lock(terminal_mutex_);
+  std::unique_lock<std::mutex> lock(print_mutex_);
+  // let a running fault log fetch finish first, the timer ends it within FAULT_LOG_TIMEOUT
+  print_cv_.wait(lock, [this] {return !print_collecting_;});
+  print_output_.clear();
+  print_collecting_ = true;
+  vesc_.sendTerminalCommand(request->command);
+
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline || printQuiet(now)) {
+      break;
+    }
+    auto wake =
+      print_output_.empty() ? deadline : std::min(deadline, print_last_ + TERMINAL_QUIET_PERIOD);
+    print_cv_.wait_until(lock, wake);
+  }
+
+  print_collecting_ = false;
+  response->success = !print_output_.empty();
+  response->output = std::move(print_output_);
+  print_output_.clear();
+  print_cv_.notify_all();
+}
+
+/** Whether the terminal output is complete, the caller holds print_mutex_. */
+bool VescDriver::printQuiet(const std::chrono::steady_clock::time_point & now) const
+{
+  return !print_output_.empty() && now - print_last_ >= TERMINAL_QUIET_PERIOD;
+}
+
+/**
+ * Publish a fault event when the fault code changes, and fetch the vesc's fault log with the
+ * details of the fault. Called on the packet thread, so the fetch must not wait for the output,
+ * the timer publishes it once complete.
+ */
+void VescDriver::handleFaultCode(int fault_code)
+{
+  if (fault_code == last_fault_code_) {
+    return;
+  }
+
+  auto fault_msg = VescFault();
+  fault_msg.header.stamp = now();
+  fault_msg.fault_code = fault_code;
+  fault_msg.fault_name = faultCodeName(fault_code);
+  fault_msg.previous_fault_code = last_fault_code_ < 0 ? FAULT_CODE_NONE : last_fault_code_;
+  fault_pub_->publish(fault_msg);
+
+  if (fault_code != FAULT_CODE_NONE) {
+    RCLCPP_ERROR(get_logger(), "VESC fault %s.", fault_msg.fault_name.c_str());
+  } else if (last_fault_code_ > 0) {
+    RCLCPP_INFO(get_logger(), "VESC fault %s cleared.", faultCodeName(last_fault_code_));
+  }
+  last_fault_code_ = fault_code;
+
+  if (fault_code != FAULT_CODE_NONE) {
+    std::lock_guard<std::mutex> lock(print_mutex_);
+    // skipped while a terminal command runs, the next fault log lists this fault as well
+    if (!print_collecting_) {
+      print_collecting_ = true;
+      print_output_.clear();
+      fault_log_pending_ = true;
+      fault_log_msg_ = fault_msg;
+      fault_log_started_ = std::chrono::steady_clock::now();
+      vesc_.sendTerminalCommand("faults");
+    }
+  }
+}
+
+/** Publish the collected fault log, the caller holds print_mutex_. */
+void VescDriver::publishFaultLog()
+{
+  fault_log_msg_.detail = std::move(print_output_);
+  print_output_.clear();
+  fault_log_pub_->publish(fault_log_msg_);
+  fault_log_pending_ = false;
+  print_collecting_ = false;
+  print_cv_.notify_all();
+}
+
+void VescDriver::handlePrint(const std::string & text)
+{
+  std::lock_guard<std::mutex> lock(print_mutex_);
+  if (print_collecting_) {
+    print_output_ += text + "\n";
+    print_last_ = std::chrono::steady_clock::now();
+    print_cv_.notify_all();
+  } else {
+    RCLCPP_INFO(get_logger(), "VESC: %s", text.c_str());
+  }
+}
+
 void VescDriver::vescErrorCallback(const std::string & error)
 {
   RCLCPP_ERROR(get_logger(), "%s", error.c_str());
@@ -270,8 +1421,9 @@ void VescDriver::vescErrorCallback(const std::string & error)
  */
 void VescDriver::dutyCycleCallback(const Float64::SharedPtr duty_cycle)
 {
-  if (driver_mode_ = MODE_OPERATING) {
+  if (commandsEnabled()) {
     vesc_.setDutyCycle(duty_cycle_limit_.clip(duty_cycle->data));
+    commandSent();
   }
 }
 
@@ -282,8 +1434,9 @@ void VescDriver::dutyCycleCallback(const Float64::SharedPtr duty_cycle)
  */
 void VescDriver::currentCallback(const Float64::SharedPtr current)
 {
-  if (driver_mode_ = MODE_OPERATING) {
+  if (commandsEnabled()) {
     vesc_.setCurrent(current_limit_.clip(current->data));
+    commandSent();
   }
 }
 
@@ -294,8 +1447,9 @@ void VescDriver::currentCallback(const Float64::SharedPtr current)
  */
 void VescDriver::brakeCallback(const Float64::SharedPtr brake)
 {
-  if (driver_mode_ = MODE_OPERATING) {
+  if (commandsEnabled()) {
     vesc_.setBrake(brake_limit_.clip(brake->data));
+    commandSent();
   }
 }
 
@@ -307,8 +1461,9 @@ void VescDriver::brakeCallback(const Float64::SharedPtr brake)
  */
 void VescDriver::speedCallback(const Float64::SharedPtr speed)
 {
-  if (driver_mode_ = MODE_OPERATING) {
+  if (commandsEnabled()) {
     vesc_.setSpeed(speed_limit_.clip(speed->data));
+    commandSent();
   }
 }
 
@@ -318,10 +1473,11 @@ void VescDriver::speedCallback(const Float64::SharedPtr speed)
  */
 void VescDriver::positionCallback(const Float64::SharedPtr position)
 {
-  if (driver_mode_ = MODE_OPERATING) {
+  if (commandsEnabled()) {
     // ROS uses radians but VESC seems to use degrees. Convert to degrees.
     double position_deg = position_limit_.clip(position->data) * 180.0 / M_PI;
     vesc_.setPosition(position_deg);
+    commandSent();
   }
 }
 
@@ -330,9 +1486,10 @@ void VescDriver::positionCallback(const Float64::SharedPtr position)
  */
 void VescDriver::servoCallback(const Float64::SharedPtr servo)
 {
-  if (driver_mode_ = MODE_OPERATING) {
+  if (commandsEnabled()) {
     double servo_clipped(servo_limit_.clip(servo->data));
     vesc_.setServo(servo_clipped);
+    commandSent();
     // publish clipped servo value as a "sensor"
     auto servo_sensor_msg = Float64();
     servo_sensor_msg.data = servo_clipped;
@@ -341,7 +1498,7 @@ void VescDriver::servoCallback(const Float64::SharedPtr servo)
 }
 
 VescDriver::CommandLimit::CommandLimit(
-  rclcpp::Node * node_ptr,
+  rclcpp_lifecycle::LifecycleNode * node_ptr,
   const std::string & str,
   const std::experimental::optional<double> & min_lower,
   const std::experimental::optional<double> & max_upper)
@@ -419,11 +1576,15 @@ VescDriver::CommandLimit::CommandLimit(
   }
 
   RCLCPP_DEBUG_STREAM(logger, oss.str());
+
+  user_lower = lower;
+  user_upper = upper;
 }
 
 double VescDriver::CommandLimit::clip(double value)
 {
   auto clock = rclcpp::Clock(RCL_ROS_TIME);
+  std::lock_guard<std::mutex> lock(mutex);
 
   if (lower && value < lower) {
     RCLCPP_INFO_THROTTLE(
@@ -440,6 +1601,45 @@ double VescDriver::CommandLimit::clip(double value)
   return value;
 }
 
+/**
+ * Narrow the limits configured by the user to the bounds the vesc itself enforces. The limits are
+ * recomputed from the user's each time, so bounds from a previous configuration, e.g. another
+ * device's cached one, don't stay in effect.
+ */
+void VescDriver::CommandLimit::restrict(
+  const std::experimental::optional<double> & vesc_lower,
+  const std::experimental::optional<double> & vesc_upper)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  lower = user_lower;
+  upper = user_upper;
+  if (vesc_lower && (!lower || *lower < *vesc_lower)) {
+    if (lower) {
+      RCLCPP_WARN_STREAM(
+        logger, "Parameter " << name << "_min (" << *lower <<
+          ") is less than the VESC minimum (" << *vesc_lower << ").");
+    }
+    lower = *vesc_lower;
+  }
+  if (vesc_upper && (!upper || *upper > *vesc_upper)) {
+    if (upper) {
+      RCLCPP_WARN_STREAM(
+        logger, "Parameter " << name << "_max (" << *upper <<
+          ") is greater than the VESC maximum (" << *vesc_upper << ").");
+    }
+    upper = *vesc_upper;
+  }
+}
+
+/** Back to the limits configured by the user, until the vesc's bounds are known again */
+void VescDriver::CommandLimit::reset()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  lower = user_lower;
+  upper = user_upper;
+}
+
 }  // namespace vesc_driver
 
 #include "rclcpp_components/register_node_macro.hpp"  // NOLINT
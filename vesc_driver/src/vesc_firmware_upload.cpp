@@ -0,0 +1,314 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_firmware_upload.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef VESC_DRIVER_HAVE_LZO
+#include <lzo/lzo1x.h>
+#endif
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+// largest payload the VESC accepts, minus the command id, offset and LZO size
+const size_t MAX_CHUNK_SIZE = 512 - 7;
+
+double secondsSince(const std::chrono::steady_clock::time_point & start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+const uint32_t VescFirmwareUploader::NO_OFFSET;
+
+double VescFirmwareUploader::Result::throughput() const
+{
+  return write_seconds > 0.0 ? image_bytes / write_seconds : 0.0;
+}
+
+VescFirmwareUploader::VescFirmwareUploader(VescInterface * vesc, const Options & options)
+: vesc_(vesc),
+  options_(options),
+  erase_done_(false),
+  erase_ok_(false)
+{
+  options_.chunk_size = std::max<size_t>(1, std::min(options_.chunk_size, MAX_CHUNK_SIZE));
+  options_.window = std::max<size_t>(1, options_.window);
+}
+
+bool VescFirmwareUploader::lzoAvailable()
+{
+#ifdef VESC_DRIVER_HAVE_LZO
+  return true;
+#else
+  return false;
+#endif
+}
+
+Buffer VescFirmwareUploader::prefixImage(const Buffer & firmware)
+{
+  uint32_t size = firmware.size();
+  uint16_t crc = CRC::Calculate(firmware.data(), firmware.size(), VescFrame::CRC_TYPE);
+
+  Buffer image;
+  image.reserve(6 + firmware.size());
+  image.push_back(static_cast<uint8_t>((size >> 24) & 0xFF));
+  image.push_back(static_cast<uint8_t>((size >> 16) & 0xFF));
+  image.push_back(static_cast<uint8_t>((size >> 8) & 0xFF));
+  image.push_back(static_cast<uint8_t>(size & 0xFF));
+  image.push_back(static_cast<uint8_t>(crc >> 8));
+  image.push_back(static_cast<uint8_t>(crc & 0xFF));
+  image.insert(image.end(), firmware.begin(), firmware.end());
+  return image;
+}
+
+std::vector<VescFirmwareUploader::Chunk> VescFirmwareUploader::buildChunks(
+  const Buffer & image) const
+{
+#ifdef VESC_DRIVER_HAVE_LZO
+  static const bool lzo_ready = (lzo_init() == LZO_E_OK);
+  std::vector<uint8_t> lzo_work(LZO1X_1_MEM_COMPRESS);
+  Buffer compressed(options_.chunk_size + options_.chunk_size / 16 + 64 + 3);
+#endif
+
+  std::vector<Chunk> chunks;
+  chunks.reserve((image.size() + options_.chunk_size - 1) / options_.chunk_size);
+  for (size_t offset = 0; offset < image.size(); offset += options_.chunk_size) {
+    auto begin = image.cbegin() + offset;
+    auto end = image.cbegin() + std::min(offset + options_.chunk_size, image.size());
+
+    Chunk chunk;
+    chunk.offset = static_cast<uint32_t>(offset);
+    chunk.attempts = 0;
+    chunk.in_flight = false;
+    chunk.done = false;
+
+#ifdef VESC_DRIVER_HAVE_LZO
+    // only send the compressed chunk if it is actually smaller, flash images compress unevenly
+    lzo_uint compressed_size = 0;
+    if (options_.lzo && lzo_ready &&
+      lzo1x_1_compress(
+        &(*begin), std::distance(begin, end), compressed.data(), &compressed_size,
+        lzo_work.data()) == LZO_E_OK &&
+      compressed_size < static_cast<lzo_uint>(std::distance(begin, end)))
+    {
+      chunk.packet = std::make_shared<VescPacketWriteNewAppDataLzo>(
+        chunk.offset, static_cast<uint16_t>(std::distance(begin, end)), compressed.cbegin(),
+        compressed.cbegin() + compressed_size);
+    }
+#endif
+    if (!chunk.packet) {
+      chunk.packet = std::make_shared<VescPacketWriteNewAppData>(chunk.offset, begin, end);
+    }
+    chunks.push_back(chunk);
+  }
+  return chunks;
+}
+
+void VescFirmwareUploader::sendChunk(Chunk * chunk, Result * result)
+{
+  if (chunk->attempts > 0) {
+    result->resent++;
+  }
+  chunk->attempts++;
+  chunk->in_flight = true;
+  chunk->sent = std::chrono::steady_clock::now();
+  result->wire_bytes += chunk->packet->frame().size();
+  vesc_->send(*chunk->packet);
+}
+
+VescFirmwareUploader::Result VescFirmwareUploader::upload(
+  const Buffer & firmware, const ProgressFunction & progress)
+{
+  Result result;
+  if (options_.lzo && !lzoAvailable()) {
+    result.error = "LZO compression requested, but vesc_driver was built without liblzo2";
+    return result;
+  }
+
+  Buffer image = prefixImage(firmware);
+  result.image_bytes = image.size();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  chunks_ = buildChunks(image);
+  chunk_by_offset_.clear();
+  for (size_t i = 0; i < chunks_.size(); i++) {
+    chunk_by_offset_[chunks_[i].offset] = i;
+  }
+  acks_.clear();
+  nacks_.clear();
+  result.chunks = chunks_.size();
+
+  // erase the staging area, this takes a few seconds on the VESC
+  auto start = std::chrono::steady_clock::now();
+  erase_done_ = false;
+  vesc_->send(VescPacketEraseNewApp(static_cast<uint32_t>(image.size())));
+  if (!cv_.wait_for(lock, options_.erase_timeout, [this] {return erase_done_;})) {
+    result.error = "Timed out erasing the VESC's staging area";
+    return result;
+  }
+  if (!erase_ok_) {
+    result.error = "The VESC failed to erase its staging area";
+    return result;
+  }
+  result.erase_seconds = secondsSince(start);
+
+  // stream the chunks with a window in flight. Resent chunks go out before new ones.
+  start = std::chrono::steady_clock::now();
+  size_t next = 0;
+  size_t done = 0;
+  std::vector<size_t> in_flight;
+  std::deque<size_t> resend;
+  // one chunk until the first acknowledgement shows whether the firmware echoes the offset
+  size_t window = 1;
+  bool window_known = false;
+  // chunk an acknowledgement is for, or chunks_.size() if it can't be told
+  auto ackedChunk = [&](uint32_t offset) {
+      if (offset == NO_OFFSET) {
+        return in_flight.size() == 1 ? in_flight.front() : chunks_.size();
+      }
+      auto search = chunk_by_offset_.find(offset);
+      return search != chunk_by_offset_.end() ? search->second : chunks_.size();
+    };
+  while (done < chunks_.size()) {
+    if (!window_known && (!acks_.empty() || !nacks_.empty())) {
+      bool echoes = (acks_.empty() ? nacks_ : acks_).front() != NO_OFFSET;
+      window = echoes ? options_.window : 1;
+      window_known = true;
+    }
+    for (uint32_t offset : acks_) {
+      size_t i = ackedChunk(offset);
+      if (i < chunks_.size() && !chunks_[i].done) {
+        chunks_[i].done = true;
+        chunks_[i].in_flight = false;
+        done++;
+      }
+    }
+    for (uint32_t offset : nacks_) {
+      size_t i = ackedChunk(offset);
+      if (i < chunks_.size() && chunks_[i].in_flight) {
+        chunks_[i].in_flight = false;
+        resend.push_back(i);
+      }
+    }
+    bool progressed = !acks_.empty();
+    acks_.clear();
+    nacks_.clear();
+
+    // drop finished chunks from the window, and resend the ones not acknowledged in time
+    auto now = std::chrono::steady_clock::now();
+    auto expired = [&](size_t i) {
+        if (chunks_[i].in_flight && now - chunks_[i].sent > options_.chunk_timeout) {
+          chunks_[i].in_flight = false;
+          resend.push_back(i);
+        }
+        return !chunks_[i].in_flight;
+      };
+    in_flight.erase(std::remove_if(in_flight.begin(), in_flight.end(), expired), in_flight.end());
+
+    while (in_flight.size() < window && (!resend.empty() || next < chunks_.size())) {
+      size_t i;
+      if (!resend.empty()) {
+        i = resend.front();
+        resend.pop_front();
+        if (chunks_[i].done) {
+          continue;  // a late acknowledgement arrived after all
+        }
+      } else {
+        i = next++;
+      }
+      if (chunks_[i].attempts > options_.retries) {
+        result.error = "Writing " + std::to_string(chunks_[i].packet->frame().size()) +
+          " byte chunk at offset " + std::to_string(chunks_[i].offset) + " failed after " +
+          std::to_string(chunks_[i].attempts) + " attempts";
+        result.write_seconds = secondsSince(start);
+        return result;
+      }
+      sendChunk(&chunks_[i], &result);
+      in_flight.push_back(i);
+    }
+
+    if (progressed && progress) {
+      progress(done * image.size() / chunks_.size(), image.size());
+    }
+
+    if (done < chunks_.size()) {
+      // wait for an acknowledgement, or until the oldest chunk in flight times out
+      auto deadline = now + options_.chunk_timeout;
+      for (size_t i : in_flight) {
+        deadline = std::min(deadline, chunks_[i].sent + options_.chunk_timeout);
+      }
+      cv_.wait_until(lock, deadline, [this] {return !acks_.empty() || !nacks_.empty();});
+    }
+  }
+
+  result.write_seconds = secondsSince(start);
+  result.success = true;
+  return result;
+}
+
+void VescFirmwareUploader::jumpToBootloader()
+{
+  vesc_->send(VescPacketJumpToBootloader());
+}
+
+void VescFirmwareUploader::handlePacket(const VescPacketConstPtr & packet)
+{
+  if (packet->name() == "EraseNewAppResult") {
+    std::lock_guard<std::mutex> lock(mutex_);
+    erase_done_ = true;
+    erase_ok_ = std::dynamic_pointer_cast<VescPacketEraseNewAppResult const>(packet)->ok();
+    cv_.notify_all();
+  } else if (packet->name() == "WriteNewAppDataResult") {
+    std::shared_ptr<VescPacketWriteNewAppDataResult const> write_result =
+      std::dynamic_pointer_cast<VescPacketWriteNewAppDataResult const>(packet);
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t offset = write_result->hasOffset() ? write_result->offset() : NO_OFFSET;
+    if (write_result->ok()) {
+      acks_.push_back(offset);
+    } else {
+      nacks_.push_back(offset);
+    }
+    cv_.notify_all();
+  }
+}
+
+}  // namespace vesc_driver
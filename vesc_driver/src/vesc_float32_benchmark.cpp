@@ -0,0 +1,212 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+// Measure the float32_auto decoding of IMU packets against the implementation it replaced: the
+// exponent / mantissa reconstruction with ldexpf for every value and one mask test per field,
+// against the IEEE-754 memcpy fast path and a loop over the set bits of the mask only.
+//
+//   vesc_float32_benchmark [--iterations N]
+//
+//   --iterations N    packets decoded per run (default 2000000)
+//
+// Prints the time per value and per packet for a full mask and for a few typical field
+// selections, and checks that both decoders agree on every value.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace
+{
+
+const int IMU_FIELDS = 16;
+
+/** The decoder before the fast path, as in the firmware's buffer_get_float32_auto() */
+float decodeFloat32AutoLdexp(uint32_t res)
+{
+  int e = (res >> 23) & 0xFF;
+  int fr = res & 0x7FFFFF;
+  bool negative = res & (1u << 31);
+
+  float f = 0.0;
+  if (e != 0 || fr != 0) {
+    f = static_cast<float>(fr) / (8388608.0 * 2.0) + 0.5;
+    e -= 126;
+  }
+
+  if (negative) {
+    f = -f;
+  }
+  return ldexpf(f, e);
+}
+
+uint32_t readWord(const uint8_t * data)
+{
+  return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+         static_cast<uint32_t>(data[2]) << 8 | static_cast<uint32_t>(data[3]);
+}
+
+/** Old field walk: one test per field whether it is requested or not */
+void decodeImuOld(uint32_t mask, const uint8_t * data, double * fields)
+{
+  for (int i = 0; i < IMU_FIELDS; i++) {
+    if (mask & (1u << i)) {
+      fields[i] = decodeFloat32AutoLdexp(readWord(data));
+      data += 4;
+    }
+  }
+}
+
+/** New field walk, as VescPacketImu does it */
+void decodeImuNew(uint32_t mask, const uint8_t * data, double * fields)
+{
+  for (uint32_t bits = mask; bits != 0; bits &= bits - 1) {
+    fields[__builtin_ctz(bits)] = vesc_driver::decodeFloat32Auto(readWord(data));
+    data += 4;
+  }
+}
+
+/** IMU payloads as the firmware writes them, with values in the range of the real fields */
+std::vector<uint8_t> makePackets(uint32_t mask, int count)
+{
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> value(-400.0f, 400.0f);
+  int num_fields = __builtin_popcount(mask);
+  std::vector<uint8_t> data(static_cast<size_t>(count) * num_fields * 4);
+  for (size_t i = 0; i < data.size(); i += 4) {
+    // every 16th value zero, the firmware sends that for fields without a sensor
+    uint32_t word = (i / 4) % 16 == 0 ? 0 : vesc_driver::encodeFloat32Auto(value(rng));
+    for (int b = 0; b < 4; b++) {
+      data[i + b] = static_cast<uint8_t>(word >> (24 - 8 * b));
+    }
+  }
+  return data;
+}
+
+typedef void (* DecodeFunction)(uint32_t, const uint8_t *, double *);
+
+/** Nanoseconds per packet, the decoded values are summed so the work can't be dropped */
+double timePackets(
+  DecodeFunction decode, uint32_t mask, const std::vector<uint8_t> & data, int count,
+  double * checksum)
+{
+  size_t packet_size = __builtin_popcount(mask) * 4;
+  double fields[IMU_FIELDS] = {0.0};
+  double sum = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; i++) {
+    decode(mask, data.data() + i * packet_size, fields);
+    sum += fields[__builtin_ctz(mask)];
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  *checksum = sum;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / count;
+}
+
+int usage(const char * name)
+{
+  std::cerr << "Usage: " << name << " [--iterations N]" << std::endl;
+  return -1;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  int iterations = 2000000;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::stoi(argv[++i]);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (iterations <= 0) {
+    return usage(argv[0]);
+  }
+
+  // both decoders must agree bit for bit on random words and on zero and the exponent extremes
+  // (NaN payloads aside)
+  std::mt19937 rng(1);
+  uint64_t mismatches = 0;
+  uint32_t special[] = {0x00000000, 0x80000000, 0x00000001, 0x807FFFFF, 0x7F800000, 0xFFFFFFFF};
+  std::vector<uint32_t> words(special, special + sizeof(special) / sizeof(special[0]));
+  for (int i = 0; i < 1000000; i++) {
+    words.push_back(rng());
+  }
+  for (uint32_t word : words) {
+    float a = decodeFloat32AutoLdexp(word);
+    float b = vesc_driver::decodeFloat32Auto(word);
+    if (std::memcmp(&a, &b, sizeof(a)) != 0 && !(std::isnan(a) && std::isnan(b))) {
+      mismatches++;
+    }
+  }
+  std::printf("%zu words checked, %lu mismatches\n\n", words.size(),
+    static_cast<unsigned long>(mismatches));
+
+  struct Selection
+  {
+    const char * name;
+    uint32_t mask;
+  };
+  const Selection selections[] = {
+    {"all", 0xFFFF},
+    {"rpy", 0x0007},
+    {"acc,gyro", 0x01F8},
+    {"quaternion", 0xF000},
+  };
+
+  std::printf("fields      old [ns/pkt]  new [ns/pkt]  old [ns/val]  new [ns/val]  speedup\n");
+  for (const Selection & selection : selections) {
+    std::vector<uint8_t> data = makePackets(selection.mask, iterations);
+    double old_sum = 0.0;
+    double new_sum = 0.0;
+    // warm up the caches, then measure
+    timePackets(decodeImuOld, selection.mask, data, iterations / 10, &old_sum);
+    double old_ns = timePackets(decodeImuOld, selection.mask, data, iterations, &old_sum);
+    double new_ns = timePackets(decodeImuNew, selection.mask, data, iterations, &new_sum);
+    int num_fields = __builtin_popcount(selection.mask);
+    std::printf("%-10s  %12.1f  %12.1f  %12.2f  %12.2f  %6.1fx%s\n", selection.name, old_ns,
+      new_ns, old_ns / num_fields, new_ns / num_fields, old_ns / new_ns,
+      old_sum == new_sum ? "" : "  (results differ)");
+    if (old_sum != new_sum) {
+      mismatches++;
+    }
+  }
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+// Upload a firmware image to a VESC.
+//
+//   vesc_fw_upload [options] <port> <firmware.bin>
+//
+//   --window N      writes in flight (default 4)
+//   --chunk N       image bytes per write (default 384)
+//   --retries N     attempts per chunk after the first (default 5)
+//   --timeout MS    acknowledgement timeout per chunk (default 500)
+//   --lzo           compress the chunks with LZO
+//   --no-jump       only stage the image, do not start the bootloader
+//
+// The image is staged on the VESC and installed by its bootloader, which checks the image size
+// and CRC first. Try it against vesc_simulator before flashing real hardware.
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include "vesc_driver/vesc_firmware_upload.hpp"
+#include "vesc_driver/vesc_interface.hpp"
+
+using vesc_driver::Buffer;
+using vesc_driver::VescFirmwareUploader;
+using vesc_driver::VescInterface;
+
+static int usage(const char * name)
+{
+  std::cerr << "Usage: " << name << " [--window N] [--chunk N] [--retries N] [--timeout MS] "
+    "[--lzo] [--no-jump] <port> <firmware.bin>" << std::endl;
+  return -1;
+}
+
+int main(int argc, char ** argv)
+{
+  VescFirmwareUploader::Options options;
+  bool jump = true;
+  std::string port;
+  std::string path;
+
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--window") == 0 && has_value) {
+      options.window = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--chunk") == 0 && has_value) {
+      options.chunk_size = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--retries") == 0 && has_value) {
+      options.retries = std::stoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--timeout") == 0 && has_value) {
+      options.chunk_timeout = std::chrono::milliseconds(std::stoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--lzo") == 0) {
+      options.lzo = true;
+    } else if (std::strcmp(argv[i], "--no-jump") == 0) {
+      jump = false;
+    } else if (argv[i][0] == '-') {
+      return usage(argv[0]);
+    } else if (port.empty()) {
+      port = argv[i];
+    } else if (path.empty()) {
+      path = argv[i];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (port.empty() || path.empty()) {
+    return usage(argv[0]);
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Unable to read " << path << std::endl;
+    return -1;
+  }
+  Buffer firmware((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  VescInterface vesc;
+  VescFirmwareUploader uploader(&vesc, options);
+  vesc.setPacketHandler(
+    [&uploader](const vesc_driver::VescPacketConstPtr & packet) {
+      uploader.handlePacket(packet);
+    });
+  vesc.setErrorHandler(
+    [](const std::string & error) {
+      std::cerr << std::endl << error << std::endl;
+    });
+
+  try {
+    vesc.connect(port);
+  } catch (const vesc_driver::SerialException & e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  std::cout << "Uploading " << firmware.size() << " bytes to " << port << std::endl;
+  VescFirmwareUploader::Result result = uploader.upload(
+    firmware, [](size_t done, size_t total) {
+      std::cout << "\r" << std::setw(3) << (100 * done / total) << "% " << done << "/" << total <<
+        std::flush;
+    });
+  std::cout << std::endl;
+
+  if (!result.success) {
+    std::cerr << "Upload failed: " << result.error << std::endl;
+    return -1;
+  }
+
+  std::cout << std::fixed << std::setprecision(2) <<
+    "Erased in " << result.erase_seconds << " s, wrote " << result.image_bytes << " bytes in " <<
+    result.write_seconds << " s (" << result.throughput() / 1024.0 << " KiB/s), " <<
+    result.wire_bytes << " bytes on the wire, " << result.chunks << " chunks, " << result.resent <<
+    " resent" << std::endl;
+
+  if (jump) {
+    std::cout << "Starting the bootloader, the VESC reboots into the new firmware" << std::endl;
+    uploader.jumpToBootloader();
+    // let the write go out before the port is closed
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return 0;
+}
@@ -30,8 +30,18 @@
 
 #include "vesc_driver/vesc_interface.hpp"
 
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -42,21 +52,131 @@
 #include <vector>
 
 #include "vesc_driver/vesc_packet_factory.hpp"
+#include "vesc_driver/vesc_reactor.hpp"
+#include "vesc_driver/vesc_serial_baud.hpp"
+#include "vesc_driver/vesc_serial_latency.hpp"
 #include "serial_driver/serial_driver.hpp"
 
 namespace vesc_driver
 {
 
+namespace
+{
+
+/**
+ * Bytes the reactor mode queues for a port that does not take them, e.g. with hardware flow control
+ * and the vesc not reading, before further frames are dropped. Far more than an upload window.
+ */
+const size_t MAX_TX_QUEUE = 64 * 1024;
+
+/** The termios constant for @p baud_rate, B0 if there is none */
+speed_t termiosSpeed(uint32_t baud_rate)
+{
+  switch (baud_rate) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 576000: return B576000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1152000: return B1152000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 2500000: return B2500000;
+    case 3000000: return B3000000;
+    case 3500000: return B3500000;
+    case 4000000: return B4000000;
+    default: return B0;
+  }
+}
+
+/**
+ * Open @p port in raw mode with the link settings in @p config, non-blocking for the reactor.
+ *
+ * @return The file descriptor, or -1 and sets @p error.
+ */
+int openSerialPort(const std::string & port, const VescSerialConfig & config, std::string * error)
+{
+  if (config.stop_bits == VescSerialConfig::StopBits::ONE_POINT_FIVE) {
+    *error = "1.5 stop bits are not supported by termios";
+    return -1;
+  }
+
+  int fd = ::open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    *error = std::string("open failed: ") + std::strerror(errno);
+    return -1;
+  }
+
+  struct termios tty;
+  if (::tcgetattr(fd, &tty) != 0) {
+    *error = std::string("tcgetattr failed: ") + std::strerror(errno);
+    ::close(fd);
+    return -1;
+  }
+  ::cfmakeraw(&tty);
+  speed_t speed = termiosSpeed(config.baud_rate);
+  ::cfsetspeed(&tty, speed != B0 ? speed : B115200);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~(CRTSCTS | PARENB | PARODD | CSTOPB);
+  tty.c_iflag &= ~(IXON | IXOFF);
+  switch (config.flow_control) {
+    case VescSerialConfig::FlowControl::NONE: break;
+    case VescSerialConfig::FlowControl::HARDWARE: tty.c_cflag |= CRTSCTS; break;
+    case VescSerialConfig::FlowControl::SOFTWARE: tty.c_iflag |= IXON | IXOFF; break;
+  }
+  switch (config.parity) {
+    case VescSerialConfig::Parity::NONE: break;
+    case VescSerialConfig::Parity::ODD: tty.c_cflag |= PARENB | PARODD; break;
+    case VescSerialConfig::Parity::EVEN: tty.c_cflag |= PARENB; break;
+  }
+  if (config.stop_bits == VescSerialConfig::StopBits::TWO) {
+    tty.c_cflag |= CSTOPB;
+  }
+  // reads return whatever is there, the reactor only reads once epoll reports data
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+  if (::tcsetattr(fd, TCSANOW, &tty) != 0) {
+    *error = std::string("tcsetattr failed: ") + std::strerror(errno);
+    ::close(fd);
+    return -1;
+  }
+
+  if (speed == B0 && !setCustomBaudRate(port, config.baud_rate, error)) {
+    ::close(fd);
+    return -1;
+  }
+  ::tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+}  // namespace
+
 class VescInterface::Impl
 {
 public:
-  Impl()
-  : owned_ctx{new IoContext(2)},
-    serial_driver_{new drivers::serial_driver::SerialDriver(*owned_ctx)}
-  {}
+  Impl() = default;
   void packet_creation_thread();
   void on_configure();
-  void connect(const std::string & port);
+  void connect(const std::string & port, const VescSerialConfig & config);
+
+  /** Append received bytes to the buffer and hand every complete frame to the packet handler */
+  void processBytes(const uint8_t * data, size_t size);
+
+  /** Whether @p packet answers an outstanding measureRoundTrip() request, and record it if so */
+  bool takeProbeReply(const VescPacket & packet);
+
+  // reactor mode
+  void connectReactor(const std::string & port, const VescSerialConfig & config);
+  void onEvents(uint32_t events);
+  void closeReactorPort();
+  bool queueReactor(const Buffer & frame, std::string * error);
+  void flushReactor();
 
   bool packet_thread_run_;
   std::unique_ptr<std::thread> packet_thread_;
@@ -64,8 +184,28 @@ public:
   ErrorHandlerFunction error_handler_;
   std::unique_ptr<drivers::serial_driver::SerialPortConfig> device_config_;
   std::string device_name_;
+  // created on the first threaded connect(), the reactor mode runs without them
   std::unique_ptr<IoContext> owned_ctx{};
   std::unique_ptr<drivers::serial_driver::SerialDriver> serial_driver_;
+  std::mutex send_mutex_;
+
+  std::shared_ptr<VescReactor> reactor_;  ///< services the port if set, instead of the threads
+  std::atomic<int> fd_{-1};               ///< port opened in reactor mode
+  Buffer tx_queue_;                       ///< reactor mode: bytes not written yet, send_mutex_
+
+  // round trip probe, see measureRoundTrip()
+  std::atomic<bool> probe_pending_{false};
+  std::chrono::steady_clock::time_point probe_reply_time_;
+  std::mutex probe_mutex_;
+  std::condition_variable probe_cv_;
+
+  // link statistics
+  std::atomic<uint64_t> rx_bytes_{0};
+  std::atomic<uint64_t> rx_packets_{0};
+  std::atomic<uint64_t> tx_bytes_{0};
+  std::atomic<uint64_t> tx_packets_{0};
+  std::atomic<uint64_t> parse_errors_{0};
+  std::atomic<uint64_t> dropped_bytes_{0};
 
   ~Impl()
   {
@@ -75,87 +215,273 @@ public:
   }
 
 private:
-  std::vector<uint8_t> buffer_;
+  // receive state, per instance so that several interfaces can run in one process
+  Buffer rx_chunk_ = Buffer(2048, 0);  ///< bytes of one read from the port
+  Buffer buffer_;                      ///< received bytes not yet parsed into packets
 };
 
 void VescInterface::Impl::packet_creation_thread()
 {
-  static auto temp_buffer = Buffer(2048, 0);
   while (packet_thread_run_) {
-    const auto bytes_read = serial_driver_->port()->receive(temp_buffer);
-    buffer_.reserve(buffer_.size() + temp_buffer.size());
-    buffer_.insert(buffer_.end(), temp_buffer.begin(), temp_buffer.begin() + bytes_read);
-    int bytes_needed = VescFrame::VESC_MIN_FRAME_SIZE;
-    if (!buffer_.empty()) {
-      // search buffer for valid packet(s)
-      auto iter = buffer_.begin();
-      auto iter_begin = buffer_.begin();
-      while (iter != buffer_.end()) {
-        // check if valid start-of-frame character
-        if (VescFrame::VESC_SOF_VAL_SMALL_FRAME == *iter ||
-          VescFrame::VESC_SOF_VAL_LARGE_FRAME == *iter)
-        {
-          // good start, now attempt to create packet
-          std::string error;
-          VescPacketConstPtr packet =
-            VescPacketFactory::createPacket(iter, buffer_.end(), &bytes_needed, &error);
-          if (packet) {
-            // good packet, check if we skipped any data
-            if (std::distance(iter_begin, iter) > 0) {
-              std::ostringstream ss;
-              ss << "Out-of-sync with VESC, unknown data leading valid frame. Discarding " <<
-                std::distance(iter_begin, iter) << " bytes.";
-              error_handler_(ss.str());
-            }
-            // call packet handler
+    // receive() blocks until bytes arrive, so streamed packets are handled as soon as they are read
+    const auto bytes_read = serial_driver_->port()->receive(rx_chunk_);
+    processBytes(rx_chunk_.data(), bytes_read);
+  }
+}
+
+void VescInterface::Impl::processBytes(const uint8_t * data, size_t size)
+{
+  rx_bytes_.fetch_add(size, std::memory_order_relaxed);
+  buffer_.insert(buffer_.end(), data, data + size);
+  int bytes_needed = VescFrame::VESC_MIN_FRAME_SIZE;
+  if (!buffer_.empty()) {
+    // search buffer for valid packet(s)
+    auto iter = buffer_.begin();
+    auto iter_begin = buffer_.begin();
+    while (iter != buffer_.end()) {
+      // check if valid start-of-frame character
+      if (VescFrame::VESC_SOF_VAL_SMALL_FRAME == *iter ||
+        VescFrame::VESC_SOF_VAL_LARGE_FRAME == *iter)
+      {
+        // good start, now attempt to create packet
+        std::string error;
+        VescPacketConstPtr packet =
+          VescPacketFactory::createPacket(iter, buffer_.end(), &bytes_needed, &error);
+        if (packet) {
+          // good packet, check if we skipped any data
+          if (std::distance(iter_begin, iter) > 0) {
+            std::ostringstream ss;
+            dropped_bytes_.fetch_add(std::distance(iter_begin, iter), std::memory_order_relaxed);
+            ss << "Out-of-sync with VESC, unknown data leading valid frame. Discarding " <<
+              std::distance(iter_begin, iter) << " bytes.";
+            error_handler_(ss.str());
+          }
+          // call packet handler
+          rx_packets_.fetch_add(1, std::memory_order_relaxed);
+          if (!takeProbeReply(*packet)) {
             packet_handler_(packet);
-            // update state
-            iter = iter + packet->frame().size();
-            iter_begin = iter;
-            // continue to look for another frame in buffer
-            continue;
-          } else if (bytes_needed > 0) {
-            // need more data, break out of while loop
-            break;  // for (iter_sof...
-          } else {
-            // else, this was not a packet, move on to next byte
-            error_handler_(error);
           }
+          // update state
+          iter = iter + packet->frame().size();
+          iter_begin = iter;
+          // continue to look for another frame in buffer
+          continue;
+        } else if (bytes_needed > 0) {
+          // need more data, break out of while loop
+          break;  // for (iter_sof...
+        } else {
+          // else, this was not a packet, move on to next byte
+          parse_errors_.fetch_add(1, std::memory_order_relaxed);
+          error_handler_(error);
         }
-
-        iter++;
       }
 
-      // if iter is at the end of the buffer, more bytes are needed
-      if (iter == buffer_.end()) {
-        bytes_needed = VescFrame::VESC_MIN_FRAME_SIZE;
-      }
+      iter++;
+    }
 
-      // erase "used" buffer
-      if (std::distance(iter_begin, iter) > 0) {
-        std::ostringstream ss;
-        ss << "Out-of-sync with VESC, discarding " << std::distance(iter_begin, iter) << " bytes.";
-        error_handler_(ss.str());
-      }
-      buffer_.erase(buffer_.begin(), iter);
+    // if iter is at the end of the buffer, more bytes are needed
+    if (iter == buffer_.end()) {
+      bytes_needed = VescFrame::VESC_MIN_FRAME_SIZE;
     }
-    // Only attempt to read every 5 ms
-    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    // erase "used" buffer
+    if (std::distance(iter_begin, iter) > 0) {
+      std::ostringstream ss;
+      dropped_bytes_.fetch_add(std::distance(iter_begin, iter), std::memory_order_relaxed);
+      ss << "Out-of-sync with VESC, discarding " << std::distance(iter_begin, iter) << " bytes.";
+      error_handler_(ss.str());
+    }
+    buffer_.erase(buffer_.begin(), iter);
+  }
+}
+
+bool VescInterface::Impl::takeProbeReply(const VescPacket & packet)
+{
+  if (!probe_pending_.load(std::memory_order_relaxed) || packet.name() != "FWVersion") {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(probe_mutex_);
+  if (!probe_pending_) {
+    return false;
   }
+  probe_reply_time_ = now;
+  probe_pending_ = false;
+  probe_cv_.notify_all();
+  return true;
 }
 
-void VescInterface::Impl::connect(const std::string & port)
+void VescInterface::Impl::connect(const std::string & port, const VescSerialConfig & config)
 {
-  uint32_t baud_rate = 115200;
-  auto fc = drivers::serial_driver::FlowControl::HARDWARE;
-  auto pt = drivers::serial_driver::Parity::NONE;
-  auto sb = drivers::serial_driver::StopBits::ONE;
+  using drivers::serial_driver::FlowControl;
+  using drivers::serial_driver::Parity;
+  using drivers::serial_driver::StopBits;
+
+  FlowControl fc = FlowControl::HARDWARE;
+  switch (config.flow_control) {
+    case VescSerialConfig::FlowControl::NONE: fc = FlowControl::NONE; break;
+    case VescSerialConfig::FlowControl::HARDWARE: fc = FlowControl::HARDWARE; break;
+    case VescSerialConfig::FlowControl::SOFTWARE: fc = FlowControl::SOFTWARE; break;
+  }
+  Parity pt = Parity::NONE;
+  switch (config.parity) {
+    case VescSerialConfig::Parity::NONE: pt = Parity::NONE; break;
+    case VescSerialConfig::Parity::ODD: pt = Parity::ODD; break;
+    case VescSerialConfig::Parity::EVEN: pt = Parity::EVEN; break;
+  }
+  StopBits sb = StopBits::ONE;
+  switch (config.stop_bits) {
+    case VescSerialConfig::StopBits::ONE: sb = StopBits::ONE; break;
+    case VescSerialConfig::StopBits::ONE_POINT_FIVE: sb = StopBits::ONE_POINT_FIVE; break;
+    case VescSerialConfig::StopBits::TWO: sb = StopBits::TWO; break;
+  }
+
+  // asio only knows the termios Bxxx rates, open others at 115200 and change the rate afterwards
+  bool standard_rate = isStandardBaudRate(config.baud_rate);
+  uint32_t baud_rate = standard_rate ? config.baud_rate : 115200;
+  if (!serial_driver_) {
+    owned_ctx = std::make_unique<IoContext>(2);
+    serial_driver_ = std::make_unique<drivers::serial_driver::SerialDriver>(*owned_ctx);
+  }
   device_config_ =
     std::make_unique<drivers::serial_driver::SerialPortConfig>(baud_rate, fc, pt, sb);
   serial_driver_->init_port(port, *device_config_);
   if (!serial_driver_->port()->is_open()) {
     serial_driver_->port()->open();
   }
+
+  std::string error;
+  if (!standard_rate && !setCustomBaudRate(port, config.baud_rate, &error)) {
+    serial_driver_->port()->close();
+    throw std::runtime_error(error);
+  }
+  device_name_ = port;
+  buffer_.clear();
+}
+
+void VescInterface::Impl::connectReactor(
+  const std::string & port, const VescSerialConfig & config)
+{
+  std::string error;
+  int fd = openSerialPort(port, config, &error);
+  if (fd < 0) {
+    throw std::runtime_error(error);
+  }
+  device_name_ = port;
+  buffer_.clear();
+  tx_queue_.clear();
+  fd_ = fd;
+  if (!reactor_->addFd(fd, [this](uint32_t events) {onEvents(events);})) {
+    error = std::string("Unable to watch the port: ") + std::strerror(errno);
+    fd_ = -1;
+    ::close(fd);
+    throw std::runtime_error(error);
+  }
+}
+
+/** Called on the reactor thread when the port is readable, writable or failed */
+void VescInterface::Impl::onEvents(uint32_t events)
+{
+  if (events & EPOLLOUT) {
+    flushReactor();
+  }
+  bool closed = (events & (EPOLLERR | EPOLLHUP)) != 0;
+  if (!closed && !(events & EPOLLIN)) {
+    return;
+  }
+  while (!closed) {
+    ssize_t n = ::read(fd_, rx_chunk_.data(), rx_chunk_.size());
+    if (n > 0) {
+      processBytes(rx_chunk_.data(), n);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      // with VMIN = 0 a tty returns 0 rather than EAGAIN once drained, a hang up shows as EPOLLHUP
+      closed = n < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+      break;
+    }
+  }
+  if (closed) {
+    error_handler_("Serial port to the VESC closed.");
+    closeReactorPort();
+  }
+}
+
+void VescInterface::Impl::closeReactorPort()
+{
+  int fd = fd_.load();
+  if (fd < 0) {
+    return;
+  }
+  // after removeFd() returns onEvents() is not running, unless this is onEvents()
+  reactor_->removeFd(fd);
+  std::lock_guard<std::mutex> lock(send_mutex_);
+  if (fd_.compare_exchange_strong(fd, -1)) {
+    ::close(fd);
+  }
+  tx_queue_.clear();
+}
+
+/**
+ * Queue @p frame for the reactor thread, the caller holds send_mutex_. The port is written from
+ * the reactor thread only, once epoll reports room, so frames go out in the order they were sent
+ * and a stalled port does not block the sender.
+ *
+ * @return false if the port is closed or the queue is full, and sets @p error.
+ */
+bool VescInterface::Impl::queueReactor(const Buffer & frame, std::string * error)
+{
+  int fd = fd_.load();
+  if (fd < 0) {
+    return false;
+  }
+  if (tx_queue_.size() + frame.size() > MAX_TX_QUEUE) {
+    std::ostringstream ss;
+    ss << "The VESC does not take the writes, dropped a frame with " << tx_queue_.size() <<
+      " bytes queued.";
+    *error = ss.str();
+    return false;
+  }
+  bool idle = tx_queue_.empty();
+  tx_queue_.insert(tx_queue_.end(), frame.begin(), frame.end());
+  if (idle) {
+    reactor_->setWritable(fd, true);
+  }
+  return true;
+}
+
+/** Called on the reactor thread when the port has room, writes as much of the queue as it takes */
+void VescInterface::Impl::flushReactor()
+{
+  std::string error;
+  {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    int fd = fd_.load();
+    size_t sent = 0;
+    while (fd >= 0 && sent < tx_queue_.size()) {
+      ssize_t n = ::write(fd, tx_queue_.data() + sent, tx_queue_.size() - sent);
+      if (n >= 0) {
+        sent += n;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      } else if (errno != EINTR) {
+        std::ostringstream ss;
+        ss << "Write to the VESC failed, dropped " << tx_queue_.size() - sent << " bytes: " <<
+          std::strerror(errno);
+        error = ss.str();
+        sent = tx_queue_.size();
+      }
+    }
+    tx_bytes_.fetch_add(sent, std::memory_order_relaxed);
+    tx_queue_.erase(tx_queue_.begin(), tx_queue_.begin() + sent);
+    if (fd >= 0 && tx_queue_.empty()) {
+      reactor_->setWritable(fd, false);
+    }
+  }
+  // reported outside the lock, the handler may well send something itself
+  if (!error.empty()) {
+    error_handler_(error);
+  }
 }
 
 VescInterface::VescInterface(
@@ -183,13 +509,40 @@ void VescInterface::setPacketHandler(const PacketHandlerFunction & handler)
   impl_->packet_handler_ = handler;
 }
 
+void VescInterface::setReactor(std::shared_ptr<VescReactor> reactor)
+{
+  if (isConnected()) {
+    throw SerialException("Cannot change the reactor while connected.");
+  }
+  impl_->reactor_ = reactor;
+}
+
 void VescInterface::setErrorHandler(const ErrorHandlerFunction & handler)
 {
   // todo - definately need mutex
   impl_->error_handler_ = handler;
 }
 
-void VescInterface::connect(const std::string & port)
+double VescSerialConfig::bitsPerByte() const
+{
+  double bits = 1.0 + 8.0;  // start and data bits
+  if (parity != Parity::NONE) {
+    bits += 1.0;
+  }
+  switch (stop_bits) {
+    case StopBits::ONE: bits += 1.0; break;
+    case StopBits::ONE_POINT_FIVE: bits += 1.5; break;
+    case StopBits::TWO: bits += 2.0; break;
+  }
+  return bits;
+}
+
+double VescSerialConfig::bytesPerSecond() const
+{
+  return baud_rate / bitsPerByte();
+}
+
+void VescInterface::connect(const std::string & port, const VescSerialConfig & config)
 {
   // todo - mutex?
 
@@ -199,7 +552,11 @@ void VescInterface::connect(const std::string & port)
 
   // connect to serial port
   try {
-    impl_->connect(port);
+    if (impl_->reactor_) {
+      impl_->connectReactor(port, config);
+      return;
+    }
+    impl_->connect(port, config);
   } catch (const std::exception & e) {
     std::stringstream ss;
     ss << "Failed to open the serial port " << port << " to the VESC. " << e.what();
@@ -217,7 +574,9 @@ void VescInterface::disconnect()
 {
   // todo - mutex?
 
-  if (isConnected()) {
+  if (impl_->reactor_) {
+    impl_->closeReactorPort();
+  } else if (isConnected()) {
     // bring down read thread
     impl_->packet_thread_run_ = false;
     requestFWVersion();
@@ -228,6 +587,12 @@ void VescInterface::disconnect()
 
 bool VescInterface::isConnected() const
 {
+  if (impl_->reactor_) {
+    return impl_->fd_ >= 0;
+  }
+  if (!impl_->serial_driver_) {
+    return false;
+  }
   auto port = impl_->serial_driver_->port();
   if (port) {
     return port->is_open();
@@ -238,7 +603,95 @@ bool VescInterface::isConnected() const
 
 void VescInterface::send(const VescPacket & packet)
 {
-  impl_->serial_driver_->port()->async_send(packet.frame());
+  // the frame of a temporary packet must not be referenced after returning, it is written or
+  // copied to the reactor's queue here, and frames from different threads must not interleave
+  std::string error;
+  {
+    bool written = true;
+    std::lock_guard<std::mutex> lock(impl_->send_mutex_);
+    const Buffer & frame = packet.frame();
+    if (impl_->reactor_) {
+      // the bytes are counted once the reactor thread wrote them
+      written = impl_->queueReactor(frame, &error);
+    } else {
+      size_t sent = impl_->serial_driver_->port()->send(frame);
+      while (sent < frame.size()) {
+        sent += impl_->serial_driver_->port()->send(Buffer(frame.begin() + sent, frame.end()));
+      }
+      impl_->tx_bytes_.fetch_add(frame.size(), std::memory_order_relaxed);
+    }
+    if (written) {
+      impl_->tx_packets_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  // reported outside the lock, the handler may well send something itself
+  if (!error.empty()) {
+    impl_->error_handler_(error);
+  }
+}
+
+VescInterface::Statistics VescInterface::statistics() const
+{
+  Statistics stats;
+  stats.rx_bytes = impl_->rx_bytes_.load(std::memory_order_relaxed);
+  stats.rx_packets = impl_->rx_packets_.load(std::memory_order_relaxed);
+  stats.tx_bytes = impl_->tx_bytes_.load(std::memory_order_relaxed);
+  stats.tx_packets = impl_->tx_packets_.load(std::memory_order_relaxed);
+  stats.parse_errors = impl_->parse_errors_.load(std::memory_order_relaxed);
+  stats.dropped_bytes = impl_->dropped_bytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+bool VescInterface::setLowLatency(std::string * error)
+{
+  if (!isConnected()) {
+    *error = "not connected";
+    return false;
+  }
+  const std::string & port = impl_->device_name_;
+  std::vector<std::string> errors;
+  std::string step_error;
+  if (!setSerialLowLatency(port, &step_error)) {
+    errors.push_back(step_error);
+  }
+  // most USB-serial adapters buffer in hardware, only the FTDI driver lets that be shortened
+  if (!ftdiLatencyTimerPath(port).empty() && !setFtdiLatencyTimer(port, 1, &step_error)) {
+    errors.push_back(step_error);
+  }
+
+  error->clear();
+  for (const auto & e : errors) {
+    *error += (error->empty() ? "" : "; ") + e;
+  }
+  return errors.empty();
+}
+
+double VescInterface::measureRoundTrip(int samples, std::chrono::milliseconds timeout)
+{
+  std::vector<double> round_trips;
+  for (int i = 0; i < samples && isConnected(); i++) {
+    {
+      std::lock_guard<std::mutex> lock(impl_->probe_mutex_);
+      impl_->probe_pending_ = true;
+    }
+    auto start = std::chrono::steady_clock::now();
+    requestFWVersion();
+
+    std::unique_lock<std::mutex> lock(impl_->probe_mutex_);
+    if (impl_->probe_cv_.wait_for(lock, timeout, [this] {return !impl_->probe_pending_;})) {
+      round_trips.push_back(
+        std::chrono::duration<double>(impl_->probe_reply_time_ - start).count());
+    } else {
+      // a late reply goes to the packet handler
+      impl_->probe_pending_ = false;
+    }
+  }
+  if (round_trips.empty()) {
+    return -1.0;
+  }
+  std::nth_element(
+    round_trips.begin(), round_trips.begin() + round_trips.size() / 2, round_trips.end());
+  return round_trips[round_trips.size() / 2];
 }
 
 void VescInterface::requestFWVersion()
@@ -281,9 +734,24 @@ void VescInterface::setServo(double servo)
   send(VescPacketSetServoPos(servo));
 }
 
-void VescInterface::requestImuData()
+void VescInterface::requestImuData(uint16_t mask)
+{
+  send(VescPacketRequestImu(mask));
+}
+
+void VescInterface::requestSamples(uint8_t mode, uint16_t sample_len, uint8_t decimation)
+{
+  send(VescPacketRequestSample(mode, sample_len, decimation));
+}
+
+void VescInterface::setRotorPositionMode(uint8_t mode)
+{
+  send(VescPacketSetDetect(mode));
+}
+
+void VescInterface::sendTerminalCommand(const std::string & command)
 {
-  send(VescPacketRequestImu());
+  send(VescPacketTerminalCmd(command));
 }
 
 }  // namespace vesc_driver
@@ -0,0 +1,299 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+// Measure the CPU the driver's serial I/O costs per number of VESCs, with a receive thread, an
+// asio context and a poll thread per device ("threads", like one driver process per VESC) against
+// one shared reactor ("reactor", like single_io_thread with the drivers in one process).
+//
+//   vesc_io_benchmark [options] [port...]
+//
+//   --devices LIST    device counts to measure, e.g. 1,2,4,6 (default), simulated VESCs
+//   --rate HZ         telemetry and IMU polls per second and device (default 50)
+//   --duration S      measuring time per run (default 5)
+//   --simulator PATH  vesc_simulator to start (default the one next to this program)
+//   --mode MODE       threads, reactor or both (default)
+//
+// Without ports a vesc_simulator with the largest device count is started. With ports given the
+// devices on them are measured instead, all of them in every run. Prints the process CPU load,
+// the threads in the process and the replies received per second.
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vesc_driver/vesc_interface.hpp"
+#include "vesc_driver/vesc_reactor.hpp"
+
+using vesc_driver::VescInterface;
+using vesc_driver::VescReactor;
+
+namespace
+{
+
+struct RunResult
+{
+  int threads = 0;
+  double cpu_percent = 0.0;
+  double replies_per_second = 0.0;
+  uint64_t errors = 0;
+};
+
+/** User and system CPU time of this process, seconds */
+double cpuSeconds()
+{
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/** Threads in this process, from /proc */
+int threadCount()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 8, "Threads:") == 0) {
+      return std::stoi(line.substr(8));
+    }
+  }
+  return -1;
+}
+
+/** Start vesc_simulator with @p count devices, return their ports or nothing if it failed */
+std::vector<std::string> startSimulator(const std::string & path, int count, pid_t * pid)
+{
+  int fds[2];
+  if (::pipe(fds) != 0) {
+    return {};
+  }
+  *pid = ::fork();
+  if (*pid == 0) {
+    ::dup2(fds[1], STDOUT_FILENO);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    std::string count_arg = std::to_string(count);
+    ::execl(path.c_str(), path.c_str(), "--count", count_arg.c_str(), static_cast<char *>(nullptr));
+    ::_exit(127);
+  }
+  ::close(fds[1]);
+
+  std::vector<std::string> ports;
+  FILE * out = ::fdopen(fds[0], "r");
+  char line[256];
+  while (static_cast<int>(ports.size()) < count && out && std::fgets(line, sizeof(line), out)) {
+    std::string port(line);
+    port.erase(port.find_last_not_of("\r\n") + 1);
+    ports.push_back(port);
+  }
+  if (out) {
+    std::fclose(out);
+  }
+  return ports;
+}
+
+RunResult run(
+  const std::vector<std::string> & ports, bool reactor_mode, double rate, double duration)
+{
+  std::atomic<uint64_t> replies{0};
+  std::atomic<uint64_t> errors{0};
+
+  std::shared_ptr<VescReactor> reactor;
+  if (reactor_mode) {
+    reactor = std::make_shared<VescReactor>();
+  }
+  std::vector<std::unique_ptr<VescInterface>> vescs;
+  for (const auto & port : ports) {
+    vescs.emplace_back(new VescInterface());
+    vescs.back()->setPacketHandler(
+      [&replies](const vesc_driver::VescPacketConstPtr &) {replies++;});
+    vescs.back()->setErrorHandler([&errors](const std::string &) {errors++;});
+    if (reactor) {
+      vescs.back()->setReactor(reactor);
+    }
+    vescs.back()->connect(port);
+  }
+
+  // one telemetry and one IMU request per tick, as the driver polls
+  auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::duration<double>(1.0 / rate));
+  std::vector<VescReactor::TimerId> timers;
+  std::vector<std::thread> pollers;
+  std::atomic<bool> polling{true};
+  for (auto & vesc : vescs) {
+    VescInterface * v = vesc.get();
+    auto poll = [v] {
+        v->requestState();
+        v->requestImuData();
+      };
+    if (reactor) {
+      timers.push_back(reactor->addPollTimer(period, poll));
+    } else {
+      pollers.emplace_back(
+        [&polling, period, poll] {
+          auto next = std::chrono::steady_clock::now();
+          while (polling) {
+            poll();
+            next += period;
+            std::this_thread::sleep_until(next);
+          }
+        });
+    }
+  }
+
+  // let the link settle, then measure
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  RunResult result;
+  result.threads = threadCount();
+  replies = 0;
+  errors = 0;
+  double cpu_start = cpuSeconds();
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+  double cpu = cpuSeconds() - cpu_start;
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.cpu_percent = 100.0 * cpu / wall;
+  result.replies_per_second = replies / wall;
+  result.errors = errors;
+
+  for (auto id : timers) {
+    reactor->removePollTimer(id);
+  }
+  polling = false;
+  for (auto & poller : pollers) {
+    poller.join();
+  }
+  vescs.clear();
+  return result;
+}
+
+int usage(const char * name)
+{
+  std::cerr << "Usage: " << name << " [--devices LIST] [--rate HZ] [--duration S] "
+    "[--simulator PATH] [--mode threads|reactor|both] [port...]" << std::endl;
+  return -1;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::vector<int> device_counts = {1, 2, 4, 6};
+  double rate = 50.0;
+  double duration = 5.0;
+  std::string mode = "both";
+  std::string simulator = std::string(argv[0]);
+  simulator = simulator.substr(0, simulator.find_last_of('/') + 1) + "vesc_simulator";
+  std::vector<std::string> ports;
+
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--devices") == 0 && has_value) {
+      device_counts.clear();
+      std::stringstream list(argv[++i]);
+      std::string count;
+      while (std::getline(list, count, ',')) {
+        device_counts.push_back(std::max(1, std::stoi(count)));
+      }
+    } else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {
+      rate = std::stod(argv[++i]);
+    } else if (std::strcmp(argv[i], "--duration") == 0 && has_value) {
+      duration = std::stod(argv[++i]);
+    } else if (std::strcmp(argv[i], "--simulator") == 0 && has_value) {
+      simulator = argv[++i];
+    } else if (std::strcmp(argv[i], "--mode") == 0 && has_value) {
+      mode = argv[++i];
+    } else if (argv[i][0] == '-') {
+      return usage(argv[0]);
+    } else {
+      ports.push_back(argv[i]);
+    }
+  }
+  if (device_counts.empty() || rate <= 0.0 || duration <= 0.0 ||
+    (mode != "threads" && mode != "reactor" && mode != "both"))
+  {
+    return usage(argv[0]);
+  }
+
+  pid_t simulator_pid = -1;
+  if (ports.empty()) {
+    int max_count = *std::max_element(device_counts.begin(), device_counts.end());
+    ports = startSimulator(simulator, max_count, &simulator_pid);
+    if (static_cast<int>(ports.size()) != max_count) {
+      std::cerr << "Unable to start " << simulator << std::endl;
+      return -1;
+    }
+  } else {
+    device_counts = {static_cast<int>(ports.size())};
+  }
+
+  std::cout << "devices  mode      threads  cpu [%]  replies/s  errors" << std::endl;
+  int status = 0;
+  for (int count : device_counts) {
+    std::vector<std::string> run_ports(ports.begin(), ports.begin() + count);
+    for (bool reactor_mode : {false, true}) {
+      if ((reactor_mode && mode == "threads") || (!reactor_mode && mode == "reactor")) {
+        continue;
+      }
+      try {
+        RunResult result = run(run_ports, reactor_mode, rate, duration);
+        std::cout << std::setw(7) << count << "  " << std::left << std::setw(8) <<
+          (reactor_mode ? "reactor" : "threads") << std::right << std::setw(9) << result.threads <<
+          std::fixed << std::setprecision(2) << std::setw(9) << result.cpu_percent <<
+          std::setprecision(1) << std::setw(11) << result.replies_per_second <<
+          std::setw(8) << result.errors << std::endl;
+      } catch (const std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        status = -1;
+      }
+    }
+  }
+
+  if (simulator_pid > 0) {
+    ::kill(simulator_pid, SIGTERM);
+    ::waitpid(simulator_pid, nullptr, 0);
+  }
+  return status;
+}
@@ -30,11 +30,15 @@
 
 #include "vesc_driver/vesc_packet.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <string>
-#include <cmath>
 
 #include "vesc_driver/datatypes.hpp"
 #include "vesc_driver/vesc_packet_factory.hpp"
@@ -43,6 +47,199 @@
 namespace vesc_driver
 {
 
+namespace
+{
+
+// Payload layouts, in the order the firmware's commands.c writes the fields
+
+/** COMM_GET_VALUES reply (firmware 5) */
+enum ValuesField
+{
+  VALUES_TEMP_FET,
+  VALUES_TEMP_MOTOR,
+  VALUES_AVG_MOTOR_CURRENT,
+  VALUES_AVG_INPUT_CURRENT,
+  VALUES_AVG_ID,
+  VALUES_AVG_IQ,
+  VALUES_DUTY_CYCLE_NOW,
+  VALUES_RPM,
+  VALUES_V_IN,
+  VALUES_AMP_HOURS,
+  VALUES_AMP_HOURS_CHARGED,
+  VALUES_WATT_HOURS,
+  VALUES_WATT_HOURS_CHARGED,
+  VALUES_TACHOMETER,
+  VALUES_TACHOMETER_ABS,
+  VALUES_FAULT_CODE,
+  VALUES_PID_POS_NOW,
+  VALUES_CONTROLLER_ID,
+  VALUES_TEMP_MOS1,
+  VALUES_TEMP_MOS2,
+  VALUES_TEMP_MOS3,
+  VALUES_AVG_VD,
+  VALUES_AVG_VQ
+};
+typedef codec::PacketSchema<COMM_GET_VALUES,
+    codec::Field<int16_t, 10>,       // temp_fet, degC
+    codec::Field<int16_t, 10>,       // temp_motor, degC
+    codec::Field<int32_t, 100>,      // avg_motor_current, A
+    codec::Field<int32_t, 100>,      // avg_input_current, A
+    codec::Field<int32_t, 100>,      // avg_id, A
+    codec::Field<int32_t, 100>,      // avg_iq, A
+    codec::Field<int16_t, 1000>,     // duty_cycle_now
+    codec::Field<int32_t>,           // rpm, electrical
+    codec::Field<int16_t, 10>,       // v_in, V
+    codec::Field<int32_t, 10000>,    // amp_hours, Ah
+    codec::Field<int32_t, 10000>,    // amp_hours_charged, Ah
+    codec::Field<int32_t, 10000>,    // watt_hours, Wh
+    codec::Field<int32_t, 10000>,    // watt_hours_charged, Wh
+    codec::Field<int32_t>,           // tachometer
+    codec::Field<int32_t>,           // tachometer_abs
+    codec::Field<uint8_t>,           // fault_code
+    codec::Field<int32_t, 1000000>,  // pid_pos_now, deg
+    codec::Field<uint8_t>,           // controller_id
+    codec::Field<int16_t, 10>,       // temp_mos1, degC
+    codec::Field<int16_t, 10>,       // temp_mos2, degC
+    codec::Field<int16_t, 10>,       // temp_mos3, degC
+    codec::Field<int32_t, 1000>,     // avg_vd, V
+    codec::Field<int32_t, 1000>      // avg_vq, V
+> ValuesSchema;
+static_assert(ValuesSchema::NUM_FIELDS == VALUES_AVG_VQ + 1, "values fields out of sync");
+static_assert(ValuesSchema::offset<VALUES_FAULT_CODE>() == 53, "values layout changed");
+static_assert(ValuesSchema::PAYLOAD_SIZE == 73, "values layout changed");
+
+// motor commands
+typedef codec::PacketSchema<COMM_SET_DUTY, codec::Field<int32_t, 100000>> SetDutySchema;
+typedef codec::PacketSchema<COMM_SET_CURRENT, codec::Field<int32_t, 1000>> SetCurrentSchema;
+typedef codec::PacketSchema<COMM_SET_CURRENT_BRAKE, codec::Field<int32_t, 1000>>
+  SetCurrentBrakeSchema;
+typedef codec::PacketSchema<COMM_SET_RPM, codec::Field<int32_t>> SetRPMSchema;
+typedef codec::PacketSchema<COMM_SET_POS, codec::Field<int32_t, 1000000>> SetPosSchema;
+typedef codec::PacketSchema<COMM_SET_SERVO_POS, codec::Field<int16_t, 1000>> SetServoPosSchema;
+static_assert(SetCurrentSchema::PAYLOAD_SIZE == 5, "motor command layout changed");
+static_assert(SetServoPosSchema::PAYLOAD_SIZE == 3, "servo command layout changed");
+
+typedef codec::PacketSchema<COMM_SET_MCCONF_TEMP,
+    codec::Field<uint8_t>,           // store
+    codec::Field<uint8_t>,           // forward_can
+    codec::Field<uint8_t>,           // ack
+    codec::Field<uint8_t>,           // divide_by_controllers
+    codec::Float32Auto,              // l_current_min_scale
+    codec::Float32Auto,              // l_current_max_scale
+    codec::Float32Auto,              // l_min_erpm
+    codec::Float32Auto,              // l_max_erpm
+    codec::Float32Auto,              // l_min_duty
+    codec::Float32Auto,              // l_max_duty
+    codec::Float32Auto,              // l_watt_min
+    codec::Float32Auto,              // l_watt_max
+    codec::Float32Auto,              // l_in_current_min
+    codec::Float32Auto               // l_in_current_max
+> SetMcconfTempSchema;
+static_assert(SetMcconfTempSchema::PAYLOAD_SIZE == 45, "mcconf temp layout changed");
+
+typedef codec::PacketSchema<COMM_ROTOR_POSITION, codec::Field<int32_t, 100000>>
+  RotorPositionSchema;
+typedef codec::PacketSchema<COMM_SET_DETECT, codec::Field<uint8_t>> SetDetectSchema;
+typedef codec::PacketSchema<COMM_GET_IMU_DATA, codec::Field<uint16_t>> RequestImuSchema;
+
+/** COMM_SAMPLE_PRINT sample, the float fields in VescPacketSample's field order */
+typedef codec::PacketSchema<COMM_SAMPLE_PRINT,
+    codec::Float32Auto, codec::Float32Auto, codec::Float32Auto, codec::Float32Auto,
+    codec::Float32Auto, codec::Float32Auto, codec::Float32Auto, codec::Float32Auto,
+    codec::Field<uint8_t>,           // status
+    codec::Field<uint8_t>            // phase
+> SampleSchema;
+typedef codec::PacketSchema<COMM_SAMPLE_PRINT,
+    codec::Field<uint8_t>,           // mode
+    codec::Field<uint16_t>,          // sample length
+    codec::Field<uint8_t>            // decimation
+> RequestSampleSchema;
+
+// firmware update, the data follows the fields
+typedef codec::PacketSchema<COMM_ERASE_NEW_APP, codec::Field<uint32_t>> EraseNewAppSchema;
+typedef codec::PacketSchema<COMM_WRITE_NEW_APP_DATA, codec::Field<uint32_t>>
+  WriteNewAppDataSchema;
+typedef codec::PacketSchema<COMM_WRITE_NEW_APP_DATA_LZO,
+    codec::Field<uint32_t>,          // offset
+    codec::Field<uint16_t>           // decompressed size
+> WriteNewAppDataLzoSchema;
+/** Reply to an erase or write, firmware 3 and later echo the write offset after the result */
+typedef codec::PacketSchema<COMM_WRITE_NEW_APP_DATA,
+    codec::Field<uint8_t>,           // ok
+    codec::Field<uint32_t>           // offset
+> WriteNewAppDataResultSchema;
+
+/** Decode fields @p I of @p Schema into @p out, in order */
+template<typename Schema, typename Iter, typename T, size_t ... I>
+void decodeFields(Iter payload, T * out, std::index_sequence<I...>)
+{
+  int expand[] = {0, (out[I] = Schema::template decode<I>(payload), 0)...};
+  (void)expand;
+}
+
+}  // namespace
+
+/**
+ * Decode a value written by the firmware's buffer_append_float32_auto(). For normal numbers the
+ * encoding is bit-for-bit IEEE-754 single precision, so those are copied straight into a float.
+ * Zero and the exponent extremes are rebuilt from exponent and mantissa exactly as the firmware's
+ * buffer_get_float32_auto() does, since they do not map onto IEEE-754 zero / subnormal / inf / NaN.
+ */
+float decodeFloat32Auto(uint32_t res)
+{
+  static_assert(sizeof(float) == sizeof(uint32_t), "float must be 32 bit IEEE-754");
+  static_assert(std::numeric_limits<float>::is_iec559, "float must be 32 bit IEEE-754");
+
+  uint32_t e = (res >> 23) & 0xFF;
+  if (e != 0 && e != 0xFF) {
+    float f;
+    std::memcpy(&f, &res, sizeof(f));
+    return f;
+  }
+
+  int exp = static_cast<int>(e);
+  uint32_t fr = res & 0x7FFFFF;
+  bool negative = res & (1u << 31);
+
+  float f = 0.0;
+  if (exp != 0 || fr != 0) {
+    f = static_cast<float>(fr) / (8388608.0 * 2.0) + 0.5;
+    exp -= 126;
+  }
+
+  if (negative) {
+    f = -f;
+  }
+  return ldexpf(f, exp);
+}
+
+/**
+ * Inverse of decodeFloat32Auto(), following buffer_append_float32_auto(): values too small for a
+ * normal float are flushed to zero, everything else is split into exponent and mantissa.
+ */
+uint32_t encodeFloat32Auto(float number)
+{
+  if (std::fabs(number) < 1.5e-38f) {
+    number = 0.0f;
+  }
+
+  int e = 0;
+  float sig = frexpf(number, &e);
+  float sig_abs = std::fabs(sig);
+  uint32_t sig_i = 0;
+
+  if (sig_abs >= 0.5f) {
+    sig_i = static_cast<uint32_t>((sig_abs - 0.5f) * 2.0f * 8388608.0f);
+    e += 126;
+  }
+
+  uint32_t res = ((static_cast<uint32_t>(e) & 0xFF) << 23) | (sig_i & 0x7FFFFF);
+  if (sig < 0) {
+    res |= 1u << 31;
+  }
+  return res;
+}
+
 constexpr CRC::Parameters<crcpp_uint16, 16> VescFrame::CRC_TYPE;
 
 VescFrame::VescFrame(int payload_size)
@@ -68,6 +265,14 @@ VescFrame::VescFrame(int payload_size)
   *(frame_->end() - 1) = 3;
 }
 
+VescFrame::VescFrame(const uint8_t * frame, size_t frame_size)
+: frame_(new Buffer(frame, frame + frame_size))
+{
+  assert(frame_size >= VESC_MIN_FRAME_SIZE && frame[0] == VESC_SOF_VAL_SMALL_FRAME);
+  payload_.first = frame_->begin() + 2;
+  payload_.second = frame_->end() - 3;
+}
+
 VescFrame::VescFrame(const BufferRangeConst & frame, const BufferRangeConst & payload)
 {
   /* VescPacketFactory::createPacket() should make sure that the input is valid, but run a few cheap
@@ -97,6 +302,14 @@ VescPacket::VescPacket(const std::string & name, std::shared_ptr<VescFrame> raw)
 {
 }
 
+void VescPacket::writeCrc()
+{
+  uint16_t crc = CRC::Calculate(
+    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
+  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
+  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+}
+
 /*------------------------------------------------------------------------------------------------*/
 
 VescPacketFWVersion::VescPacketFWVersion(std::shared_ptr<VescFrame> raw)
@@ -138,6 +351,18 @@ const uint8_t * VescPacketFWVersion::uuid() const
 {
   return uuid_;
 }
+std::string VescPacketFWVersion::uuidString() const
+{
+  char uuid_data[32];
+  snprintf(
+    uuid_data, sizeof(uuid_data),
+    "%02x%02x%02x-%02x%02x%02x-%02x%02x%02x-%02x%02x%02x",
+    uuid_[0], uuid_[1], uuid_[2],
+    uuid_[3], uuid_[4], uuid_[5],
+    uuid_[6], uuid_[7], uuid_[8],
+    uuid_[9], uuid_[10], uuid_[11]);
+  return uuid_data;
+}
 bool VescPacketFWVersion::paired() const
 {
   return paired_;
@@ -150,12 +375,46 @@ uint8_t VescPacketFWVersion::devVersion() const
 REGISTER_PACKET_TYPE(COMM_FW_VERSION, VescPacketFWVersion)
 
 VescPacketRequestFWVersion::VescPacketRequestFWVersion()
-: VescPacket("RequestFWVersion", 1, COMM_FW_VERSION)
+: VescPacket("RequestFWVersion", codec::ConstantFrame<COMM_FW_VERSION>())
+{
+}
+
+/*------------------------------------------------------------------------------------------------*/
+
+VescPacketMcConf::VescPacketMcConf(std::shared_ptr<VescFrame> raw)
+: VescPacket("McConf", raw)
+{
+}
+
+Buffer VescPacketMcConf::data() const
+{
+  return Buffer(payload_.first + 1, payload_.second);
+}
+
+REGISTER_PACKET_TYPE(COMM_GET_MCCONF, VescPacketMcConf)
+
+VescPacketRequestMcConf::VescPacketRequestMcConf()
+: VescPacket("RequestMcConf", codec::ConstantFrame<COMM_GET_MCCONF>())
+{
+}
+
+/*------------------------------------------------------------------------------------------------*/
+
+VescPacketAppConf::VescPacketAppConf(std::shared_ptr<VescFrame> raw)
+: VescPacket("AppConf", raw)
+{
+}
+
+Buffer VescPacketAppConf::data() const
+{
+  return Buffer(payload_.first + 1, payload_.second);
+}
+
+REGISTER_PACKET_TYPE(COMM_GET_APPCONF, VescPacketAppConf)
+
+VescPacketRequestAppConf::VescPacketRequestAppConf()
+: VescPacket("RequestAppConf", codec::ConstantFrame<COMM_GET_APPCONF>())
 {
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
 }
 
 /*------------------------------------------------------------------------------------------------*/
@@ -166,395 +425,283 @@ VescPacketValues::VescPacketValues(std::shared_ptr<VescFrame> raw)
 }
 double VescPacketValues::temp_fet() const
 {
-  int16_t v = static_cast<int16_t>(
-    (static_cast<uint16_t>(*(payload_.first + 1)) << 8) +
-    (static_cast<uint16_t>(*(payload_.first + 2)) )
-  );
-  return static_cast<double>(v) / 10.0;
+  return ValuesSchema::decode<VALUES_TEMP_FET>(payload_.first);
 }
 
 double VescPacketValues::temp_motor() const
 {
-  int16_t v = static_cast<int16_t>(
-    (static_cast<uint16_t>(*(payload_.first + 3)) << 8) +
-    (static_cast<uint16_t>(*(payload_.first + 4)) )
-  );
-  return static_cast<double>(v) / 10.0;
+  return ValuesSchema::decode<VALUES_TEMP_MOTOR>(payload_.first);
 }
 
-
 double VescPacketValues::avg_motor_current() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 5)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 6)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 7)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 8)) )
-  );
-  return static_cast<double>(v) / 100.0;
+  return ValuesSchema::decode<VALUES_AVG_MOTOR_CURRENT>(payload_.first);
 }
 
-
-double VescPacketValues::avg_input_current()  const
+double VescPacketValues::avg_input_current() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 9)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 10)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 11)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 12)) )
-  );
-  return static_cast<double>(v) / 100.0;
+  return ValuesSchema::decode<VALUES_AVG_INPUT_CURRENT>(payload_.first);
 }
 
-
-double VescPacketValues::avg_id()  const
+double VescPacketValues::avg_id() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 13)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 14)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 15)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 16)) )
-  );
-  return static_cast<double>(v) / 100.0;
+  return ValuesSchema::decode<VALUES_AVG_ID>(payload_.first);
 }
 
-double VescPacketValues::avg_iq()  const
+double VescPacketValues::avg_iq() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 17)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 18)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 19)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 20)) )
-  );
-  return static_cast<double>(v) / 100.0;
+  return ValuesSchema::decode<VALUES_AVG_IQ>(payload_.first);
 }
 
-
 double VescPacketValues::duty_cycle_now() const
 {
-  int16_t v = static_cast<int16_t>(
-    (static_cast<uint16_t>(*(payload_.first + 21)) << 8) +
-    (static_cast<uint16_t>(*(payload_.first + 22)) )
-  );
-  return static_cast<double>(v) / 1000.0;
+  return ValuesSchema::decode<VALUES_DUTY_CYCLE_NOW>(payload_.first);
 }
 
 double VescPacketValues::rpm() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 23)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 24)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 25)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 26)) )
-  );
-  return static_cast<double>(v) / 1.0;
+  return ValuesSchema::decode<VALUES_RPM>(payload_.first);
 }
 
 double VescPacketValues::v_in() const
 {
-  int16_t v = static_cast<int16_t>(
-    (static_cast<uint16_t>(*(payload_.first + 27)) << 8) +
-    (static_cast<uint16_t>(*(payload_.first + 28)) )
-  );
-  return static_cast<double>(v) / 10.0;
+  return ValuesSchema::decode<VALUES_V_IN>(payload_.first);
 }
 
-double VescPacketValues::amp_hours()  const
+double VescPacketValues::amp_hours() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 29)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 30)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 31)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 32)) )
-  );
-  return static_cast<double>(v) / 1e4;
+  return ValuesSchema::decode<VALUES_AMP_HOURS>(payload_.first);
 }
 
-double VescPacketValues::amp_hours_charged()  const
+double VescPacketValues::amp_hours_charged() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 33)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 34)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 35)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 36)) )
-  );
-  return static_cast<double>(v) / 1e4;
+  return ValuesSchema::decode<VALUES_AMP_HOURS_CHARGED>(payload_.first);
 }
 
-double VescPacketValues::watt_hours()  const
+double VescPacketValues::watt_hours() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 37)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 38)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 39)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 40)) )
-  );
-  return static_cast<double>(v) / 1e4;
+  return ValuesSchema::decode<VALUES_WATT_HOURS>(payload_.first);
 }
 
-double VescPacketValues::watt_hours_charged()  const
+double VescPacketValues::watt_hours_charged() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 41)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 42)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 43)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 44)) )
-  );
-  return static_cast<double>(v) / 1e4;
+  return ValuesSchema::decode<VALUES_WATT_HOURS_CHARGED>(payload_.first);
 }
 
 int32_t VescPacketValues::tachometer() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 45)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 46)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 47)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 48)) )
-  );
-  return static_cast<int32_t>(v);
+  return ValuesSchema::read<VALUES_TACHOMETER>(payload_.first);
 }
 
 int32_t VescPacketValues::tachometer_abs() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 49)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 50)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 51)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 52)) )
-  );
-  return static_cast<int32_t>(v);
+  return ValuesSchema::read<VALUES_TACHOMETER_ABS>(payload_.first);
 }
 
 int VescPacketValues::fault_code() const
 {
-  return static_cast<int32_t>(*(payload_.first + 53));
+  return ValuesSchema::read<VALUES_FAULT_CODE>(payload_.first);
 }
 
-
 double VescPacketValues::pid_pos_now() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 54)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 55)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 56)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 57)) )
-  );
-  return static_cast<double>(v) / 1e6;
+  return ValuesSchema::decode<VALUES_PID_POS_NOW>(payload_.first);
 }
 
 int32_t VescPacketValues::controller_id() const
 {
-  int32_t v = static_cast<int32_t>((static_cast<uint32_t>(*(payload_.first + 58) )));
-
-  return static_cast<int32_t>(v);
+  return ValuesSchema::read<VALUES_CONTROLLER_ID>(payload_.first);
 }
 
 double VescPacketValues::temp_mos1() const
 {
-  int16_t v = static_cast<int16_t>(
-    (static_cast<uint16_t>(*(payload_.first + 59)) << 8) +
-    (static_cast<uint16_t>(*(payload_.first + 60)) )
-  );
-  return static_cast<double>(v) / 10.0;
+  return ValuesSchema::decode<VALUES_TEMP_MOS1>(payload_.first);
 }
 
 double VescPacketValues::temp_mos2() const
 {
-  int16_t v = static_cast<int16_t>(
-    (static_cast<uint16_t>(*(payload_.first + 61)) << 8) +
-    (static_cast<uint16_t>(*(payload_.first + 62)) )
-  );
-  return static_cast<double>(v) / 10.0;
+  return ValuesSchema::decode<VALUES_TEMP_MOS2>(payload_.first);
 }
 
 double VescPacketValues::temp_mos3() const
 {
-  int16_t v = static_cast<int16_t>(
-    (static_cast<uint16_t>(*(payload_.first + 63)) << 8) +
-    (static_cast<uint16_t>(*(payload_.first + 64)) )
-  );
-  return static_cast<double>(v) / 10.0;
+  return ValuesSchema::decode<VALUES_TEMP_MOS3>(payload_.first);
 }
 
-double VescPacketValues::avg_vd()  const
+double VescPacketValues::avg_vd() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 65)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 66)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 67)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 68)) )
-  );
-  return static_cast<double>(v) / 1e3;
+  return ValuesSchema::decode<VALUES_AVG_VD>(payload_.first);
 }
 
-
-double VescPacketValues::avg_vq()  const
+double VescPacketValues::avg_vq() const
 {
-  int32_t v = static_cast<int32_t>(
-    (static_cast<uint32_t>(*(payload_.first + 69)) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + 70)) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + 71)) << 8) +
-    (static_cast<uint32_t>(*(payload_.first + 72)) )
-  );
-  return static_cast<double>(v) / 1e3;
+  return ValuesSchema::decode<VALUES_AVG_VQ>(payload_.first);
 }
 
-
 REGISTER_PACKET_TYPE(COMM_GET_VALUES, VescPacketValues)
 
+const char * faultCodeName(int fault_code)
+{
+  static const char * const NAMES[] = {
+    "FAULT_CODE_NONE",
+    "FAULT_CODE_OVER_VOLTAGE",
+    "FAULT_CODE_UNDER_VOLTAGE",
+    "FAULT_CODE_DRV",
+    "FAULT_CODE_ABS_OVER_CURRENT",
+    "FAULT_CODE_OVER_TEMP_FET",
+    "FAULT_CODE_OVER_TEMP_MOTOR",
+    "FAULT_CODE_GATE_DRIVER_OVER_VOLTAGE",
+    "FAULT_CODE_GATE_DRIVER_UNDER_VOLTAGE",
+    "FAULT_CODE_MCU_UNDER_VOLTAGE",
+    "FAULT_CODE_BOOTING_FROM_WATCHDOG_RESET",
+    "FAULT_CODE_ENCODER_SPI",
+    "FAULT_CODE_ENCODER_SINCOS_BELOW_MIN_AMPLITUDE",
+    "FAULT_CODE_ENCODER_SINCOS_ABOVE_MAX_AMPLITUDE",
+    "FAULT_CODE_FLASH_CORRUPTION",
+    "FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_1",
+    "FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_2",
+    "FAULT_CODE_HIGH_OFFSET_CURRENT_SENSOR_3",
+    "FAULT_CODE_UNBALANCED_CURRENTS",
+    "FAULT_CODE_BRK",
+    "FAULT_CODE_RESOLVER_LOT",
+    "FAULT_CODE_RESOLVER_DOS",
+    "FAULT_CODE_RESOLVER_LOS"
+  };
+  static_assert(
+    sizeof(NAMES) / sizeof(NAMES[0]) == FAULT_CODE_RESOLVER_LOS + 1,
+    "fault code names out of sync with mc_fault_code");
+  if (fault_code < 0 || fault_code > FAULT_CODE_RESOLVER_LOS) {
+    return "FAULT_CODE_UNKNOWN";
+  }
+  return NAMES[fault_code];
+}
+
 VescPacketRequestValues::VescPacketRequestValues()
-: VescPacket("RequestValues", 1, COMM_GET_VALUES)
+: VescPacket("RequestValues", codec::ConstantFrame<COMM_GET_VALUES>())
 {
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
 }
 
 /*------------------------------------------------------------------------------------------------*/
 
 
 VescPacketSetDuty::VescPacketSetDuty(double duty)
-: VescPacket("SetDuty", 5, COMM_SET_DUTY)
+: VescPacket("SetDuty", SetDutySchema::PAYLOAD_SIZE, SetDutySchema::ID)
 {
   /** @todo range check duty */
 
-  int32_t v = static_cast<int32_t>(duty * 100000.0);
-
-  *(payload_.first + 1) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 24) & 0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 16) & 0xFF);
-  *(payload_.first + 3) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 8) & 0xFF);
-  *(payload_.first + 4) = static_cast<uint8_t>(static_cast<uint32_t>(v) & 0xFF);
-
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+  SetDutySchema::encode(payload_.first, duty);
+  writeCrc();
 }
 
 /*------------------------------------------------------------------------------------------------*/
 
 VescPacketSetCurrent::VescPacketSetCurrent(double current)
-: VescPacket("SetCurrent", 5, COMM_SET_CURRENT)
+: VescPacket("SetCurrent", SetCurrentSchema::PAYLOAD_SIZE, SetCurrentSchema::ID)
 {
-  int32_t v = static_cast<int32_t>(current * 1000.0);
-
-  *(payload_.first + 1) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 24) & 0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 16) & 0xFF);
-  *(payload_.first + 3) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 8) & 0xFF);
-  *(payload_.first + 4) = static_cast<uint8_t>(static_cast<uint32_t>(v) & 0xFF);
-
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+  SetCurrentSchema::encode(payload_.first, current);
+  writeCrc();
 }
 
 /*------------------------------------------------------------------------------------------------*/
 
 VescPacketSetCurrentBrake::VescPacketSetCurrentBrake(double current_brake)
-: VescPacket("SetCurrentBrake", 5, COMM_SET_CURRENT_BRAKE)
+: VescPacket("SetCurrentBrake", SetCurrentBrakeSchema::PAYLOAD_SIZE, SetCurrentBrakeSchema::ID)
 {
-  int32_t v = static_cast<int32_t>(current_brake * 1000.0);
-
-  *(payload_.first + 1) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 24) & 0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 16) & 0xFF);
-  *(payload_.first + 3) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 8) & 0xFF);
-  *(payload_.first + 4) = static_cast<uint8_t>(static_cast<uint32_t>(v) & 0xFF);
-
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+  SetCurrentBrakeSchema::encode(payload_.first, current_brake);
+  writeCrc();
 }
 
 /*------------------------------------------------------------------------------------------------*/
 
 VescPacketSetRPM::VescPacketSetRPM(double rpm)
-: VescPacket("SetRPM", 5, COMM_SET_RPM)
+: VescPacket("SetRPM", SetRPMSchema::PAYLOAD_SIZE, SetRPMSchema::ID)
 {
-  int32_t v = static_cast<int32_t>(rpm);
-
-  *(payload_.first + 1) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 24) & 0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 16) & 0xFF);
-  *(payload_.first + 3) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 8) & 0xFF);
-  *(payload_.first + 4) = static_cast<uint8_t>(static_cast<uint32_t>(v) & 0xFF);
-
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+  SetRPMSchema::encode(payload_.first, rpm);
+  writeCrc();
 }
 
 /*------------------------------------------------------------------------------------------------*/
 
 VescPacketSetPos::VescPacketSetPos(double pos)
-: VescPacket("SetPos", 5, COMM_SET_POS)
+: VescPacket("SetPos", SetPosSchema::PAYLOAD_SIZE, SetPosSchema::ID)
 {
   /** @todo range check pos */
 
-  int32_t v = static_cast<int32_t>(pos * 1000000.0);
-
-  *(payload_.first + 1) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 24) & 0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 16) & 0xFF);
-  *(payload_.first + 3) = static_cast<uint8_t>((static_cast<uint32_t>(v) >> 8) & 0xFF);
-  *(payload_.first + 4) = static_cast<uint8_t>(static_cast<uint32_t>(v) & 0xFF);
-
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+  SetPosSchema::encode(payload_.first, pos);
+  writeCrc();
 }
 
 /*------------------------------------------------------------------------------------------------*/
 
 VescPacketSetServoPos::VescPacketSetServoPos(double servo_pos)
-: VescPacket("SetServoPos", 3, COMM_SET_SERVO_POS)
+: VescPacket("SetServoPos", SetServoPosSchema::PAYLOAD_SIZE, SetServoPosSchema::ID)
 {
   /** @todo range check pos */
 
-  int16_t v = static_cast<int16_t>(servo_pos * 1000.0);
+  SetServoPosSchema::encode(payload_.first, servo_pos);
+  writeCrc();
+}
 
-  *(payload_.first + 1) = static_cast<uint8_t>((static_cast<uint16_t>(v) >> 8) & 0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>(static_cast<uint16_t>(v) & 0xFF);
+/*------------------------------------------------------------------------------------------------*/
 
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+VescPacketSetMcconfTemp::VescPacketSetMcconfTemp(const Limits & limits, bool store)
+: VescPacket("SetMcconfTemp", SetMcconfTempSchema::PAYLOAD_SIZE, SetMcconfTempSchema::ID)
+{
+  // not forwarded to CAN and not acknowledged, the driver does not wait for a reply
+  SetMcconfTempSchema::encode(
+    payload_.first, store ? 1 : 0, 0, 0, 0,
+    limits.current_min_scale, limits.current_max_scale, limits.min_erpm, limits.max_erpm,
+    limits.min_duty, limits.max_duty, limits.watt_min, limits.watt_max,
+    limits.in_current_min, limits.in_current_max);
+  writeCrc();
 }
 
+/*------------------------------------------------------------------------------------------------*/
 
-VescPacketImu::VescPacketImu(std::shared_ptr<VescFrame> raw)
-: VescPacket("ImuData", raw)
+VescPacketRotorPosition::VescPacketRotorPosition(std::shared_ptr<VescFrame> raw)
+: VescPacket("RotorPosition", raw)
 {
-  uint32_t ind = 1;
-  mask_ = static_cast<uint32_t>(
-    (static_cast<uint16_t>(*(payload_.first + ind       )) << 8) +
-    static_cast<uint16_t>(*(payload_.first + ind + 1   ))
-  );
-  ind += 2;
+}
 
-  if (mask_ & ((uint32_t)1 << 0)) {roll_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 1)) {pitch_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 2)) {yaw_ = getFloat32Auto(&ind);}
+double VescPacketRotorPosition::position() const
+{
+  if (std::distance(payload_.first, payload_.second) <
+    static_cast<std::ptrdiff_t>(RotorPositionSchema::PAYLOAD_SIZE))
+  {
+    return 0.0;  // truncated packet
+  }
+  return RotorPositionSchema::decode<0>(payload_.first);
+}
 
-  if (mask_ & ((uint32_t)1 << 3)) {acc_x_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 4)) {acc_y_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 5)) {acc_z_ = getFloat32Auto(&ind);}
+REGISTER_PACKET_TYPE(COMM_ROTOR_POSITION, VescPacketRotorPosition)
 
-  if (mask_ & ((uint32_t)1 << 6)) {gyr_x_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 7)) {gyr_y_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 8)) {gyr_z_ = getFloat32Auto(&ind);}
+VescPacketSetDetect::VescPacketSetDetect(uint8_t mode)
+: VescPacket("SetDetect", SetDetectSchema::PAYLOAD_SIZE, SetDetectSchema::ID)
+{
+  SetDetectSchema::encode(payload_.first, mode);
+  writeCrc();
+}
 
-  if (mask_ & ((uint32_t)1 << 9)) {mag_x_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 10)) {mag_y_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 11)) {mag_z_ = getFloat32Auto(&ind);}
+/*------------------------------------------------------------------------------------------------*/
 
-  if (mask_ & ((uint32_t)1 << 12)) {q0_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 13)) {q1_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 14)) {q2_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 15)) {q3_ = getFloat32Auto(&ind);}
+VescPacketImu::VescPacketImu(std::shared_ptr<VescFrame> raw)
+: VescPacket("ImuData", raw), fields_()
+{
+  // the mask is laid out like the request's, the fields it selects follow
+  uint32_t ind = RequestImuSchema::PAYLOAD_SIZE;
+  mask_ = RequestImuSchema::read<0>(payload_.first);
+
+  // each set bit in the mask is followed by one float32_auto in bit order, so only visit set bits
+  uint32_t payload_size = std::distance(payload_.first, payload_.second);
+  uint32_t num_fields = __builtin_popcount(mask_);
+  if (ind + 4 * num_fields > payload_size) {
+    // truncated packet, leave all fields zeroed rather than read past the payload
+    return;
+  }
+
+  for (uint32_t bits = mask_; bits != 0; bits &= bits - 1) {
+    fields_[__builtin_ctz(bits)] = getFloat32Auto(&ind);
+  }
 }
 
 int VescPacketImu::mask() const
@@ -564,126 +711,294 @@ int VescPacketImu::mask() const
 
 double VescPacketImu::getFloat32Auto(uint32_t * idx) const
 {
-  int pos = *idx;
-  uint32_t res = static_cast<uint32_t>(
-    (static_cast<uint32_t>(*(payload_.first + (pos ) )) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + (pos + 1) )) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + (pos + 2) )) << 8) +
-    static_cast<uint32_t>(*(payload_.first + (pos + 3) ))
-  );
-
-  *idx += 4;
-
-  int e = (res >> 23) & 0xFF;
-  int fr = res & 0x7FFFFF;
-  bool negative = res & (1 << 31);
-
-  float f = 0.0;
-  if (e != 0 || fr != 0) {
-    f = static_cast<float>(fr) / (8388608.0 * 2.0) + 0.5;
-    e -= 126;
-  }
-
-  if (negative) {
-    f = -f;
-  }
-  return ldexpf(f, e);
+  double value = codec::Float32Auto::read(payload_.first + *idx);
+  *idx += codec::Float32Auto::SIZE;
+  return value;
 }
 
 double VescPacketImu::roll() const
 {
-  return roll_ * 180 / M_PI;  // da rad a gradi per debug  deg
+  return fields_[IMU_ROLL] * 180 / M_PI;  // da rad a gradi per debug  deg
 }
 
 double VescPacketImu::pitch() const
 {
-  return pitch_ * 180 / M_PI;
+  return fields_[IMU_PITCH] * 180 / M_PI;
 }
 
 
 double VescPacketImu::yaw() const
 {
-  return yaw_ * 180 / M_PI;
+  return fields_[IMU_YAW] * 180 / M_PI;
 }
 
 
 double VescPacketImu::acc_x()const
 {
-  return acc_x_;  // g/s
+  return fields_[IMU_ACC_X];  // g/s
 }
 
 double VescPacketImu::acc_y() const
 {
-  return acc_y_;
+  return fields_[IMU_ACC_Y];
 }
 
 double VescPacketImu::acc_z() const
 {
-  return acc_z_;
+  return fields_[IMU_ACC_Z];
 }
 
 double VescPacketImu::gyr_x() const
 {
-  return gyr_x_;  // deg/s
+  return fields_[IMU_GYR_X];  // deg/s
 }
 
 double VescPacketImu::gyr_y() const
 {
-  return gyr_y_;
+  return fields_[IMU_GYR_Y];
 }
 
 double VescPacketImu::gyr_z() const
 {
-  return gyr_z_;
+  return fields_[IMU_GYR_Z];
 }
 
 double VescPacketImu::mag_x() const
 {
-  return mag_x_;
+  return fields_[IMU_MAG_X];
 }
 
 double VescPacketImu::mag_y() const
 {
-  return mag_y_;
+  return fields_[IMU_MAG_Y];
 }
 
 double VescPacketImu::mag_z() const
 {
-  return mag_z_;
+  return fields_[IMU_MAG_Z];
 }
 
 double VescPacketImu::q_w() const
 {
-  return q0_;
+  return fields_[IMU_Q_W];
 }
 
 double VescPacketImu::q_x() const
 {
-  return q1_;
+  return fields_[IMU_Q_X];
 }
 
 double VescPacketImu::q_y() const
 {
-  return q2_;
+  return fields_[IMU_Q_Y];
 }
 
 double VescPacketImu::q_z() const
 {
-  return q3_;
+  return fields_[IMU_Q_Z];
 }
 
+const uint16_t VescPacketImu::IMU_MASK_RPY;
+const uint16_t VescPacketImu::IMU_MASK_ACC;
+const uint16_t VescPacketImu::IMU_MASK_GYRO;
+const uint16_t VescPacketImu::IMU_MASK_MAG;
+const uint16_t VescPacketImu::IMU_MASK_QUATERNION;
+
 REGISTER_PACKET_TYPE(COMM_GET_IMU_DATA, VescPacketImu)
 
-VescPacketRequestImu::VescPacketRequestImu()
-: VescPacket("RequestImuData", 3, COMM_GET_IMU_DATA)
+VescPacketRequestImu::VescPacketRequestImu(uint16_t mask)
+: VescPacket("RequestImuData", RequestImuSchema::PAYLOAD_SIZE, RequestImuSchema::ID)
 {
-  *(payload_.first + 1) = static_cast<uint8_t>(0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>(0xFF);
+  RequestImuSchema::encode(payload_.first, mask);
+  writeCrc();
+}
 
-  uint16_t crc = CRC::Calculate(
-    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
-  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
-  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+/*------------------------------------------------------------------------------------------------*/
+
+VescPacketSample::VescPacketSample(std::shared_ptr<VescFrame> raw)
+: VescPacket("Sample", raw), fields_(), status_(0), phase_(0)
+{
+  static_assert(SampleSchema::NUM_FIELDS == SAMPLE_NUM_FIELDS + 2, "sample fields out of sync");
+  const uint32_t payload_size = std::distance(payload_.first, payload_.second);
+  if (payload_size < SampleSchema::PAYLOAD_SIZE) {
+    // truncated sample, leave it zeroed
+    return;
+  }
+
+  decodeFields<SampleSchema>(
+    payload_.first, fields_, std::make_index_sequence<SAMPLE_NUM_FIELDS>());
+  status_ = SampleSchema::read<SAMPLE_NUM_FIELDS>(payload_.first);
+  phase_ = SampleSchema::read<SAMPLE_NUM_FIELDS + 1>(payload_.first);
+}
+
+float VescPacketSample::current0() const
+{
+  return fields_[SAMPLE_CURRENT0];
+}
+
+float VescPacketSample::current1() const
+{
+  return fields_[SAMPLE_CURRENT1];
+}
+
+float VescPacketSample::voltage_ph1() const
+{
+  return fields_[SAMPLE_VOLTAGE_PH1];
+}
+
+float VescPacketSample::voltage_ph2() const
+{
+  return fields_[SAMPLE_VOLTAGE_PH2];
+}
+
+float VescPacketSample::voltage_ph3() const
+{
+  return fields_[SAMPLE_VOLTAGE_PH3];
+}
+
+float VescPacketSample::voltage_zero() const
+{
+  return fields_[SAMPLE_VOLTAGE_ZERO];
+}
+
+float VescPacketSample::current_fir() const
+{
+  return fields_[SAMPLE_CURRENT_FIR];
+}
+
+float VescPacketSample::f_sw() const
+{
+  return fields_[SAMPLE_F_SW];
+}
+
+uint8_t VescPacketSample::status() const
+{
+  return status_;
 }
+
+uint8_t VescPacketSample::phase() const
+{
+  return phase_;
+}
+
+REGISTER_PACKET_TYPE(COMM_SAMPLE_PRINT, VescPacketSample)
+
+VescPacketRequestSample::VescPacketRequestSample(
+  uint8_t mode, uint16_t sample_len, uint8_t decimation)
+: VescPacket("RequestSample", RequestSampleSchema::PAYLOAD_SIZE, RequestSampleSchema::ID)
+{
+  RequestSampleSchema::encode(payload_.first, mode, sample_len, decimation);
+  writeCrc();
+}
+/*------------------------------------------------------------------------------------------------*/
+
+VescPacketTerminalCmd::VescPacketTerminalCmd(const std::string & command)
+: VescPacket("TerminalCmd", 1 + command.size(), COMM_TERMINAL_CMD)
+{
+  std::copy(command.begin(), command.end(), payload_.first + 1);
+  writeCrc();
+}
+
+VescPacketPrint::VescPacketPrint(std::shared_ptr<VescFrame> raw)
+: VescPacket("Print", raw)
+{
+}
+
+std::string VescPacketPrint::text() const
+{
+  std::string text(payload_.first + 1, payload_.second);
+  // the firmware may send the terminating null along
+  text.erase(std::find(text.begin(), text.end(), '\0'), text.end());
+  return text;
+}
+
+REGISTER_PACKET_TYPE(COMM_PRINT, VescPacketPrint)
+
+/*------------------------------------------------------------------------------------------------*/
+
+VescPacketEraseNewApp::VescPacketEraseNewApp(uint32_t size)
+: VescPacket("EraseNewApp", EraseNewAppSchema::PAYLOAD_SIZE, EraseNewAppSchema::ID)
+{
+  EraseNewAppSchema::encode(payload_.first, size);
+  writeCrc();
+}
+
+VescPacketEraseNewAppResult::VescPacketEraseNewAppResult(std::shared_ptr<VescFrame> raw)
+: VescPacket("EraseNewAppResult", raw)
+{
+}
+
+bool VescPacketEraseNewAppResult::ok() const
+{
+  return std::distance(payload_.first, payload_.second) >= 2 &&
+         WriteNewAppDataResultSchema::read<0>(payload_.first) == 1;
+}
+
+REGISTER_PACKET_TYPE(COMM_ERASE_NEW_APP, VescPacketEraseNewAppResult)
+
+VescPacketWriteNewAppData::VescPacketWriteNewAppData(
+  uint32_t offset, Buffer::const_iterator begin, Buffer::const_iterator end)
+: VescPacket(
+    "WriteNewAppData", WriteNewAppDataSchema::PAYLOAD_SIZE + std::distance(begin, end),
+    WriteNewAppDataSchema::ID)
+{
+  WriteNewAppDataSchema::encode(payload_.first, offset);
+  std::copy(begin, end, payload_.first + WriteNewAppDataSchema::PAYLOAD_SIZE);
+  writeCrc();
+}
+
+VescPacketWriteNewAppDataLzo::VescPacketWriteNewAppDataLzo(
+  uint32_t offset, uint16_t decompressed_size, Buffer::const_iterator begin,
+  Buffer::const_iterator end)
+: VescPacket(
+    "WriteNewAppDataLzo", WriteNewAppDataLzoSchema::PAYLOAD_SIZE + std::distance(begin, end),
+    WriteNewAppDataLzoSchema::ID)
+{
+  WriteNewAppDataLzoSchema::encode(payload_.first, offset, decompressed_size);
+  std::copy(begin, end, payload_.first + WriteNewAppDataLzoSchema::PAYLOAD_SIZE);
+  writeCrc();
+}
+
+VescPacketWriteNewAppDataResult::VescPacketWriteNewAppDataResult(std::shared_ptr<VescFrame> raw)
+: VescPacket("WriteNewAppDataResult", raw)
+{
+}
+
+bool VescPacketWriteNewAppDataResult::ok() const
+{
+  return std::distance(payload_.first, payload_.second) >= 2 &&
+         WriteNewAppDataResultSchema::read<0>(payload_.first) == 1;
+}
+
+bool VescPacketWriteNewAppDataResult::hasOffset() const
+{
+  // firmware older than 3.x does not echo the offset
+  return std::distance(payload_.first, payload_.second) >=
+         static_cast<std::ptrdiff_t>(WriteNewAppDataResultSchema::PAYLOAD_SIZE);
+}
+
+uint32_t VescPacketWriteNewAppDataResult::offset() const
+{
+  if (!hasOffset()) {
+    return 0;
+  }
+  return WriteNewAppDataResultSchema::read<1>(payload_.first);
+}
+
+REGISTER_PACKET_TYPE(COMM_WRITE_NEW_APP_DATA, VescPacketWriteNewAppDataResult)
+
+VescPacketWriteNewAppDataLzoResult::VescPacketWriteNewAppDataLzoResult(
+  std::shared_ptr<VescFrame> raw)
+: VescPacketWriteNewAppDataResult(raw)
+{
+}
+
+REGISTER_PACKET_TYPE(COMM_WRITE_NEW_APP_DATA_LZO, VescPacketWriteNewAppDataLzoResult)
+
+VescPacketJumpToBootloader::VescPacketJumpToBootloader()
+: VescPacket("JumpToBootloader", codec::ConstantFrame<COMM_JUMP_TO_BOOTLOADER>())
+{
+}
+
 /*------------------------------------------------------------------------------------------------*/
 }  // namespace vesc_driver
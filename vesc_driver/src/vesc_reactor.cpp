@@ -0,0 +1,364 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_reactor.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace vesc_driver
+{
+
+VescReactor::VescReactor()
+: epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)),
+  wake_fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  running_(true),
+  next_poll_id_(0)
+{
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    std::string error = std::strerror(errno);
+    if (epoll_fd_ >= 0) {
+      ::close(epoll_fd_);
+    }
+    if (wake_fd_ >= 0) {
+      ::close(wake_fd_);
+    }
+    throw std::runtime_error("Unable to create the reactor: " + error);
+  }
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = wake_fd_;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+  thread_ = std::thread(&VescReactor::run, this);
+}
+
+VescReactor::~VescReactor()
+{
+  // the reactor cannot join itself, the last reference must not be dropped by a handler
+  assert(!inReactorThread());
+  post([this] {running_ = false;});
+  thread_.join();
+
+  for (const auto & source : sources_) {
+    if (source.second->timer) {
+      ::close(source.first);
+    }
+  }
+  ::close(wake_fd_);
+  ::close(epoll_fd_);
+}
+
+bool VescReactor::addFd(int fd, FdHandler handler)
+{
+  auto source = std::make_shared<Source>();
+  source->handler = std::move(handler);
+  source->timer = false;
+  bool added = false;
+  int error = 0;
+  runSync(
+    [this, fd, source, &added, &error] {
+      added = add(fd, source);
+      error = errno;
+    });
+  errno = error;
+  return added;
+}
+
+void VescReactor::setWritable(int fd, bool writable)
+{
+  // epoll_ctl() is safe against a concurrent epoll_wait(), the change applies to the next wait
+  struct epoll_event event = {};
+  event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  event.data.fd = fd;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+}
+
+void VescReactor::removeFd(int fd)
+{
+  runSync([this, fd] {remove(fd);});
+}
+
+VescReactor::TimerId VescReactor::addTimer(
+  std::chrono::nanoseconds period, TimerHandler handler, std::chrono::nanoseconds delay)
+{
+  int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  // an it_value of zero disarms the timer, so fire "immediately" as 1 ns
+  if (delay.count() <= 0) {
+    delay = std::chrono::nanoseconds(1);
+  }
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = period.count() / 1000000000;
+  spec.it_interval.tv_nsec = period.count() % 1000000000;
+  spec.it_value.tv_sec = delay.count() / 1000000000;
+  spec.it_value.tv_nsec = delay.count() % 1000000000;
+  ::timerfd_settime(fd, 0, &spec, nullptr);
+
+  auto source = std::make_shared<Source>();
+  source->handler = [fd, handler](uint32_t) {
+      // ticks missed while the reactor was busy are dropped rather than run back to back
+      uint64_t expirations;
+      if (::read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        handler();
+      }
+    };
+  source->timer = true;
+  bool added = false;
+  runSync([this, fd, source, &added] {added = add(fd, source);});
+  return added ? fd : -1;
+}
+
+void VescReactor::removeTimer(TimerId id)
+{
+  runSync([this, id] {remove(id);});
+}
+
+VescReactor::TimerId VescReactor::addPollTimer(
+  std::chrono::nanoseconds period, TimerHandler handler)
+{
+  TimerId id = -1;
+  runSync(
+    [this, period, &handler, &id] {
+      int64_t key = period.count();
+      PollGroup & group = poll_groups_[key];
+      if (group.fd < 0) {
+        int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) {
+          poll_groups_.erase(key);
+          return;
+        }
+        auto source = std::make_shared<Source>();
+        source->handler = [this, fd, key](uint32_t) {
+            uint64_t expirations;
+            if (::read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+              tickPollGroup(key);
+            }
+          };
+        source->timer = true;
+        if (!add(fd, source)) {
+          poll_groups_.erase(key);
+          return;
+        }
+        group.fd = fd;
+      }
+      id = next_poll_id_++;
+      group.members.emplace_back(id, handler);
+      armPollGroup(key, &group);
+    });
+  return id;
+}
+
+void VescReactor::removePollTimer(TimerId id)
+{
+  runSync(
+    [this, id] {
+      for (auto iter = poll_groups_.begin(); iter != poll_groups_.end(); iter++) {
+        PollGroup & group = iter->second;
+        for (size_t i = 0; i < group.members.size(); i++) {
+          if (group.members[i].first != id) {
+            continue;
+          }
+          group.members.erase(group.members.begin() + i);
+          if (i < group.next) {
+            group.next--;
+          }
+          if (group.members.empty()) {
+            remove(group.fd);
+            poll_groups_.erase(iter);
+          } else {
+            armPollGroup(iter->first, &group);
+          }
+          return;
+        }
+      }
+    });
+}
+
+/** Tick every period / n for the n members, the first tick one slot from now */
+void VescReactor::armPollGroup(int64_t period, PollGroup * group)
+{
+  int64_t slot = std::max<int64_t>(1, period / static_cast<int64_t>(group->members.size()));
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = slot / 1000000000;
+  spec.it_interval.tv_nsec = slot % 1000000000;
+  spec.it_value = spec.it_interval;
+  ::timerfd_settime(group->fd, 0, &spec, nullptr);
+}
+
+void VescReactor::tickPollGroup(int64_t period)
+{
+  auto iter = poll_groups_.find(period);
+  if (iter == poll_groups_.end() || iter->second.members.empty()) {
+    return;
+  }
+  PollGroup & group = iter->second;
+  if (group.next >= group.members.size()) {
+    group.next = 0;
+  }
+  // the handler may add or remove poll timers, call a copy
+  TimerHandler handler = group.members[group.next].second;
+  group.next++;
+  handler();
+}
+
+void VescReactor::post(std::function<void ()> fn)
+{
+  {
+    std::lock_guard<std::mutex> lock(posted_mutex_);
+    posted_.push_back(std::move(fn));
+  }
+  uint64_t one = 1;
+  ssize_t written = ::write(wake_fd_, &one, sizeof(one));
+  (void)written;
+}
+
+bool VescReactor::inReactorThread() const
+{
+  return std::this_thread::get_id() == thread_.get_id();
+}
+
+std::shared_ptr<VescReactor> VescReactor::shared()
+{
+  static std::mutex mutex;
+  static std::weak_ptr<VescReactor> instance;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<VescReactor> reactor = instance.lock();
+  if (!reactor) {
+    reactor = std::make_shared<VescReactor>();
+    instance = reactor;
+  }
+  return reactor;
+}
+
+void VescReactor::run()
+{
+  const int MAX_EVENTS = 32;
+  struct epoll_event events[MAX_EVENTS];
+  while (running_) {
+    int n = ::epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    for (int i = 0; i < n && running_; i++) {
+      int fd = events[i].data.fd;
+      if (fd == wake_fd_) {
+        uint64_t count;
+        ssize_t bytes = ::read(wake_fd_, &count, sizeof(count));
+        (void)bytes;
+        runPosted();
+        continue;
+      }
+      // an earlier handler in this batch may have removed the source
+      auto iter = sources_.find(fd);
+      if (iter != sources_.end()) {
+        std::shared_ptr<Source> source = iter->second;
+        source->handler(events[i].events);
+      }
+    }
+  }
+}
+
+void VescReactor::runPosted()
+{
+  std::deque<std::function<void ()>> posted;
+  {
+    std::lock_guard<std::mutex> lock(posted_mutex_);
+    posted.swap(posted_);
+  }
+  for (auto & fn : posted) {
+    fn();
+  }
+}
+
+/** Watch @p fd, a timerfd is closed if it can't be watched. Returns false with errno set if so. */
+bool VescReactor::add(int fd, std::shared_ptr<Source> source)
+{
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0) {
+    sources_[fd] = source;
+    return true;
+  }
+  if (source->timer) {
+    int error = errno;
+    ::close(fd);
+    errno = error;
+  }
+  return false;
+}
+
+void VescReactor::remove(int fd)
+{
+  auto iter = sources_.find(fd);
+  if (iter == sources_.end()) {
+    return;
+  }
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  if (iter->second->timer) {
+    ::close(fd);
+  }
+  sources_.erase(iter);
+}
+
+void VescReactor::runSync(const std::function<void ()> & fn)
+{
+  if (inReactorThread()) {
+    fn();
+    return;
+  }
+  std::promise<void> done;
+  post([&fn, &done] {
+      fn();
+      done.set_value();
+    });
+  done.get_future().wait();
+}
+
+}  // namespace vesc_driver
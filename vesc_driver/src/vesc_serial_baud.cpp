@@ -0,0 +1,92 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+// asm/termbits.h clashes with termios.h, so termios2 is kept in its own translation unit.
+#include <asm/termbits.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#include "vesc_driver/vesc_serial_baud.hpp"
+
+namespace vesc_driver
+{
+
+bool isStandardBaudRate(uint32_t baud_rate)
+{
+  static const uint32_t STANDARD_RATES[] = {
+    50, 75, 110, 134, 150, 200, 300, 600, 1200, 1800, 2400, 4800, 9600, 19200, 38400, 57600,
+    115200, 230400, 460800, 500000, 576000, 921600, 1000000, 1152000, 1500000, 2000000, 2500000,
+    3000000, 3500000, 4000000
+  };
+  return std::find(std::begin(STANDARD_RATES), std::end(STANDARD_RATES), baud_rate) !=
+         std::end(STANDARD_RATES);
+}
+
+bool setCustomBaudRate(const std::string & port, uint32_t baud_rate, std::string * error)
+{
+  int fd = ::open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    *error = std::string("open failed: ") + std::strerror(errno);
+    return false;
+  }
+
+  struct termios2 tio;
+  bool ok = ::ioctl(fd, TCGETS2, &tio) == 0;
+  if (ok) {
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baud_rate;
+    tio.c_ospeed = baud_rate;
+    ok = ::ioctl(fd, TCSETS2, &tio) == 0;
+  }
+  if (ok) {
+    // the driver rounds to the closest rate it supports, refuse anything more than 2% off
+    ok = ::ioctl(fd, TCGETS2, &tio) == 0 &&
+      std::abs(static_cast<double>(tio.c_ospeed) - baud_rate) <= 0.02 * baud_rate;
+    if (!ok) {
+      *error = "baud rate " + std::to_string(baud_rate) + " not supported, driver set " +
+        std::to_string(tio.c_ospeed);
+    }
+  } else {
+    *error = std::string("termios2 ioctl failed: ") + std::strerror(errno);
+  }
+  ::close(fd);
+  return ok;
+}
+
+}  // namespace vesc_driver
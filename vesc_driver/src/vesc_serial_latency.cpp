@@ -0,0 +1,98 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "vesc_driver/vesc_serial_latency.hpp"
+
+namespace vesc_driver
+{
+
+bool setSerialLowLatency(const std::string & port, std::string * error)
+{
+  int fd = ::open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    *error = std::string("open failed: ") + std::strerror(errno);
+    return false;
+  }
+
+  struct serial_struct serial;
+  bool ok = ::ioctl(fd, TIOCGSERIAL, &serial) == 0;
+  if (ok) {
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ok = ::ioctl(fd, TIOCSSERIAL, &serial) == 0;
+  }
+  if (!ok) {
+    *error = std::string("ASYNC_LOW_LATENCY not set: ") + std::strerror(errno);
+  }
+  ::close(fd);
+  return ok;
+}
+
+std::string ftdiLatencyTimerPath(const std::string & port)
+{
+  // /dev/serial/by-id/... links to the tty, and the tty name is the usb-serial device's name
+  char resolved[PATH_MAX];
+  if (::realpath(port.c_str(), resolved) == nullptr) {
+    return std::string();
+  }
+  std::string tty(resolved);
+  tty = tty.substr(tty.find_last_of('/') + 1);
+  std::string path = "/sys/bus/usb-serial/devices/" + tty + "/latency_timer";
+  return ::access(path.c_str(), F_OK) == 0 ? path : std::string();
+}
+
+bool setFtdiLatencyTimer(const std::string & port, int milliseconds, std::string * error)
+{
+  std::string path = ftdiLatencyTimerPath(port);
+  if (path.empty()) {
+    *error = port + " has no latency timer";
+    return false;
+  }
+  std::ofstream timer(path);
+  timer << milliseconds << std::endl;
+  if (!timer) {
+    *error = "cannot write " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,386 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+// Simulated VESC on a pseudo terminal, for trying the driver and the tools without hardware.
+//
+//   vesc_simulator [--count N] [--drop-every N] [--erase-ms MS] [--write-us US] [--no-offset]
+//                  [--duration S]
+//
+//   --count N       simulate N VESCs, each on its own pseudo terminal (default 1)
+//   --drop-every N  do not acknowledge every N-th firmware write, to exercise resending
+//   --erase-ms MS   time the staging area erase takes (default 0)
+//   --write-us US   time each firmware write takes (default 0)
+//   --no-offset     acknowledge firmware writes without their offset, like firmware before 3.x
+//   --duration S    exit after S seconds (default run until killed)
+//
+// Prints the pseudo terminals to connect to, one per line, e.g.
+// vesc_fw_upload /dev/pts/3 firmware.bin. Answers the firmware version, telemetry and IMU
+// requests, and stages firmware writes, checking the image size and CRC when the bootloader is
+// started like the real bootloader would.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef VESC_DRIVER_HAVE_LZO
+#include <lzo/lzo1x.h>
+#endif
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+using vesc_driver::Buffer;
+using vesc_driver::VescFrame;
+using vesc_driver::VescPacket;
+
+namespace
+{
+
+struct SimulatorOptions
+{
+  int count = 1;
+  int drop_every = 0;
+  int erase_ms = 0;
+  int write_us = 0;
+  bool no_offset = false;
+  double duration = 0.0;
+};
+
+/** A reply with an arbitrary payload */
+class SimulatedReply : public VescPacket
+{
+public:
+  explicit SimulatedReply(const Buffer & payload)
+  : VescPacket("SimulatedReply", payload.size(), payload[0])
+  {
+    std::copy(payload.begin(), payload.end(), payload_.first);
+    writeCrc();
+  }
+};
+
+void appendUint32(Buffer * buffer, uint32_t value)
+{
+  buffer->push_back(static_cast<uint8_t>((value >> 24) & 0xFF));
+  buffer->push_back(static_cast<uint8_t>((value >> 16) & 0xFF));
+  buffer->push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+  buffer->push_back(static_cast<uint8_t>(value & 0xFF));
+}
+
+uint32_t getUint32(Buffer::const_iterator pos)
+{
+  return (static_cast<uint32_t>(*pos) << 24) + (static_cast<uint32_t>(*(pos + 1)) << 16) +
+         (static_cast<uint32_t>(*(pos + 2)) << 8) + static_cast<uint32_t>(*(pos + 3));
+}
+
+class SimulatedVesc
+{
+public:
+  SimulatedVesc(int index, const SimulatorOptions & options)
+  : index_(index), options_(options), fd_(-1), writes_(0)
+  {
+    fd_ = ::posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd_ < 0 || ::grantpt(fd_) != 0 || ::unlockpt(fd_) != 0) {
+      throw std::runtime_error(std::string("posix_openpt failed: ") + std::strerror(errno));
+    }
+    // raw mode on the terminal side, the driver side configures its end when it opens it
+    int slave = ::open(::ptsname(fd_), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave >= 0 && ::tcgetattr(slave, &tio) == 0) {
+      ::cfmakeraw(&tio);
+      ::tcsetattr(slave, TCSANOW, &tio);
+    }
+    if (slave >= 0) {
+      ::close(slave);
+    }
+  }
+
+  ~SimulatedVesc()
+  {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  int fd() const
+  {
+    return fd_;
+  }
+
+  std::string port() const
+  {
+    return ::ptsname(fd_);
+  }
+
+  /** Read what the driver wrote and answer every complete frame. */
+  void receive()
+  {
+    uint8_t data[4096];
+    ssize_t n = ::read(fd_, data, sizeof(data));
+    if (n <= 0) {
+      return;
+    }
+    rx_.insert(rx_.end(), data, data + n);
+
+    auto iter = rx_.cbegin();
+    while (iter != rx_.cend()) {
+      if (*iter != VescFrame::VESC_SOF_VAL_SMALL_FRAME &&
+        *iter != VescFrame::VESC_SOF_VAL_LARGE_FRAME)
+      {
+        iter++;
+        continue;
+      }
+      size_t header = (*iter == VescFrame::VESC_SOF_VAL_SMALL_FRAME) ? 2 : 3;
+      if (static_cast<size_t>(std::distance(iter, rx_.cend())) < header) {
+        break;
+      }
+      size_t length = (header == 2) ? *(iter + 1) : (*(iter + 1) << 8) + *(iter + 2);
+      if (length == 0 || length > VescFrame::VESC_MAX_PAYLOAD_SIZE) {
+        iter++;
+        continue;
+      }
+      if (static_cast<size_t>(std::distance(iter, rx_.cend())) < header + length + 3) {
+        break;
+      }
+      auto payload = iter + header;
+      uint16_t crc = (*(payload + length) << 8) + *(payload + length + 1);
+      if (*(payload + length + 2) != VescFrame::VESC_EOF_VAL ||
+        crc != CRC::Calculate(&(*payload), length, VescFrame::CRC_TYPE))
+      {
+        iter++;
+        continue;
+      }
+      handle(Buffer(payload, payload + length));
+      iter = payload + length + 3;
+    }
+    rx_.erase(rx_.cbegin(), iter);
+  }
+
+private:
+  void reply(const Buffer & payload)
+  {
+    SimulatedReply packet(payload);
+    const Buffer & frame = packet.frame();
+    size_t written = 0;
+    while (written < frame.size()) {
+      ssize_t n = ::write(fd_, frame.data() + written, frame.size() - written);
+      if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        return;
+      }
+      written += std::max<ssize_t>(n, 0);
+    }
+  }
+
+  void handle(const Buffer & payload)
+  {
+    Buffer out{payload[0]};
+    switch (payload[0]) {
+      case vesc_driver::COMM_FW_VERSION: {
+          out.push_back(5);
+          out.push_back(2);
+          std::string name = "VESC SIM";
+          out.insert(out.end(), name.begin(), name.end());
+          out.push_back(0);
+          for (int i = 0; i < 12; i++) {
+            out.push_back(static_cast<uint8_t>(i == 11 ? index_ : 0x50 + i));
+          }
+          out.insert(out.end(), {0, 0, 0, 0});  // paired, test firmware, hardware type, configs
+          reply(out);
+          break;
+        }
+      case vesc_driver::COMM_GET_VALUES:
+        out.resize(73, 0);
+        reply(out);
+        break;
+      case vesc_driver::COMM_GET_IMU_DATA: {
+          uint16_t mask = payload.size() >= 3 ? (payload[1] << 8) + payload[2] : 0xFFFF;
+          out.push_back(static_cast<uint8_t>(mask >> 8));
+          out.push_back(static_cast<uint8_t>(mask & 0xFF));
+          out.resize(out.size() + 4 * __builtin_popcount(mask), 0);
+          reply(out);
+          break;
+        }
+      case vesc_driver::COMM_ERASE_NEW_APP:
+        std::this_thread::sleep_for(std::chrono::milliseconds(options_.erase_ms));
+        image_.assign(payload.size() >= 5 ? getUint32(payload.begin() + 1) : 0, 0xFF);
+        std::cout << "[" << index_ << "] erased " << image_.size() << " bytes" << std::endl;
+        out.push_back(1);
+        reply(out);
+        break;
+      case vesc_driver::COMM_WRITE_NEW_APP_DATA:
+      case vesc_driver::COMM_WRITE_NEW_APP_DATA_LZO:
+        handleWrite(payload);
+        break;
+      case vesc_driver::COMM_JUMP_TO_BOOTLOADER:
+        checkImage();
+        break;
+      default:
+        break;
+    }
+  }
+
+  void handleWrite(const Buffer & payload)
+  {
+    bool lzo = payload[0] == vesc_driver::COMM_WRITE_NEW_APP_DATA_LZO;
+    size_t header = lzo ? 7 : 5;
+    if (payload.size() < header) {
+      return;
+    }
+    uint32_t offset = getUint32(payload.begin() + 1);
+
+    Buffer data(payload.begin() + header, payload.end());
+    bool ok = true;
+    if (lzo) {
+#ifdef VESC_DRIVER_HAVE_LZO
+      lzo_uint size = (payload[5] << 8) + payload[6];
+      Buffer decompressed(size);
+      ok = lzo1x_decompress_safe(
+        data.data(), data.size(), decompressed.data(), &size, nullptr) == LZO_E_OK;
+      decompressed.resize(size);
+      data.swap(decompressed);
+#else
+      ok = false;
+#endif
+    }
+    ok = ok && offset + data.size() <= image_.size();
+    if (ok) {
+      std::copy(data.begin(), data.end(), image_.begin() + offset);
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(options_.write_us));
+    writes_++;
+    if (options_.drop_every > 0 && writes_ % options_.drop_every == 0) {
+      return;
+    }
+    Buffer out{vesc_driver::COMM_WRITE_NEW_APP_DATA, static_cast<uint8_t>(ok ? 1 : 0)};
+    if (!options_.no_offset) {
+      appendUint32(&out, offset);
+    }
+    reply(out);
+  }
+
+  void checkImage()
+  {
+    if (image_.size() < 6) {
+      std::cout << "[" << index_ << "] bootloader: no image staged" << std::endl;
+      return;
+    }
+    uint32_t size = getUint32(image_.cbegin());
+    uint16_t crc = (image_[4] << 8) + image_[5];
+    bool ok = size + 6 <= image_.size() &&
+      crc == CRC::Calculate(image_.data() + 6, size, VescFrame::CRC_TYPE);
+    std::cout << "[" << index_ << "] bootloader: " << size << " byte image " <<
+      (ok ? "verified" : "CORRUPT, size or CRC mismatch") << std::endl;
+  }
+
+  int index_;
+  SimulatorOptions options_;
+  int fd_;
+  Buffer rx_;
+  Buffer image_;  ///< staging area
+  int writes_;
+};
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  SimulatorOptions options;
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--count") == 0 && has_value) {
+      options.count = std::max(1, std::stoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--drop-every") == 0 && has_value) {
+      options.drop_every = std::stoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--erase-ms") == 0 && has_value) {
+      options.erase_ms = std::stoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--write-us") == 0 && has_value) {
+      options.write_us = std::stoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--no-offset") == 0) {
+      options.no_offset = true;
+    } else if (std::strcmp(argv[i], "--duration") == 0 && has_value) {
+      options.duration = std::stod(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0] <<
+        " [--count N] [--drop-every N] [--erase-ms MS] [--write-us US] [--no-offset]"
+        " [--duration S]" << std::endl;
+      return -1;
+    }
+  }
+
+#ifdef VESC_DRIVER_HAVE_LZO
+  lzo_init();
+#endif
+
+  try {
+    std::vector<std::unique_ptr<SimulatedVesc>> vescs;
+    std::vector<struct pollfd> pfds;
+    for (int i = 0; i < options.count; i++) {
+      vescs.emplace_back(new SimulatedVesc(i, options));
+      pfds.push_back({vescs.back()->fd(), POLLIN, 0});
+      std::cout << vescs.back()->port() << std::endl;
+    }
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.duration));
+    while (options.duration <= 0.0 || std::chrono::steady_clock::now() < end) {
+      if (::poll(pfds.data(), pfds.size(), 100) <= 0) {
+        continue;
+      }
+      bool idle = true;
+      for (size_t i = 0; i < pfds.size(); i++) {
+        if (pfds[i].revents & POLLIN) {
+          vescs[i]->receive();
+          idle = false;
+        }
+      }
+      if (idle) {
+        // nobody has the terminals open, wait for the next client
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      }
+    }
+  } catch (const std::exception & e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_can_bus_monitor.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+
+// frame lengths cross-checked against a bit level model of the frame and its stuff bits
+
+TEST(CanBusMonitor, StandardFrameBits)
+{
+  VescCanFrame frame;
+  frame.extended = false;
+  frame.id = 0;
+  EXPECT_EQ(53, VescCanBusMonitor::frameBits(frame));
+  frame.id = 0x7FF;
+  EXPECT_EQ(50, VescCanBusMonitor::frameBits(frame));
+}
+
+TEST(CanBusMonitor, ExtendedFrameBits)
+{
+  VescCanFrame frame;
+  frame.id = codec::canId(CAN_PACKET_STATUS, 0x68);
+  frame.len = 8;
+  // 0x55 alternates and needs no stuff bits in the data, zeros need one every five bits
+  std::memset(frame.data, 0x55, sizeof(frame.data));
+  EXPECT_EQ(135, VescCanBusMonitor::frameBits(frame));
+  std::memset(frame.data, 0, sizeof(frame.data));
+  EXPECT_EQ(148, VescCanBusMonitor::frameBits(frame));
+}
+
+TEST(CanBusMonitor, Report)
+{
+  VescCanBusMonitor monitor(500000);
+  VescCanFrame frame;
+  frame.id = codec::canId(CAN_PACKET_STATUS, 0x68);
+  frame.len = 8;
+  monitor.onFrame(frame);
+  monitor.onFrame(frame);
+  VescCanFrame error;
+  error.error = true;
+  error.id = 0x4;
+  monitor.onFrame(error);
+
+  VescCanBusMonitor::Report report = monitor.report();
+  EXPECT_EQ(1u, report.error_frames);
+  EXPECT_EQ(0x4u, report.error_classes);
+  ASSERT_EQ(1u, report.id_rates.size());
+  EXPECT_EQ(frame.id | VescCanBusMonitor::EXTENDED_ID_FLAG, report.id_rates.begin()->first);
+  EXPECT_GT(report.load, 0.0);
+
+  // the next report starts over
+  EXPECT_EQ(0u, monitor.report().error_frames);
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,146 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <initializer_list>
+#include <map>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_can_status.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+namespace
+{
+
+/** A status frame @p packet_id of the VESC @p controller_id carrying @p data */
+VescCanFrame statusFrame(uint8_t packet_id, uint8_t controller_id, std::initializer_list<int> data)
+{
+  VescCanFrame frame;
+  frame.id = codec::canId(packet_id, controller_id);
+  frame.len = 8;
+  int i = 0;
+  for (int byte : data) {
+    frame.data[i++] = static_cast<uint8_t>(byte);
+  }
+  return frame;
+}
+
+/** One cycle of all five status frames */
+void sendCycle(VescCanStatusDecoder * decoder, uint8_t controller_id)
+{
+  decoder->decode(
+    statusFrame(CAN_PACKET_STATUS, controller_id, {0, 0, 0x27, 0x10, 0, 0x7b, 0x01, 0xf4}));
+  decoder->decode(statusFrame(CAN_PACKET_STATUS_2, controller_id, {0, 0, 0x30, 0x39, 0, 0, 0, 0}));
+  decoder->decode(statusFrame(CAN_PACKET_STATUS_3, controller_id, {0, 0, 0x30, 0x39, 0, 0, 0, 0}));
+  decoder->decode(
+    statusFrame(CAN_PACKET_STATUS_4, controller_id, {0x01, 0x2c, 0xff, 0xf6, 0, 0x64, 0x46, 0x50}));
+  decoder->decode(
+    statusFrame(CAN_PACKET_STATUS_5, controller_id, {0xff, 0xff, 0xff, 0xfe, 0x01, 0x7c, 0, 0}));
+}
+
+}  // namespace
+
+TEST(CanStatus, MergesOneUpdatePerCycle)
+{
+  std::vector<VescCanStatus> updates;
+  VescCanStatusDecoder decoder([&updates](const VescCanStatus & status) {
+      updates.push_back(status);
+    });
+  for (int cycle = 0; cycle < 3; cycle++) {
+    sendCycle(&decoder, 0x68);
+  }
+
+  ASSERT_EQ(3u, updates.size());
+  const VescCanStatus & status = updates.back();
+  EXPECT_EQ(0x68, status.controller_id);
+  EXPECT_EQ(0x1f, status.frames);
+  EXPECT_DOUBLE_EQ(10000.0, status.rpm);
+  EXPECT_DOUBLE_EQ(12.3, status.current_motor);
+  EXPECT_DOUBLE_EQ(0.5, status.duty_cycle);
+  EXPECT_DOUBLE_EQ(1.2345, status.amp_hours);
+  EXPECT_DOUBLE_EQ(0.0, status.amp_hours_charged);
+  EXPECT_DOUBLE_EQ(1.2345, status.watt_hours);
+  EXPECT_DOUBLE_EQ(30.0, status.temp_fet);
+  EXPECT_DOUBLE_EQ(-1.0, status.temp_motor);
+  EXPECT_DOUBLE_EQ(10.0, status.current_input);
+  EXPECT_DOUBLE_EQ(360.0, status.pid_pos);
+  EXPECT_EQ(-2, status.tachometer);
+  EXPECT_DOUBLE_EQ(38.0, status.voltage_input);
+}
+
+TEST(CanStatus, ControllersAreIndependent)
+{
+  std::map<uint8_t, int> updates;
+  VescCanStatusDecoder decoder([&updates](const VescCanStatus & status) {
+      updates[status.controller_id]++;
+    });
+  for (int cycle = 0; cycle < 3; cycle++) {
+    sendCycle(&decoder, 1);
+    sendCycle(&decoder, 2);
+  }
+  EXPECT_EQ(3, updates[1]);
+  EXPECT_EQ(3, updates[2]);
+}
+
+TEST(CanStatus, LearnsTheFramesSent)
+{
+  // send_can_status set to send CAN_PACKET_STATUS and STATUS_4 only
+  std::vector<VescCanStatus> updates;
+  VescCanStatusDecoder decoder([&updates](const VescCanStatus & status) {
+      updates.push_back(status);
+    });
+  for (int cycle = 0; cycle < 3; cycle++) {
+    decoder.decode(statusFrame(CAN_PACKET_STATUS, 7, {0, 0, 0x27, 0x10, 0, 0x7b, 0x01, 0xf4}));
+    decoder.decode(statusFrame(CAN_PACKET_STATUS_4, 7, {0x01, 0x2c, 0xff, 0xf6, 0, 0x64, 0, 0}));
+  }
+
+  // the first cycle is complete once the second one starts, the others as soon as they are
+  ASSERT_EQ(3u, updates.size());
+  for (const VescCanStatus & status : updates) {
+    EXPECT_EQ(VescCanStatusDecoder::STATUS_1 | VescCanStatusDecoder::STATUS_4, status.frames);
+    EXPECT_DOUBLE_EQ(10000.0, status.rpm);
+    EXPECT_DOUBLE_EQ(30.0, status.temp_fet);
+  }
+}
+
+TEST(CanStatus, IgnoresOtherFrames)
+{
+  int updates = 0;
+  VescCanStatusDecoder decoder([&updates](const VescCanStatus &) {updates++;});
+  EXPECT_FALSE(decoder.decode(statusFrame(CAN_PACKET_FILL_RX_BUFFER, 0x68, {0, 1, 2})));
+  EXPECT_TRUE(decoder.decode(statusFrame(CAN_PACKET_STATUS, 0x68, {0, 0, 0x27, 0x10})));
+  EXPECT_EQ(0, updates);
+}
+
+}  // namespace vesc_driver
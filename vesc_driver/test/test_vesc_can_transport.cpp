@@ -0,0 +1,207 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_can_transport.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+namespace
+{
+
+/**
+ * The frames the firmware's comm_can_send_buffer() sends @p payload in from the VESC @p sender to
+ * the reply id @p reply_id: FILL_RX_BUFFER while the index fits in a byte, FILL_RX_BUFFER_LONG
+ * after that, then PROCESS_RX_BUFFER with the length and CRC.
+ */
+std::vector<VescCanFrame> replyFrames(
+  uint8_t reply_id, uint8_t sender, const std::vector<uint8_t> & payload)
+{
+  std::vector<VescCanFrame> frames;
+  size_t index = 0;
+  for (; index < payload.size() && index <= 255; index += 7) {
+    VescCanFrame frame;
+    size_t n = std::min<size_t>(7, payload.size() - index);
+    frame.id = codec::canId(CAN_PACKET_FILL_RX_BUFFER, reply_id);
+    frame.data[0] = static_cast<uint8_t>(index);
+    std::memcpy(frame.data + 1, payload.data() + index, n);
+    frame.len = static_cast<uint8_t>(n + 1);
+    frames.push_back(frame);
+  }
+  for (; index < payload.size(); index += 6) {
+    VescCanFrame frame;
+    size_t n = std::min<size_t>(6, payload.size() - index);
+    frame.id = codec::canId(CAN_PACKET_FILL_RX_BUFFER_LONG, reply_id);
+    frame.data[0] = static_cast<uint8_t>(index >> 8);
+    frame.data[1] = static_cast<uint8_t>(index & 0xFF);
+    std::memcpy(frame.data + 2, payload.data() + index, n);
+    frame.len = static_cast<uint8_t>(n + 2);
+    frames.push_back(frame);
+  }
+  uint16_t crc = codec::crc16(payload.data(), payload.size());
+  VescCanFrame frame;
+  frame.id = codec::canId(CAN_PACKET_PROCESS_RX_BUFFER, reply_id);
+  const uint8_t process[] = {
+    sender, 1, static_cast<uint8_t>(payload.size() >> 8),
+    static_cast<uint8_t>(payload.size() & 0xFF), static_cast<uint8_t>(crc >> 8),
+    static_cast<uint8_t>(crc & 0xFF)};
+  std::memcpy(frame.data, process, sizeof(process));
+  frame.len = sizeof(process);
+  frames.push_back(frame);
+  return frames;
+}
+
+/** COMM_FW_VERSION reply of firmware 6.05 on "HW60" */
+std::vector<uint8_t> fwVersionPayload()
+{
+  std::vector<uint8_t> payload{COMM_FW_VERSION, 6, 5, 'H', 'W', '6', '0', 0};
+  for (uint8_t i = 0; i < 12; i++) {
+    payload.push_back(i);  // uuid
+  }
+  payload.push_back(0);  // paired
+  payload.push_back(0);  // test version
+  return payload;
+}
+
+class CanTransport : public ::testing::Test
+{
+protected:
+  CanTransport()
+  : transport(socket)
+  {
+    transport.setPacketHandler(
+      [this](uint8_t controller_id, const VescPacketConstPtr & packet) {
+        senders.push_back(controller_id);
+        packets.push_back(packet);
+      });
+    transport.setErrorHandler([this](const std::string & error) {errors.push_back(error);});
+  }
+
+  VescCanSocket socket;  // not opened, only decode() is exercised
+  VescCanTransport transport;
+  std::vector<uint8_t> senders;
+  std::vector<VescPacketConstPtr> packets;
+  std::vector<std::string> errors;
+};
+
+}  // namespace
+
+TEST_F(CanTransport, InterleavedReplies)
+{
+  // two controllers answering on their own reply ids at the same time
+  std::vector<VescCanFrame> a = replyFrames(224, 5, fwVersionPayload());
+  std::vector<VescCanFrame> b = replyFrames(225, 7, fwVersionPayload());
+  for (size_t i = 0; i < std::max(a.size(), b.size()); i++) {
+    if (i < a.size()) {
+      EXPECT_TRUE(transport.decode(a[i]));
+    }
+    if (i < b.size()) {
+      EXPECT_TRUE(transport.decode(b[i]));
+    }
+  }
+
+  EXPECT_TRUE(errors.empty());
+  ASSERT_EQ(2u, packets.size());
+  EXPECT_EQ(std::vector<uint8_t>({5, 7}), senders);
+  for (const VescPacketConstPtr & packet : packets) {
+    auto fw_version = std::dynamic_pointer_cast<VescPacketFWVersion const>(packet);
+    ASSERT_TRUE(fw_version);
+    EXPECT_EQ(6, fw_version->fwMajor());
+    EXPECT_EQ(5, fw_version->fwMinor());
+    EXPECT_EQ(27u, fw_version->frame().size());
+  }
+}
+
+TEST_F(CanTransport, LongReply)
+{
+  // 402 bytes: FILL_RX_BUFFER up to index 252, FILL_RX_BUFFER_LONG from index 259
+  std::vector<uint8_t> payload{COMM_PRINT};
+  for (int i = 0; i < 400; i++) {
+    payload.push_back(static_cast<uint8_t>('a' + i % 26));
+  }
+  payload.push_back(0);
+  std::vector<VescCanFrame> frames = replyFrames(226, 9, payload);
+  EXPECT_EQ(CAN_PACKET_FILL_RX_BUFFER, frames[36].id >> 8);
+  EXPECT_EQ(CAN_PACKET_FILL_RX_BUFFER_LONG, frames[37].id >> 8);
+  for (const VescCanFrame & frame : frames) {
+    transport.decode(frame);
+  }
+
+  EXPECT_TRUE(errors.empty());
+  ASSERT_EQ(1u, packets.size());
+  EXPECT_EQ(9, senders[0]);
+  auto print = std::dynamic_pointer_cast<VescPacketPrint const>(packets[0]);
+  ASSERT_TRUE(print);
+  EXPECT_EQ(408u, print->frame().size());
+  EXPECT_EQ(std::string(payload.begin() + 1, payload.end() - 1), print->text());
+}
+
+TEST_F(CanTransport, BadChecksum)
+{
+  std::vector<VescCanFrame> frames = replyFrames(224, 5, fwVersionPayload());
+  frames[1].data[3] ^= 0xFF;
+  for (const VescCanFrame & frame : frames) {
+    transport.decode(frame);
+  }
+  EXPECT_TRUE(packets.empty());
+  ASSERT_EQ(1u, errors.size());
+
+  // the buffer starts over with the next reply
+  for (const VescCanFrame & frame : replyFrames(224, 5, fwVersionPayload())) {
+    transport.decode(frame);
+  }
+  EXPECT_EQ(1u, packets.size());
+}
+
+TEST_F(CanTransport, IgnoresOtherIds)
+{
+  VescCanFrame frame;
+  frame.id = codec::canId(CAN_PACKET_FILL_RX_BUFFER, 5);
+  frame.len = 3;
+  EXPECT_FALSE(transport.decode(frame));
+  frame.id = codec::canId(CAN_PACKET_STATUS, 224);
+  EXPECT_FALSE(transport.decode(frame));
+}
+
+TEST_F(CanTransport, SendWithoutSocket)
+{
+  EXPECT_FALSE(transport.send(5, VescPacketRequestFWVersion()));
+}
+
+}  // namespace vesc_driver
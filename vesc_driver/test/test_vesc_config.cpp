@@ -0,0 +1,227 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/vesc_config.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+
+namespace vesc_driver
+{
+namespace
+{
+
+const uint32_t SIGNATURE = 0x12345678;
+
+/** Big-endian writer with the firmware's buffer_append_*() encodings */
+struct ConfWriter
+{
+  Buffer data;
+
+  void u8(uint8_t value)
+  {
+    data.push_back(value);
+  }
+  void u16(uint16_t value)
+  {
+    u8(static_cast<uint8_t>(value >> 8));
+    u8(static_cast<uint8_t>(value & 0xFF));
+  }
+  void u32(uint32_t value)
+  {
+    u16(static_cast<uint16_t>(value >> 16));
+    u16(static_cast<uint16_t>(value & 0xFFFF));
+  }
+  void double16(double value, double scale)
+  {
+    u16(static_cast<uint16_t>(static_cast<int16_t>(std::lround(value * scale))));
+  }
+  void float32Auto(float value)
+  {
+    u32(encodeFloat32Auto(value));
+  }
+};
+
+/** A motor configuration limits section in the order confgenerator.c writes it */
+Buffer mcconf(uint32_t signature)
+{
+  ConfWriter w;
+  w.u32(signature);
+  w.u8(1);  // pwm_mode
+  w.u8(0);  // comm_mode
+  w.u8(2);  // motor_type
+  w.u8(0);  // sensor_mode
+  w.float32Auto(60.0f);  // l_current_max
+  w.float32Auto(-50.0f);  // l_current_min
+  w.float32Auto(99.0f);  // l_in_current_max
+  w.float32Auto(-40.0f);  // l_in_current_min
+  w.float32Auto(130.0f);  // l_abs_current_max
+  w.float32Auto(-100000.0f);  // l_min_erpm
+  w.float32Auto(100000.0f);  // l_max_erpm
+  w.double16(0.8, 10000);  // l_erpm_start
+  w.float32Auto(300.0f);  // l_max_erpm_fbrake
+  w.float32Auto(1500.0f);  // l_max_erpm_fbrake_cc
+  w.float32Auto(8.0f);  // l_min_vin
+  w.float32Auto(57.0f);  // l_max_vin
+  w.float32Auto(10.0f);  // l_battery_cut_start
+  w.float32Auto(8.0f);  // l_battery_cut_end
+  w.u8(1);  // l_slow_abs_current
+  w.double16(85.0, 10);  // l_temp_fet_start
+  w.double16(100.0, 10);  // l_temp_fet_end
+  w.double16(90.0, 10);  // l_temp_motor_start
+  w.double16(110.0, 10);  // l_temp_motor_end
+  w.double16(0.15, 10000);  // l_temp_accel_dec
+  w.double16(0.005, 10000);  // l_min_duty
+  w.double16(0.95, 10000);  // l_max_duty
+  w.float32Auto(1500000.0f);  // l_watt_max
+  w.float32Auto(-1500000.0f);  // l_watt_min
+  w.double16(1.0, 10000);  // l_current_max_scale
+  w.double16(0.5, 10000);  // l_current_min_scale
+  w.double16(1.0, 10000);  // l_duty_start
+  // the rest of the configuration follows, it is not decoded
+  w.u32(0xdeadbeef);
+  return w.data;
+}
+
+Buffer appconf(uint32_t signature)
+{
+  ConfWriter w;
+  w.u32(signature);
+  w.u8(3);  // controller_id
+  w.u32(1000);  // timeout_msec
+  w.float32Auto(5.0f);  // timeout_brake_current
+  w.u8(2);  // send_can_status
+  w.u16(50);  // send_can_status_rate_hz
+  w.u8(1);  // can_baud_rate
+  return w.data;
+}
+
+}  // namespace
+
+TEST(Config, DecodesMcConf)
+{
+  mc_configuration conf = mc_configuration();
+  uint32_t signature = 0;
+  ASSERT_TRUE(deserializeMcConf(mcconf(SIGNATURE), 5, {SIGNATURE}, &conf, &signature));
+  EXPECT_EQ(SIGNATURE, signature);
+  EXPECT_EQ(2, static_cast<int>(conf.motor_type));
+  EXPECT_FLOAT_EQ(60.0f, conf.l_current_max);
+  EXPECT_FLOAT_EQ(-50.0f, conf.l_current_min);
+  EXPECT_FLOAT_EQ(99.0f, conf.l_in_current_max);
+  EXPECT_FLOAT_EQ(-40.0f, conf.l_in_current_min);
+  EXPECT_FLOAT_EQ(-100000.0f, conf.l_min_erpm);
+  EXPECT_FLOAT_EQ(100000.0f, conf.l_max_erpm);
+  EXPECT_FLOAT_EQ(0.8f, conf.l_erpm_start);
+  EXPECT_TRUE(conf.l_slow_abs_current);
+  EXPECT_FLOAT_EQ(85.0f, conf.l_temp_fet_start);
+  EXPECT_FLOAT_EQ(90.0f, conf.l_temp_motor_start);
+  EXPECT_FLOAT_EQ(0.005f, conf.l_min_duty);
+  EXPECT_FLOAT_EQ(0.95f, conf.l_max_duty);
+  EXPECT_FLOAT_EQ(1500000.0f, conf.l_watt_max);
+  EXPECT_FLOAT_EQ(0.5f, conf.l_current_min_scale);
+  EXPECT_FLOAT_EQ(1.0f, conf.l_duty_start);
+}
+
+TEST(Config, DecodesAppConf)
+{
+  app_configuration conf = app_configuration();
+  ASSERT_TRUE(deserializeAppConf(appconf(SIGNATURE), 5, {SIGNATURE}, &conf));
+  EXPECT_EQ(3, conf.controller_id);
+  EXPECT_EQ(1000u, conf.timeout_msec);
+  EXPECT_FLOAT_EQ(5.0f, conf.timeout_brake_current);
+  EXPECT_EQ(2, static_cast<int>(conf.send_can_status));
+  EXPECT_EQ(50, conf.send_can_status_rate_hz);
+  EXPECT_EQ(1, static_cast<int>(conf.can_baud_rate));
+}
+
+TEST(Config, RejectsUnknownLayouts)
+{
+  mc_configuration conf = mc_configuration();
+  uint32_t signature = 0;
+  // another signature is reported but not decoded
+  EXPECT_FALSE(deserializeMcConf(mcconf(SIGNATURE + 1), 5, {SIGNATURE}, &conf, &signature));
+  EXPECT_EQ(SIGNATURE + 1, signature);
+  EXPECT_FLOAT_EQ(0.0f, conf.l_current_max);
+  EXPECT_FALSE(deserializeMcConf(mcconf(SIGNATURE), 5, {}, &conf));
+  // firmware before 5 serializes by hand
+  EXPECT_FALSE(deserializeMcConf(mcconf(SIGNATURE), 4, {SIGNATURE}, &conf));
+
+  Buffer truncated = appconf(SIGNATURE);
+  truncated.pop_back();
+  app_configuration app = app_configuration();
+  EXPECT_FALSE(deserializeAppConf(truncated, 5, {SIGNATURE}, &app));
+}
+
+TEST(Config, KnownSignatures)
+{
+  EXPECT_FALSE(KNOWN_MCCONF_SIGNATURES.empty());
+  EXPECT_EQ(KNOWN_MCCONF_SIGNATURES.size(), KNOWN_APPCONF_SIGNATURES.size());
+  mc_configuration conf = mc_configuration();
+  for (uint32_t signature : KNOWN_MCCONF_SIGNATURES) {
+    EXPECT_TRUE(deserializeMcConf(mcconf(signature), 5, KNOWN_MCCONF_SIGNATURES, &conf));
+  }
+}
+
+TEST(Config, CacheRoundTrip)
+{
+  char dir_template[] = "/tmp/vesc_config_test_XXXXXX";
+  ASSERT_NE(nullptr, ::mkdtemp(dir_template));
+  std::string directory = std::string(dir_template) + "/nested";
+  VescConfigCache cache(directory);
+  const std::string uuid = "0123456789abcdef01234567";
+
+  Buffer data;
+  EXPECT_FALSE(cache.load(uuid, 5, 2, "mcconf", &data));
+  ASSERT_TRUE(cache.store(uuid, 5, 2, "mcconf", mcconf(SIGNATURE)));
+  ASSERT_TRUE(cache.load(uuid, 5, 2, "mcconf", &data));
+  EXPECT_EQ(mcconf(SIGNATURE), data);
+
+  // keyed by device, firmware version and kind
+  EXPECT_FALSE(cache.load("another", 5, 2, "mcconf", &data));
+  EXPECT_FALSE(cache.load(uuid, 5, 3, "mcconf", &data));
+  EXPECT_FALSE(cache.load(uuid, 5, 2, "appconf", &data));
+
+  // a store replaces the cached configuration
+  ASSERT_TRUE(cache.store(uuid, 5, 2, "mcconf", appconf(SIGNATURE)));
+  ASSERT_TRUE(cache.load(uuid, 5, 2, "mcconf", &data));
+  EXPECT_EQ(appconf(SIGNATURE), data);
+
+  ::unlink((directory + "/" + uuid + "_fw5.2.mcconf").c_str());
+  ::rmdir(directory.c_str());
+  ::rmdir(dir_template);
+}
+
+}  // namespace vesc_driver
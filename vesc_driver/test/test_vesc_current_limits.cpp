@@ -0,0 +1,183 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_current_limits.hpp"
+
+namespace vesc_driver
+{
+namespace
+{
+
+std::string hex(const VescCanFrame & frame)
+{
+  std::string text;
+  char byte[4];
+  for (int i = 0; i < frame.len; i++) {
+    std::snprintf(byte, sizeof(byte), i ? " %02x" : "%02x", frame.data[i]);
+    text += byte;
+  }
+  return text;
+}
+
+VescCurrentLimits limits(double motor_min, double motor_max, double input_min, double input_max)
+{
+  VescCurrentLimits limits;
+  limits.motor_min = motor_min;
+  limits.motor_max = motor_max;
+  limits.input_min = input_min;
+  limits.input_max = input_max;
+  return limits;
+}
+
+mc_configuration configured()
+{
+  mc_configuration conf = mc_configuration();
+  conf.l_current_min = -50.0f;
+  conf.l_current_max = 60.0f;
+  conf.l_in_current_min = -40.0f;
+  conf.l_in_current_max = 99.0f;
+  conf.l_min_erpm = -100000.0f;
+  conf.l_max_erpm = 100000.0f;
+  conf.l_min_duty = 0.005f;
+  conf.l_max_duty = 0.95f;
+  conf.l_watt_min = -1500000.0f;
+  conf.l_watt_max = 1500000.0f;
+  return conf;
+}
+
+}  // namespace
+
+TEST(CurrentLimits, CanFrames)
+{
+  // comm_can.c: CONF_CURRENT_LIMITS 21, STORE 22, _IN 23, STORE_IN 24, min then max in mA
+  static_assert(CAN_PACKET_CONF_CURRENT_LIMITS == 21, "CAN packet ids changed");
+  static_assert(CAN_PACKET_CONF_STORE_CURRENT_LIMITS_IN == 24, "CAN packet ids changed");
+
+  std::vector<VescCanFrame> frames = limits(-20.0, 60.5, -10.0, 40.0).canFrames(7);
+  ASSERT_EQ(2u, frames.size());
+  EXPECT_EQ(0x1507u, frames[0].id);
+  EXPECT_EQ("ff ff b1 e0 00 00 ec 54", hex(frames[0]));
+  EXPECT_EQ(0x1707u, frames[1].id);
+  EXPECT_EQ("ff ff d8 f0 00 00 9c 40", hex(frames[1]));
+
+  VescCurrentLimits stored = limits(-20.0, 60.5, -10.0, 40.0);
+  stored.persist = true;
+  frames = stored.canFrames(7);
+  ASSERT_EQ(2u, frames.size());
+  EXPECT_EQ(0x1607u, frames[0].id);
+  EXPECT_EQ(0x1807u, frames[1].id);
+  EXPECT_EQ("ff ff d8 f0 00 00 9c 40", hex(frames[1]));
+}
+
+TEST(CurrentLimits, OnlyCompletePairs)
+{
+  EXPECT_TRUE(VescCurrentLimits().canFrames(1).empty());
+  // a pair is only sent once both of its limits are set
+  EXPECT_TRUE(limits(-20.0, 0.0, 0.0, 40.0).canFrames(1).empty());
+  std::vector<VescCanFrame> frames = limits(0.0, 0.0, -10.0, 40.0).canFrames(1);
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_EQ(0x1701u, frames[0].id);
+}
+
+TEST(CurrentLimits, McconfTempScales)
+{
+  bool capped = true;
+  VescPacketSetMcconfTemp::Limits temp =
+    limits(-25.0, 30.0, -10.0, 40.0).mcconfTemp(configured(), &capped);
+  EXPECT_FALSE(capped);
+  EXPECT_DOUBLE_EQ(0.5, temp.current_min_scale);
+  EXPECT_DOUBLE_EQ(0.5, temp.current_max_scale);
+  // the input currents are absolute in the packet
+  EXPECT_DOUBLE_EQ(-10.0, temp.in_current_min);
+  EXPECT_DOUBLE_EQ(40.0, temp.in_current_max);
+  // everything else is written back as configured
+  EXPECT_FLOAT_EQ(-100000.0f, temp.min_erpm);
+  EXPECT_FLOAT_EQ(100000.0f, temp.max_erpm);
+  EXPECT_FLOAT_EQ(0.005f, temp.min_duty);
+  EXPECT_FLOAT_EQ(0.95f, temp.max_duty);
+  EXPECT_FLOAT_EQ(-1500000.0f, temp.watt_min);
+  EXPECT_FLOAT_EQ(1500000.0f, temp.watt_max);
+}
+
+TEST(CurrentLimits, McconfTempCapsAtConfigured)
+{
+  bool capped = false;
+  VescPacketSetMcconfTemp::Limits temp =
+    limits(-80.0, 90.0, -60.0, 150.0).mcconfTemp(configured(), &capped);
+  EXPECT_TRUE(capped);
+  EXPECT_DOUBLE_EQ(1.0, temp.current_min_scale);
+  EXPECT_DOUBLE_EQ(1.0, temp.current_max_scale);
+  // input currents are not relative to the configuration, they pass through uncapped
+  EXPECT_DOUBLE_EQ(-60.0, temp.in_current_min);
+  EXPECT_DOUBLE_EQ(150.0, temp.in_current_max);
+}
+
+TEST(CurrentLimits, McconfTempKeepsUnsetPairs)
+{
+  bool capped = true;
+  VescPacketSetMcconfTemp::Limits temp =
+    limits(0.0, 0.0, -10.0, 0.0).mcconfTemp(configured(), &capped);
+  EXPECT_FALSE(capped);
+  EXPECT_DOUBLE_EQ(1.0, temp.current_min_scale);
+  EXPECT_DOUBLE_EQ(1.0, temp.current_max_scale);
+  EXPECT_FLOAT_EQ(-40.0f, temp.in_current_min);
+  EXPECT_FLOAT_EQ(99.0f, temp.in_current_max);
+}
+
+TEST(CurrentLimits, UpdateChecksSigns)
+{
+  VescCurrentLimits current = limits(-20.0, 60.0, 0.0, 0.0);
+  std::string reason;
+  EXPECT_FALSE(
+    current.update(
+      {rclcpp::Parameter("motor_current_max", 30.0),
+        rclcpp::Parameter("motor_current_min", 5.0)}, &reason));
+  EXPECT_EQ("motor_current_min must not be positive", reason);
+  // nothing of a rejected change is applied
+  EXPECT_EQ(limits(-20.0, 60.0, 0.0, 0.0), current);
+
+  EXPECT_TRUE(
+    current.update(
+      {rclcpp::Parameter("input_current_max", 40.0),
+        rclcpp::Parameter("persist_current_limits", true),
+        rclcpp::Parameter("unrelated", 1.0)}, &reason));
+  EXPECT_DOUBLE_EQ(40.0, current.input_max);
+  EXPECT_TRUE(current.persist);
+  EXPECT_FALSE(current.hasInput());
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,251 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vesc_driver/vesc_device_registry.hpp"
+#include "vesc_driver/vesc_device_uuid_lookup.hpp"
+#include "vesc_simulator_process.hpp"
+
+namespace vesc_driver
+{
+namespace
+{
+
+/** A fresh directory for a registry, removed with its files afterwards */
+class RegistryTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    char dir_template[] = "/tmp/vesc_registry_test_XXXXXX";
+    ASSERT_NE(nullptr, ::mkdtemp(dir_template));
+    dir_ = dir_template;
+    ::chmod(dir_.c_str(), 0755);
+    path_ = dir_ + "/devices";
+  }
+
+  void TearDown() override
+  {
+    for (const char * name : {"devices", "link", "other", "sub/devices"}) {
+      ::unlink((dir_ + "/" + name).c_str());
+    }
+    ::rmdir((dir_ + "/sub").c_str());
+    ::rmdir(dir_.c_str());
+  }
+
+  /** The ownership checks only pass for files written by root */
+  bool root() const
+  {
+    return ::geteuid() == 0;
+  }
+
+  std::string dir_;
+  std::string path_;
+};
+
+VescDeviceInfo device(const std::string & port, const std::string & uuid)
+{
+  VescDeviceInfo info;
+  info.port = port;
+  info.uuid = uuid;
+  info.hwname = "60 MK5";
+  info.fw_major = 5;
+  info.fw_minor = 3;
+  return info;
+}
+
+}  // namespace
+
+TEST_F(RegistryTest, RoundTrip)
+{
+  if (!root()) {
+    // a registry not owned by root is never written or read
+    EXPECT_FALSE(VescDeviceRegistry(path_).update(device("/dev/ttyACM0", "a")));
+    return;
+  }
+  ASSERT_TRUE(VescDeviceRegistry(path_).update(device("/dev/ttyACM0", "a")));
+  // a second writer merges its entries with the file's
+  ASSERT_TRUE(
+    VescDeviceRegistry(path_).update(
+      {device("/dev/ttyACM1", "b"), device("/dev/ttyACM2", "c")}));
+
+  VescDeviceRegistry registry(path_);
+  ASSERT_TRUE(registry.load());
+  EXPECT_EQ(3u, registry.devices().size());
+  VescDeviceInfo info;
+  ASSERT_TRUE(registry.findByUuid("b", &info));
+  EXPECT_EQ("/dev/ttyACM1", info.port);
+  EXPECT_EQ("60 MK5", info.hwname);
+  EXPECT_EQ(5, info.fw_major);
+  EXPECT_EQ(3, info.fw_minor);
+  ASSERT_TRUE(registry.findByPort("/dev/ttyACM2", &info));
+  EXPECT_EQ("c", info.uuid);
+  EXPECT_FALSE(registry.findByUuid("d", &info));
+
+  // the device on a port is replaced, ports that did not answer are dropped
+  ASSERT_TRUE(
+    VescDeviceRegistry(path_).update({device("/dev/ttyACM0", "d")}, {"/dev/ttyACM1"}));
+  ASSERT_TRUE(registry.load());
+  EXPECT_EQ(2u, registry.devices().size());
+  EXPECT_FALSE(registry.findByUuid("a", &info));
+  EXPECT_FALSE(registry.findByUuid("b", &info));
+  ASSERT_TRUE(registry.findByUuid("d", &info));
+  EXPECT_EQ("/dev/ttyACM0", info.port);
+
+  struct stat st;
+  ASSERT_EQ(0, ::stat(path_.c_str(), &st));
+  EXPECT_EQ(0644u, st.st_mode & 0777);
+}
+
+TEST_F(RegistryTest, ConcurrentUpdates)
+{
+  if (!root()) {
+    return;
+  }
+  // the file is locked across read, merge and write, so no writer's entry is lost
+  std::vector<std::thread> writers;
+  for (int i = 0; i < 8; i++) {
+    writers.emplace_back(
+      [this, i] {
+        for (int j = 0; j < 10; j++) {
+          VescDeviceRegistry(path_).update(
+            device("/dev/ttyACM" + std::to_string(10 * i + j), std::to_string(10 * i + j)));
+        }
+      });
+  }
+  for (auto & writer : writers) {
+    writer.join();
+  }
+  VescDeviceRegistry registry(path_);
+  ASSERT_TRUE(registry.load());
+  EXPECT_EQ(80u, registry.devices().size());
+}
+
+TEST_F(RegistryTest, IgnoresWritableFile)
+{
+  if (!root()) {
+    return;
+  }
+  ASSERT_TRUE(VescDeviceRegistry(path_).update(device("/dev/ttyACM0", "a")));
+  ::chmod(path_.c_str(), 0666);
+  EXPECT_FALSE(VescDeviceRegistry(path_).load());
+  // nor is a planted file updated
+  EXPECT_FALSE(VescDeviceRegistry(path_).update(device("/dev/ttyACM1", "b")));
+}
+
+TEST_F(RegistryTest, IgnoresWritableDirectory)
+{
+  if (!root()) {
+    return;
+  }
+  ASSERT_TRUE(VescDeviceRegistry(path_).update(device("/dev/ttyACM0", "a")));
+  ::chmod(dir_.c_str(), 0777);
+  EXPECT_FALSE(VescDeviceRegistry(path_).load());
+  EXPECT_FALSE(VescDeviceRegistry(path_).update(device("/dev/ttyACM1", "b")));
+}
+
+TEST_F(RegistryTest, IgnoresLinks)
+{
+  if (!root()) {
+    return;
+  }
+  std::string other = dir_ + "/other";
+  ASSERT_TRUE(VescDeviceRegistry(other).update(device("/dev/ttyACM0", "a")));
+
+  // a symlink is not followed
+  ASSERT_EQ(0, ::symlink(other.c_str(), path_.c_str()));
+  EXPECT_FALSE(VescDeviceRegistry(path_).load());
+  ::unlink(path_.c_str());
+
+  // nor is a file with a second hard link, it could be changed through the other name
+  ASSERT_EQ(0, ::link(other.c_str(), path_.c_str()));
+  EXPECT_FALSE(VescDeviceRegistry(path_).load());
+}
+
+TEST_F(RegistryTest, CreatesDirectory)
+{
+  if (!root()) {
+    return;
+  }
+  std::string path = dir_ + "/sub/devices";
+  ASSERT_TRUE(VescDeviceRegistry(path).update(device("/dev/ttyACM0", "a")));
+  VescDeviceRegistry registry(path);
+  EXPECT_TRUE(registry.load());
+  EXPECT_EQ(1u, registry.devices().size());
+}
+
+TEST(DeviceLookup, Discover)
+{
+  Simulator simulator({"--duration", "30"}, 2);
+  ASSERT_EQ(2u, simulator.ports().size());
+
+  std::vector<std::string> ports = simulator.ports();
+  ports.push_back("/dev/does-not-exist");
+  std::vector<VescDeviceInfo> devices = VescDeviceLookup::discover(ports, 1000);
+
+  // the missing port is left out, the simulated VESCs are in the order of the ports
+  ASSERT_EQ(2u, devices.size());
+  for (size_t i = 0; i < devices.size(); i++) {
+    EXPECT_EQ(simulator.ports()[i], devices[i].port);
+    EXPECT_EQ("505152-535455-565758-595a0" + std::to_string(i), devices[i].uuid);
+    EXPECT_EQ("VESC SIM", devices[i].hwname);
+    EXPECT_EQ(5, devices[i].fw_major);
+    EXPECT_EQ(2, devices[i].fw_minor);
+  }
+}
+
+TEST(DeviceLookup, DiscoverTimesOut)
+{
+  // a terminal nobody answers on
+  int master = ::posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_GE(master, 0);
+  ASSERT_EQ(0, ::grantpt(master));
+  ASSERT_EQ(0, ::unlockpt(master));
+  std::string port = ::ptsname(master);
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(VescDeviceLookup::discover({port}, 200).empty());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(150));
+  EXPECT_LT(elapsed, std::chrono::seconds(1));
+  ::close(master);
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,148 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vesc_driver/vesc_firmware_upload.hpp"
+#include "vesc_driver/vesc_interface.hpp"
+#include "vesc_driver/vesc_reactor.hpp"
+#include "vesc_simulator_process.hpp"
+
+namespace vesc_driver
+{
+namespace
+{
+
+Buffer image(size_t size)
+{
+  std::mt19937 random(60);
+  Buffer data(size);
+  for (auto & byte : data) {
+    byte = static_cast<uint8_t>(random());
+  }
+  return data;
+}
+
+/** Upload @p firmware to the simulator as vesc_fw_upload does, and start the bootloader */
+VescFirmwareUploader::Result upload(
+  Simulator * simulator, const Buffer & firmware, const VescFirmwareUploader::Options & options)
+{
+  VescInterface vesc;
+  vesc.setReactor(std::make_shared<VescReactor>());
+  VescFirmwareUploader uploader(&vesc, options);
+  vesc.setPacketHandler(
+    [&uploader](const VescPacketConstPtr & packet) {uploader.handlePacket(packet);});
+  vesc.setErrorHandler([](const std::string &) {});
+  vesc.connect(simulator->port());
+
+  VescFirmwareUploader::Result result = uploader.upload(firmware);
+  if (result.success) {
+    uploader.jumpToBootloader();
+    // let the write go out before the port is closed
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return result;
+}
+
+VescFirmwareUploader::Options fastOptions()
+{
+  VescFirmwareUploader::Options options;
+  options.chunk_timeout = std::chrono::milliseconds(100);
+  options.erase_timeout = std::chrono::milliseconds(2000);
+  return options;
+}
+
+}  // namespace
+
+TEST(FirmwareUpload, Windowed)
+{
+  Simulator simulator({"--duration", "30"});
+  ASSERT_FALSE(simulator.port().empty());
+  const Buffer firmware = image(20000);
+
+  VescFirmwareUploader::Result result = upload(&simulator, firmware, fastOptions());
+  ASSERT_TRUE(result.success) << result.error;
+  EXPECT_EQ(firmware.size() + 6, result.image_bytes);
+  EXPECT_EQ((firmware.size() + 6 + 383) / 384, result.chunks);
+  EXPECT_EQ(0u, result.resent);
+  EXPECT_TRUE(simulator.waitFor("20000 byte image verified"));
+}
+
+TEST(FirmwareUpload, ResendsDroppedAcknowledgements)
+{
+  Simulator simulator({"--drop-every", "7", "--duration", "30"});
+  ASSERT_FALSE(simulator.port().empty());
+  const Buffer firmware = image(20000);
+
+  VescFirmwareUploader::Result result = upload(&simulator, firmware, fastOptions());
+  ASSERT_TRUE(result.success) << result.error;
+  // every 7th write goes unacknowledged and is written again after the chunk timeout
+  EXPECT_GE(result.resent, result.chunks / 7);
+  EXPECT_GT(result.wire_bytes, result.image_bytes);
+  EXPECT_TRUE(simulator.waitFor("20000 byte image verified"));
+}
+
+TEST(FirmwareUpload, WithoutOffsets)
+{
+  // firmware before 3.x: one chunk in flight, each acknowledgement belongs to it
+  Simulator simulator({"--no-offset", "--duration", "30"});
+  ASSERT_FALSE(simulator.port().empty());
+  const Buffer firmware = image(5000);
+
+  VescFirmwareUploader::Result result = upload(&simulator, firmware, fastOptions());
+  ASSERT_TRUE(result.success) << result.error;
+  EXPECT_EQ(0u, result.resent);
+  EXPECT_TRUE(simulator.waitFor("5000 byte image verified"));
+}
+
+TEST(FirmwareUpload, GivesUpWithoutAcknowledgements)
+{
+  Simulator simulator({"--drop-every", "1", "--duration", "30"});
+  ASSERT_FALSE(simulator.port().empty());
+
+  VescFirmwareUploader::Options options = fastOptions();
+  options.retries = 2;
+  auto start = std::chrono::steady_clock::now();
+  VescFirmwareUploader::Result result = upload(&simulator, image(5000), options);
+  EXPECT_FALSE(result.success);
+  EXPECT_FALSE(result.error.empty());
+  // the first chunk, alone in flight, is tried 1 + retries times
+  EXPECT_EQ(2u, result.resent);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,331 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+#include "vesc_driver/vesc_packet_codec.hpp"
+#include "vesc_driver/vesc_packet_factory.hpp"
+
+namespace vesc_driver
+{
+namespace
+{
+
+typedef codec::PacketSchema<COMM_SET_CURRENT, codec::Field<int32_t, 1000>> SetCurrentSchema;
+typedef codec::PacketSchema<42,
+    codec::Field<int16_t, 10>,
+    codec::Field<uint8_t>,
+    codec::Float32Auto,
+    codec::Field<int32_t, 100>> MixedSchema;
+
+/** @p frame as hex bytes, e.g. "02 01 00 00 00 03" */
+std::string hex(const Buffer & frame)
+{
+  std::string out;
+  char byte[4];
+  for (uint8_t b : frame) {
+    std::snprintf(byte, sizeof(byte), out.empty() ? "%02x" : " %02x", b);
+    out += byte;
+  }
+  return out;
+}
+
+/** Parse @p payload, framed as the VESC sends it, with the packet factory */
+VescPacketConstPtr parse(const Buffer & payload)
+{
+  Buffer frame{VescFrame::VESC_SOF_VAL_SMALL_FRAME, static_cast<uint8_t>(payload.size())};
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  uint16_t crc = codec::crc16(payload.data(), payload.size());
+  frame.push_back(static_cast<uint8_t>(crc >> 8));
+  frame.push_back(static_cast<uint8_t>(crc & 0xFF));
+  frame.push_back(VescFrame::VESC_EOF_VAL);
+  int bytes_needed = 0;
+  std::string error;
+  return VescPacketFactory::createPacket(frame.begin(), frame.end(), &bytes_needed, &error);
+}
+
+/** The firmware's buffer_append_float32_auto() */
+uint32_t firmwareFloat32Auto(float number)
+{
+  // the firmware writes numbers near the denormal range as zero
+  if (std::fabs(number) < 1.5e-38f) {
+    number = 0.0f;
+  }
+  int e = 0;
+  float sig = std::frexp(number, &e);
+  float sig_abs = std::fabs(sig);
+  uint32_t sig_i = 0;
+  if (sig_abs >= 0.5f) {
+    sig_i = static_cast<uint32_t>((sig_abs - 0.5f) * 2.0f * 8388608.0f);
+    e += 126;
+  }
+  uint32_t res = ((e & 0xFF) << 23) | (sig_i & 0x7FFFFF);
+  if (sig < 0) {
+    res |= 1u << 31;
+  }
+  return res;
+}
+
+}  // namespace
+
+TEST(PacketCodec, Crc16)
+{
+  EXPECT_EQ(0x31C3, codec::crc16Of('1', '2', '3', '4', '5', '6', '7', '8', '9'));
+  const uint8_t mcconf[] = {COMM_GET_MCCONF};
+  EXPECT_EQ(0xE1CE, codec::crc16(mcconf, sizeof(mcconf)));
+}
+
+// the layout is computed at compile time
+static_assert(SetCurrentSchema::PAYLOAD_SIZE == 5, "id and one int32");
+static_assert(SetCurrentSchema::offset<0>() == 1, "fields follow the id");
+static_assert(MixedSchema::NUM_FIELDS == 4, "field count");
+static_assert(MixedSchema::FIELDS_SIZE == 11, "fields packed without padding");
+static_assert(MixedSchema::PAYLOAD_SIZE == 12, "fields and the id");
+static_assert(MixedSchema::offset<1>() == 3, "after the int16");
+static_assert(MixedSchema::offset<2>() == 4, "after the uint8");
+static_assert(MixedSchema::offset<3>() == 8, "after the float");
+
+TEST(PacketCodec, SchemaRoundTrip)
+{
+  Buffer payload(MixedSchema::PAYLOAD_SIZE, 0);
+  MixedSchema::encode(payload.begin(), -12.3, 200, 3.25, 1234.5);
+  EXPECT_EQ("2a ff 85 c8 40 50 00 00 00 01 e2 3a", hex(payload));
+
+  EXPECT_EQ(-123, MixedSchema::read<0>(payload.begin()));
+  EXPECT_DOUBLE_EQ(-12.3, MixedSchema::decode<0>(payload.begin()));
+  EXPECT_EQ(200, MixedSchema::read<1>(payload.begin()));
+  EXPECT_FLOAT_EQ(3.25f, MixedSchema::read<2>(payload.begin()));
+  EXPECT_DOUBLE_EQ(1234.5, MixedSchema::decode<3>(payload.begin()));
+}
+
+TEST(PacketCodec, CanFrameSchema)
+{
+  typedef codec::CanFrameSchema<CAN_PACKET_STATUS,
+      codec::Field<int32_t>, codec::Field<int16_t, 10>, codec::Field<int16_t, 1000>> StatusSchema;
+  static_assert(StatusSchema::SIZE == 8, "fills the frame");
+  static_assert(StatusSchema::offset<2>() == 6, "no packet id in the data");
+
+  uint8_t data[8] = {0};
+  StatusSchema::encode(data, -10000, 12.3, 0.5);
+  EXPECT_EQ(-10000, StatusSchema::read<0>(data));
+  EXPECT_DOUBLE_EQ(12.3, StatusSchema::decode<1>(data));
+  EXPECT_DOUBLE_EQ(0.5, StatusSchema::decode<2>(data));
+  EXPECT_EQ(0x0968u, codec::canId(CAN_PACKET_STATUS, 0x68));
+}
+
+TEST(PacketCodec, ConstantFrame)
+{
+  typedef codec::ConstantFrame<COMM_FW_VERSION> FWVersionFrame;
+  typedef codec::ConstantFrame<COMM_GET_MCCONF> McConfFrame;
+  static_assert(FWVersionFrame::SIZE == 6, "start, length, id, crc and end");
+  EXPECT_EQ(
+    "02 01 00 00 00 03", hex(Buffer(FWVersionFrame::BYTES, FWVersionFrame::BYTES + 6)));
+  EXPECT_EQ("02 01 0e e1 ce 03", hex(Buffer(McConfFrame::BYTES, McConfFrame::BYTES + 6)));
+
+  // the request packets are sent from their constant frames
+  EXPECT_EQ("02 01 00 00 00 03", hex(VescPacketRequestFWVersion().frame()));
+  EXPECT_EQ("02 01 0e e1 ce 03", hex(VescPacketRequestMcConf().frame()));
+  EXPECT_EQ("02 01 11 02 10 03", hex(VescPacketRequestAppConf().frame()));
+  EXPECT_EQ("02 01 04 40 84 03", hex(VescPacketRequestValues().frame()));
+  EXPECT_EQ("02 01 01 10 21 03", hex(VescPacketJumpToBootloader().frame()));
+}
+
+TEST(PacketCodec, CommandFrames)
+{
+  EXPECT_EQ("02 05 05 00 00 30 39 81 b8 03", hex(VescPacketSetDuty(0.123456).frame()));
+  EXPECT_EQ("02 05 05 ff ff 3c b0 40 b4 03", hex(VescPacketSetDuty(-0.5).frame()));
+  EXPECT_EQ("02 05 06 ff ff fe 0c b8 07 03", hex(VescPacketSetCurrent(-0.5).frame()));
+  EXPECT_EQ("02 05 07 00 00 03 e8 4e a1 03", hex(VescPacketSetCurrentBrake(1.0).frame()));
+  EXPECT_EQ("02 05 08 00 01 81 cd 15 55 03", hex(VescPacketSetRPM(98765.4321).frame()));
+  EXPECT_EQ("02 05 09 f8 a4 36 00 7c 9d 03", hex(VescPacketSetPos(-123.456).frame()));
+  EXPECT_EQ("02 03 0c 03 e8 5c 14 03", hex(VescPacketSetServoPos(1.0).frame()));
+  EXPECT_EQ("02 02 0b 03 ec 99 03", hex(VescPacketSetDetect(3).frame()));
+  EXPECT_EQ("02 03 41 12 34 39 5b 03", hex(VescPacketRequestImu(0x1234).frame()));
+  EXPECT_EQ("02 05 13 02 03 e8 07 b7 4c 03", hex(VescPacketRequestSample(2, 1000, 7).frame()));
+  EXPECT_EQ("02 05 02 de ad be ef 80 d4 03", hex(VescPacketEraseNewApp(0xDEADBEEF).frame()));
+  EXPECT_EQ("02 07 14 66 61 75 6c 74 73 0d 9a 03", hex(VescPacketTerminalCmd("faults").frame()));
+
+  Buffer data{1, 2, 3, 4};
+  EXPECT_EQ(
+    "02 09 03 01 02 03 04 01 02 03 04 40 91 03",
+    hex(VescPacketWriteNewAppData(0x01020304, data.begin(), data.end()).frame()));
+}
+
+TEST(PacketCodec, SetMcconfTemp)
+{
+  VescPacketSetMcconfTemp::Limits limits{
+    0.5, 0.8, -10000, 10000, 0.005, 0.95, -1000, 1500, -10, 40};
+  EXPECT_EQ(
+    "02 2d 30 01 00 00 00 3f 00 00 00 3f 4c cc cd c6 1c 40 00 46 1c 40 00 3b a3 d7 0a 3f 73 33 33 "
+    "c4 7a 00 00 44 bb 80 00 c1 20 00 00 42 20 00 00 8e f3 03",
+    hex(VescPacketSetMcconfTemp(limits, true).frame()));
+}
+
+TEST(PacketCodec, Replies)
+{
+  auto imu = std::dynamic_pointer_cast<VescPacketImu const>(
+    parse({COMM_GET_IMU_DATA, 0x00, 0x07,  // mask: roll, pitch, yaw
+      0x3f, 0x80, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x00, 0x40, 0x49, 0x0f, 0xdb}));  // 1, -2, pi rad
+  ASSERT_TRUE(imu);
+  EXPECT_EQ(7, imu->mask());
+  EXPECT_NEAR(57.2958, imu->roll(), 1e-4);
+  EXPECT_NEAR(-114.592, imu->pitch(), 1e-3);
+  EXPECT_NEAR(180.0, imu->yaw(), 1e-4);
+
+  auto rotor = std::dynamic_pointer_cast<VescPacketRotorPosition const>(
+    parse({COMM_ROTOR_POSITION, 0xff, 0x12, 0x34, 0x56}));
+  ASSERT_TRUE(rotor);
+  EXPECT_NEAR(-155.8417, rotor->position(), 1e-4);
+
+  auto write = std::dynamic_pointer_cast<VescPacketWriteNewAppDataResult const>(
+    parse({COMM_WRITE_NEW_APP_DATA, 1, 0xaa, 0xbb, 0xcc, 0xdd}));
+  ASSERT_TRUE(write);
+  EXPECT_TRUE(write->ok());
+  EXPECT_TRUE(write->hasOffset());
+  EXPECT_EQ(0xaabbccddu, write->offset());
+
+  // firmware before 3.x does not echo the offset
+  auto old_write = std::dynamic_pointer_cast<VescPacketWriteNewAppDataResult const>(
+    parse({COMM_WRITE_NEW_APP_DATA, 1}));
+  ASSERT_TRUE(old_write);
+  EXPECT_TRUE(old_write->ok());
+  EXPECT_FALSE(old_write->hasOffset());
+  EXPECT_EQ(0u, old_write->offset());
+}
+
+TEST(PacketCodec, Sample)
+{
+  // mc_interface.c: eight float32_auto fields, then status and phase
+  const float fields[] = {12.5f, -3.25f, 24.0f, 23.5f, -0.5f, 12.0f, 9.75f, 30000.0f};
+  Buffer payload{COMM_SAMPLE_PRINT};
+  for (float field : fields) {
+    uint32_t word = encodeFloat32Auto(field);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      payload.push_back(static_cast<uint8_t>(word >> shift));
+    }
+  }
+  payload.push_back(2);   // status
+  payload.push_back(17);  // phase
+
+  auto sample = std::dynamic_pointer_cast<VescPacketSample const>(parse(payload));
+  ASSERT_TRUE(sample);
+  EXPECT_EQ(12.5f, sample->current0());
+  EXPECT_EQ(-3.25f, sample->current1());
+  EXPECT_EQ(24.0f, sample->voltage_ph1());
+  EXPECT_EQ(23.5f, sample->voltage_ph2());
+  EXPECT_EQ(-0.5f, sample->voltage_ph3());
+  EXPECT_EQ(12.0f, sample->voltage_zero());
+  EXPECT_EQ(9.75f, sample->current_fir());
+  EXPECT_EQ(30000.0f, sample->f_sw());
+  EXPECT_EQ(2, sample->status());
+  EXPECT_EQ(17, sample->phase());
+
+  // a truncated sample is left zeroed rather than read past the payload
+  payload.pop_back();
+  auto truncated = std::dynamic_pointer_cast<VescPacketSample const>(parse(payload));
+  ASSERT_TRUE(truncated);
+  EXPECT_EQ(0.0f, truncated->current0());
+  EXPECT_EQ(0.0f, truncated->f_sw());
+  EXPECT_EQ(0, truncated->phase());
+}
+
+TEST(PacketCodec, RequestSample)
+{
+  static_assert(COMM_SAMPLE_PRINT == 19, "command ids changed");
+  // mode, sample count, decimation
+  EXPECT_EQ("02 05 13 02 01 f4 04 af 51 03", hex(VescPacketRequestSample(2, 500, 4).frame()));
+}
+
+TEST(PacketCodec, FaultCode)
+{
+  // COMM_GET_VALUES: the fault code follows the temperatures, currents, duty, rpm, voltage, Ah,
+  // Wh and tachometers, at byte 53 counting the command id
+  Buffer payload(73, 0);
+  payload[0] = COMM_GET_VALUES;
+  payload[53] = FAULT_CODE_OVER_TEMP_FET;
+  auto values = std::dynamic_pointer_cast<VescPacketValues const>(parse(payload));
+  ASSERT_TRUE(values);
+  EXPECT_EQ(FAULT_CODE_OVER_TEMP_FET, values->fault_code());
+
+  payload[53] = FAULT_CODE_NONE;
+  values = std::dynamic_pointer_cast<VescPacketValues const>(parse(payload));
+  ASSERT_TRUE(values);
+  EXPECT_EQ(FAULT_CODE_NONE, values->fault_code());
+}
+
+TEST(PacketCodec, FaultCodeName)
+{
+  EXPECT_STREQ("FAULT_CODE_NONE", faultCodeName(FAULT_CODE_NONE));
+  EXPECT_STREQ("FAULT_CODE_OVER_TEMP_FET", faultCodeName(FAULT_CODE_OVER_TEMP_FET));
+  EXPECT_STREQ("FAULT_CODE_RESOLVER_LOS", faultCodeName(FAULT_CODE_RESOLVER_LOS));
+  // codes of newer firmware and garbage still get a name
+  EXPECT_NE(nullptr, faultCodeName(FAULT_CODE_RESOLVER_LOS + 1));
+  EXPECT_NE(nullptr, faultCodeName(-1));
+  EXPECT_STRNE(faultCodeName(FAULT_CODE_NONE), faultCodeName(FAULT_CODE_RESOLVER_LOS + 1));
+}
+
+TEST(Float32Auto, MatchesFirmwareEncoder)
+{
+  const float values[] = {
+    0.0f, 1.0f, -1.0f, 0.5f, 60.0f, -20.5f, 123456.789f, -1e-30f, 3.4e38f, 0.33f};
+  for (float value : values) {
+    uint32_t word = encodeFloat32Auto(value);
+    EXPECT_EQ(firmwareFloat32Auto(value), word) << value;
+    EXPECT_EQ(value, decodeFloat32Auto(word)) << value;
+  }
+
+  // denormals and numbers close to them are written as zero
+  EXPECT_EQ(0u, encodeFloat32Auto(1e-39f));
+  EXPECT_EQ(0u, encodeFloat32Auto(1.4e-38f));
+  EXPECT_EQ(0.0f, decodeFloat32Auto(encodeFloat32Auto(1e-39f)));
+}
+
+TEST(Float32Auto, RoundTrip)
+{
+  std::mt19937 random(51);
+  std::uniform_real_distribution<float> exponent(-120.0f, 120.0f);
+  std::uniform_real_distribution<float> mantissa(-1.0f, 1.0f);
+  for (int i = 0; i < 100000; i++) {
+    float value = std::ldexp(mantissa(random), static_cast<int>(exponent(random)));
+    uint32_t word = encodeFloat32Auto(value);
+    ASSERT_EQ(firmwareFloat32Auto(value), word) << value;
+    ASSERT_EQ(std::fabs(value) < 1.5e-38f ? 0.0f : value, decodeFloat32Auto(word)) << value;
+  }
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,163 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_SIMULATOR_PROCESS_HPP_
+#define VESC_SIMULATOR_PROCESS_HPP_
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifndef VESC_SIMULATOR
+#error "VESC_SIMULATOR must name the vesc_simulator executable"
+#endif
+
+namespace vesc_driver
+{
+
+/**
+ * vesc_simulator in a child process, with its output read through a pipe. It is killed when this
+ * is destroyed.
+ */
+class Simulator
+{
+public:
+  /** Start the simulator with @p options, simulating @p count VESCs */
+  explicit Simulator(const std::vector<std::string> & options, int count = 1)
+  {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      return;
+    }
+    pid_ = ::fork();
+    if (pid_ == 0) {
+      ::dup2(fds[1], STDOUT_FILENO);
+      ::close(fds[0]);
+      ::close(fds[1]);
+      std::string count_option = std::to_string(count);
+      std::vector<char *> argv{
+        const_cast<char *>(VESC_SIMULATOR), const_cast<char *>("--count"), &count_option[0]};
+      for (const auto & option : options) {
+        argv.push_back(const_cast<char *>(option.c_str()));
+      }
+      argv.push_back(nullptr);
+      ::execv(VESC_SIMULATOR, argv.data());
+      ::_exit(127);
+    }
+    ::close(fds[1]);
+    out_ = fds[0];
+    // the pseudo terminals to connect to come first, one per line
+    for (int i = 0; i < count; i++) {
+      std::string port = readLine(std::chrono::seconds(5));
+      if (port.empty()) {
+        break;
+      }
+      ports_.push_back(port);
+    }
+  }
+
+  ~Simulator()
+  {
+    if (pid_ > 0) {
+      ::kill(pid_, SIGTERM);
+      ::waitpid(pid_, nullptr, 0);
+    }
+    if (out_ >= 0) {
+      ::close(out_);
+    }
+  }
+
+  /** The pseudo terminal of the first simulated VESC, empty if the simulator did not start */
+  std::string port() const
+  {
+    return ports_.empty() ? std::string() : ports_[0];
+  }
+
+  const std::vector<std::string> & ports() const
+  {
+    return ports_;
+  }
+
+  /** The next line the simulator prints, empty if none comes within @p timeout */
+  std::string readLine(std::chrono::milliseconds timeout)
+  {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+      size_t end = output_.find('\n');
+      if (end != std::string::npos) {
+        std::string line = output_.substr(0, end);
+        output_.erase(0, end + 1);
+        return line;
+      }
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+      struct pollfd pfd = {out_, POLLIN, 0};
+      char chunk[256];
+      ssize_t n = 0;
+      if (left.count() <= 0 || ::poll(&pfd, 1, static_cast<int>(left.count())) <= 0 ||
+        (n = ::read(out_, chunk, sizeof(chunk))) <= 0)
+      {
+        return "";
+      }
+      output_.append(chunk, n);
+    }
+  }
+
+  /** Wait for a line containing @p text */
+  bool waitFor(
+    const std::string & text, std::chrono::milliseconds timeout = std::chrono::seconds(2))
+  {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+      std::string line = readLine(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now()));
+      if (line.find(text) != std::string::npos) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  pid_t pid_ = -1;
+  int out_ = -1;
+  std::vector<std::string> ports_;
+  std::string output_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_SIMULATOR_PROCESS_HPP_